@@ -0,0 +1,330 @@
+//----------------------------------------------------------------------
+// benchmark of the ODBC plugin on Linux
+//----------------------------------------------------------------------
+// usage: odbcbench [connection string] [rows]
+//
+// the plugin is built into this program with the stand-ins of include/,
+// and runs against any unixODBC driver, the SQLite3 ODBC driver by default.
+// rows/sec and the allocations per row of each query are reported.
+#include <new>
+#include <string>
+
+#include "../main.cpp"
+
+//----------------------------------------------------------------------
+// Allocations
+//----------------------------------------------------------------------
+static volatile size_t allocations = 0;
+
+// all the replaced operators allocate and release through this pair. they
+// are not inlined, so the compiler does not see free() called on memory
+// returned by operator new.
+__attribute__((noinline)) static void *allocate(size_t size)
+{
+  allocations++;
+  void *p = malloc(size ? size : 1);
+  if (! p)
+    throw std::bad_alloc();
+  return p;
+}
+
+__attribute__((noinline)) static void release(void *p)
+{
+  free(p);
+}
+
+void *operator new(size_t size)
+{
+  return allocate(size);
+}
+
+void *operator new[](size_t size)
+{
+  return allocate(size);
+}
+
+void operator delete(void *p) noexcept
+{
+  release(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+  release(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+  release(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+  release(p);
+}
+
+//----------------------------------------------------------------------
+// Utility Functions
+//----------------------------------------------------------------------
+static ttstr fromUtf8(const char *s)
+{
+  std::vector<wchar_t> utf16;
+  bench_fromUtf8(s, utf16);
+  return ttstr(&utf16[0]);
+}
+
+static std::string toUtf8(const ttstr &s)
+{
+  std::vector<char> utf8;
+  bench_toUtf8(s.c_str(), s.length(), utf8);
+  return std::string(&utf8[0]);
+}
+
+static ttstr format(const wchar_t *fmt, tjs_int64 value)
+{
+  wchar_t buf[256];
+  swprintf_s(buf, fmt, (long long)value);
+  return ttstr(buf);
+}
+
+// a measurement: repeated until it takes long enough to be measured.
+struct Measure {
+  const char *name;
+  tjs_int64 units;
+  tjs_int64 time;
+  size_t allocations;
+
+  Measure(const char *_name) : name(_name), units(0), time(0), allocations(0) {}
+
+  bool running() const { return time < 200000 || units == 0; }
+
+  void report(const char *unit) const {
+    double seconds = time / 1000000.0;
+    printf("  %-40s %12.0f %s/sec %8.2f allocs/%s\n",
+           name,
+           seconds > 0 ? units / seconds : 0.0,
+           unit,
+           units ? double(allocations) / units : 0.0,
+           unit);
+    fflush(stdout);
+  }
+};
+
+#define MEASURE(m, count, statement)                    \
+  do {                                                  \
+    size_t startAllocations = allocations;              \
+    tjs_int64 startTime = getMicroseconds();            \
+    statement;                                          \
+    (m).time += getMicroseconds() - startTime;          \
+    (m).allocations += allocations - startAllocations;  \
+    (m).units += (count);                               \
+  } while (0)
+
+//----------------------------------------------------------------------
+// Tables
+//----------------------------------------------------------------------
+struct Table {
+  const char *name;
+  const wchar_t *create;
+  const wchar_t *insert;
+  tTJSVariant (*makeRow)(tjs_int id);
+};
+
+static tTJSVariant makeIntRow(tjs_int id)
+{
+  tTJSVariant row = createArray();
+  ncbPropAccessor rowObj(row);
+  rowObj.SetValue(0, id);
+  rowObj.SetValue(1, id * 7 % 1000);
+  rowObj.SetValue(2, tjs_int64(id) * 1000003);
+  rowObj.SetValue(3, -id);
+  return row;
+}
+
+static tTJSVariant makeTextRow(tjs_int id)
+{
+  tTJSVariant row = createArray();
+  ncbPropAccessor rowObj(row);
+  rowObj.SetValue(0, id);
+  rowObj.SetValue(1, format(L"name %lld", id));
+  rowObj.SetValue(2, format(L"a somewhat longer note for the row %lld, with 'quotes' in it", id));
+  return row;
+}
+
+static tTJSVariant makeMixedRow(tjs_int id)
+{
+  static const tjs_uint8 data[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+  tTJSVariant row = createArray();
+  ncbPropAccessor rowObj(row);
+  rowObj.SetValue(0, id);
+  rowObj.SetValue(1, format(L"item %lld", id));
+  rowObj.SetValue(2, id * 0.25);
+  rowObj.SetValue(3, createDate(tjs_int64(1500000000) * 1000 + tjs_int64(id) * 60000));
+  rowObj.SetValue(4, createOctet(data, id % 16));
+  return row;
+}
+
+static const Table tables[] = {
+  { "int",
+    L"CREATE TABLE bench_int (id INTEGER PRIMARY KEY, a INTEGER, b BIGINT, c INTEGER)",
+    L"INSERT INTO bench_int VALUES (?, ?, ?, ?)",
+    makeIntRow },
+  { "text",
+    L"CREATE TABLE bench_text (id INTEGER PRIMARY KEY, name VARCHAR(64), note VARCHAR(255))",
+    L"INSERT INTO bench_text VALUES (?, ?, ?)",
+    makeTextRow },
+  { "mixed",
+    L"CREATE TABLE bench_mixed (id INTEGER PRIMARY KEY, name VARCHAR(64), price DOUBLE, created TIMESTAMP, data BLOB)",
+    L"INSERT INTO bench_mixed VALUES (?, ?, ?, ?, ?)",
+    makeMixedRow },
+};
+
+static void createTable(ODBC &db, const Table &table, tjs_int rows)
+{
+  ttstr name = fromUtf8(table.name);
+  db._query(L"DROP TABLE IF EXISTS bench_" + name, qrtArray, tTJSVariant());
+  db._query(table.create, qrtArray, tTJSVariant());
+
+  Measure m("insert");
+  const tjs_int chunk = 1000;
+  db.begin();
+  for (tjs_int first = 0; first < rows; first += chunk) {
+    tTJSVariant values = createArray();
+    ncbPropAccessor valuesObj(values);
+    tjs_int count = std::min(chunk, rows - first);
+    for (tjs_int i = 0; i < count; i++)
+      valuesObj.SetValue(i, table.makeRow(first + i));
+    MEASURE(m, count, db.executeBatch(table.insert, values));
+  }
+  MEASURE(m, 0, db.commit());
+  printf("%s: %d rows\n", table.name, int(rows));
+  m.report("row");
+}
+
+//----------------------------------------------------------------------
+// Queries
+//----------------------------------------------------------------------
+static const struct {
+  const char *name;
+  QueryResultType type;
+} queryTypes[] = {
+  { "qrtArray", qrtArray },
+  { "qrtDictionary", qrtDictionary },
+  { "qrtSingleColumnArray", qrtSingleColumnArray },
+  { "qrtColumns", qrtColumns },
+  { "qrtResultSet", qrtResultSet },
+};
+
+static void benchQueries(ODBC &db, const Table &table, tjs_int rows)
+{
+  static const tjs_int sizes[] = { 100, 10000, 100000 };
+  ttstr name = fromUtf8(table.name);
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    tjs_int size = std::min(sizes[s], rows);
+    ttstr sql = L"SELECT * FROM bench_" + name + format(L" WHERE id < %lld", size);
+    printf("%s: %d rows\n", table.name, int(size));
+    for (size_t t = 0; t < sizeof(queryTypes) / sizeof(queryTypes[0]); t++) {
+      Measure m(queryTypes[t].name);
+      while (m.running())
+        MEASURE(m, size, db._query(sql, queryTypes[t].type, tTJSVariant()));
+      m.report("row");
+    }
+    if (size == rows)
+      break;
+  }
+}
+
+//----------------------------------------------------------------------
+// Escaping
+//----------------------------------------------------------------------
+static void benchEscape(void)
+{
+  std::vector<ttstr> strs;
+  tTJSVariant values = createArray();
+  ncbPropAccessor valuesObj(values);
+  for (tjs_int i = 0; i < 1000; i++) {
+    ttstr str = format(L"O'Reilly \\ \"%lld\" ", i);
+    if (i % 10 == 0)
+      str += L"\r\n\t";
+    strs.push_back(str);
+    valuesObj.SetValue(i, str);
+  }
+  const tjs_int count = tjs_int(strs.size());
+
+  printf("escape: %d strings\n", int(count));
+  static const struct {
+    const char *name;
+    ttstr (*func)(ttstr);
+  } funcs[] = {
+    { "escapeStringAccess", ODBC::escapeStringAccess },
+    { "escapeStringSQLServer", ODBC::escapeStringSQLServer },
+    { "escapeStringOracle", ODBC::escapeStringOracle },
+    { "escapeStringMySQL", ODBC::escapeStringMySQL },
+    { "escapeStringPostgreSQL", ODBC::escapeStringPostgreSQL },
+  };
+  {
+    Measure m("escapeString");
+    while (m.running())
+      MEASURE(m, count, for (tjs_int i = 0; i < count; i++) ODBC::_escapeString(strs[i], L"", L" + "));
+    m.report("call");
+  }
+  for (size_t f = 0; f < sizeof(funcs) / sizeof(funcs[0]); f++) {
+    Measure m(funcs[f].name);
+    while (m.running())
+      MEASURE(m, count, for (tjs_int i = 0; i < count; i++) funcs[f].func(strs[i]));
+    m.report("call");
+  }
+  {
+    Measure m("escapeStrings");
+    while (m.running())
+      MEASURE(m, count, ODBC::_escapeStrings(values, edGeneric));
+    m.report("string");
+  }
+  {
+    Measure m("buildInList");
+    while (m.running())
+      MEASURE(m, count, ODBC::_buildInList(values, edGeneric));
+    m.report("value");
+  }
+
+  tTJSVariant date = createDate(tjs_int64(1500000000) * 1000);
+  {
+    Measure m("encodeDate (Date)");
+    while (m.running())
+      MEASURE(m, count, for (tjs_int i = 0; i < count; i++) ODBC::encodeDate(date));
+    m.report("call");
+  }
+  {
+    Measure m("encodeDate (integer)");
+    while (m.running())
+      MEASURE(m, count, for (tjs_int i = 0; i < count; i++) ODBC::encodeDate(tjs_int64(1500000000) * 1000 + i));
+    m.report("call");
+  }
+}
+
+//----------------------------------------------------------------------
+// Main
+//----------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+  const char *connectStr = argc > 1 ? argv[1] : "DRIVER=SQLite3;Database=odbcbench.db";
+  tjs_int rows = argc > 2 ? tjs_int(atoi(argv[2])) : 100000;
+
+  int status = 0;
+  try {
+    benchEscape();
+
+    ODBC db;
+    db._connect(fromUtf8(connectStr));
+    db.setLogAffectedRows(false);
+    for (size_t t = 0; t < sizeof(tables) / sizeof(tables[0]); t++)
+      createTable(db, tables[t], rows);
+    for (size_t t = 0; t < sizeof(tables) / sizeof(tables[0]); t++)
+      benchQueries(db, tables[t], rows);
+  } catch (const eTJSError &e) {
+    fprintf(stderr, "error: %s\n", toUtf8(e.GetMessage()).c_str());
+    status = 1;
+  }
+  ncbUnregistAll();
+  return status;
+}
@@ -0,0 +1,141 @@
+//----------------------------------------------------------------------
+// ncbind.hpp stand-in for the benchmark build on Linux
+//----------------------------------------------------------------------
+// the accessors work on the objects of tp_stub.h. the registration only
+// checks the names and the types, the benchmark calls the classes directly.
+#ifndef BENCH_NCBIND_HPP
+#define BENCH_NCBIND_HPP
+
+#include "tp_stub.h"
+
+namespace ncbTypedefs {
+  template <class T> struct Tag {};
+}
+
+//----------------------------------------------------------------------
+// ncbPropAccessor
+//----------------------------------------------------------------------
+class ncbPropAccessor
+{
+  iTJSDispatch2 *mObj;
+
+public:
+  ncbPropAccessor(const tTJSVariant &value) : mObj(value.AsObjectNoAddRef()) {
+    if (mObj) mObj->AddRef();
+  }
+  ncbPropAccessor(iTJSDispatch2 *obj, bool addRef = true) : mObj(obj) {
+    if (mObj && addRef) mObj->AddRef();
+  }
+  ~ncbPropAccessor() {
+    if (mObj) mObj->Release();
+  }
+
+  bool IsValid() const { return mObj != NULL; }
+  iTJSDispatch2 *GetDispatch() const { return mObj; }
+
+  template <class T>
+  T GetValue(tjs_int num, ncbTypedefs::Tag<T>, tjs_uint32 flag = 0, tjs_uint32 *hint = NULL) {
+    tTJSVariant value;
+    if (mObj) mObj->PropGetByNum(flag, num, &value, mObj);
+    return T(value);
+  }
+
+  template <class T>
+  T GetValue(const tjs_char *name, ncbTypedefs::Tag<T>, tjs_uint32 flag = 0, tjs_uint32 *hint = NULL) {
+    tTJSVariant value;
+    if (mObj) mObj->PropGet(flag, name, hint, &value, mObj);
+    return T(value);
+  }
+
+  template <class T>
+  bool SetValue(tjs_int num, const T &value, tjs_uint32 flag = 0, tjs_uint32 *hint = NULL) {
+    tTJSVariant param(value);
+    return mObj && TJS_SUCCEEDED(mObj->PropSetByNum(flag, num, &param, mObj));
+  }
+
+  template <class T>
+  bool SetValue(const tjs_char *name, const T &value, tjs_uint32 flag = 0, tjs_uint32 *hint = NULL) {
+    tTJSVariant param(value);
+    return mObj && TJS_SUCCEEDED(mObj->PropSet(flag, name, hint, &param, mObj));
+  }
+
+  template <class... Args>
+  bool FuncCall(tjs_uint32 flag, const tjs_char *name, tjs_uint32 *hint, tTJSVariant *result, const Args &... args) {
+    tTJSVariant values[] = { tTJSVariant(), tTJSVariant(args)... };
+    tTJSVariant *params[sizeof...(Args) + 1];
+    for (size_t i = 0; i < sizeof...(Args); i++)
+      params[i] = &values[i + 1];
+    return mObj && TJS_SUCCEEDED(mObj->FuncCall(flag, name, hint, result,
+                                                tjs_int(sizeof...(Args)), params, mObj));
+  }
+};
+
+//----------------------------------------------------------------------
+// ncbInstanceAdaptor
+//----------------------------------------------------------------------
+// an object owning a native instance, as the ones ncbind creates.
+template <class T>
+class ncbInstanceAdaptor : public tTJSDispatch
+{
+  T *mInstance;
+
+  ncbInstanceAdaptor(T *instance) : mInstance(instance) {}
+
+public:
+  ~ncbInstanceAdaptor() { delete mInstance; }
+
+  static T *GetNativeInstance(iTJSDispatch2 *obj, bool error = false) {
+    ncbInstanceAdaptor *adaptor = dynamic_cast<ncbInstanceAdaptor *>(obj);
+    if (adaptor)
+      return adaptor->mInstance;
+    if (error)
+      TVPThrowExceptionMessage(L"Invalid object");
+    return NULL;
+  }
+
+  static iTJSDispatch2 *CreateAdaptor(T *instance, bool noRelease = false) {
+    return new ncbInstanceAdaptor(instance);
+  }
+};
+
+//----------------------------------------------------------------------
+// Registration
+//----------------------------------------------------------------------
+typedef tjs_error (TJS_INTF_METHOD *ncbRawCallback)(tTJSVariant *result, tjs_int numparams,
+                                                    tTJSVariant **param, iTJSDispatch2 *objthis);
+
+template <class C>
+struct ncbRegistBase {
+  typedef C Class;
+
+  template <class... Args> void Constructor(Args...) {}
+  void Variant(const char *name, int value) {}
+  template <class M> void Method(const tjs_char *name, M method) {}
+  void RawCallback(const tjs_char *name, ncbRawCallback callback, int flags) {}
+  template <class G, class S> void Property(const tjs_char *name, G getter, S setter) {}
+};
+
+#define NCB_REGISTER_CLASS(cls) \
+  struct ncbRegist_##cls : ncbRegistBase<cls> { ncbRegist_##cls(); }; \
+  static ncbRegist_##cls ncbRegistInstance_##cls; \
+  ncbRegist_##cls::ncbRegist_##cls()
+
+#define NCB_METHOD(name)                         Method(L ## #name, &Class::name)
+#define NCB_METHOD_RAW_CALLBACK(name, func, flag) RawCallback(L ## #name, &func, flag)
+#define NCB_PROPERTY(name, get, set)             Property(L ## #name, &Class::get, &Class::set)
+#define NCB_PROPERTY_RO(name, get)               Property(L ## #name, &Class::get, 0)
+#define NCB_PROPERTY_WO(name, set)               Property(L ## #name, 0, &Class::set)
+
+// the callbacks run from ncbUnregistAll(), as the plugin is unloaded.
+typedef void (*ncbCallback)(void);
+void ncbAddUnregistCallback(ncbCallback callback);
+void ncbUnregistAll(void);
+
+struct ncbUnregistCallback {
+  ncbUnregistCallback(ncbCallback callback) { ncbAddUnregistCallback(callback); }
+};
+
+#define NCB_PRE_UNREGIST_CALLBACK(func) \
+  static ncbUnregistCallback ncbPreUnregist_##func(&func)
+
+#endif
@@ -0,0 +1,19 @@
+//----------------------------------------------------------------------
+// process.h stand-in for the benchmark build on Linux
+//----------------------------------------------------------------------
+#ifndef BENCH_PROCESS_H
+#define BENCH_PROCESS_H
+
+#include <windows.h>
+
+#define __stdcall
+
+// starts the thread at once. the handle is released by CloseHandle.
+uintptr_t _beginthreadex(void *security,
+                         unsigned stackSize,
+                         unsigned (*startAddress)(void *),
+                         void *argument,
+                         unsigned initFlag,
+                         unsigned *threadId);
+
+#endif
@@ -0,0 +1,345 @@
+//----------------------------------------------------------------------
+// tp_stub.h stand-in for the benchmark build on Linux
+//----------------------------------------------------------------------
+// a small TJS: strings, variants, Array, Dictionary and Date objects,
+// enough to run the conversions of main.cpp outside of kirikiri.
+#ifndef BENCH_TP_STUB_H
+#define BENCH_TP_STUB_H
+
+#include <windows.h>
+#include <map>
+
+//----------------------------------------------------------------------
+// Types
+//----------------------------------------------------------------------
+typedef wchar_t tjs_char;
+typedef int32_t tjs_int;
+typedef uint32_t tjs_uint;
+typedef int64_t tjs_int64;
+typedef uint64_t tjs_uint64;
+typedef uint8_t tjs_uint8;
+typedef uint32_t tjs_uint32;
+typedef int32_t tjs_int32;
+typedef double tjs_real;
+typedef int32_t tjs_error;
+
+#define TJS_INTF_METHOD
+
+#define TJS_S_OK                0
+#define TJS_S_TRUE              1
+#define TJS_S_FALSE             2
+#define TJS_E_MEMBERNOTFOUND    (-1001)
+#define TJS_E_NOTIMPL           (-1002)
+#define TJS_E_INVALIDPARAM      (-1003)
+#define TJS_E_BADPARAMCOUNT     (-1004)
+#define TJS_E_INVALIDTYPE       (-1005)
+#define TJS_E_INVALIDOBJECT     (-1006)
+#define TJS_E_NATIVECLASSCRASH  (-1008)
+#define TJS_E_FAIL              (-1)
+#define TJS_FAILED(x)           ((x) < 0)
+#define TJS_SUCCEEDED(x)        ((x) >= 0)
+
+#define TJS_MEMBERMUSTEXIST     0x00000200
+
+#define TJS_BS_READ             0
+#define TJS_BS_WRITE            1
+
+class tTJSVariant;
+class iTJSDispatch2;
+
+//----------------------------------------------------------------------
+// tTJSString
+//----------------------------------------------------------------------
+class tTJSString
+{
+  // null terminated, empty for the empty string.
+  std::vector<tjs_char> mBuf;
+
+public:
+  tTJSString() {}
+  tTJSString(const tjs_char *str) { assign(str, str ? wcslen(str) : 0); }
+  tTJSString(const tjs_char *str, int length) { assign(str, length); }
+  tTJSString(tjs_int n);
+  tTJSString(const tTJSVariant &value);
+
+  const tjs_char *c_str() const {
+    static const tjs_char empty = 0;
+    return mBuf.empty() ? &empty : &mBuf[0];
+  }
+  tjs_int length() const { return mBuf.empty() ? 0 : tjs_int(mBuf.size() - 1); }
+  tjs_int GetLen() const { return length(); }
+  bool IsEmpty() const { return mBuf.empty(); }
+  tjs_char operator[](tjs_int i) const { return c_str()[i]; }
+
+  tTJSString &operator+=(const tTJSString &str) { append(str.c_str(), str.length()); return *this; }
+  tTJSString &operator+=(const tjs_char *str) { append(str, wcslen(str)); return *this; }
+  tTJSString &operator+=(tjs_char c) { append(&c, 1); return *this; }
+  tTJSString operator+(const tTJSString &str) const { tTJSString result(*this); result += str; return result; }
+  tTJSString operator+(const tjs_char *str) const { tTJSString result(*this); result += str; return result; }
+  tTJSString operator+(tjs_char c) const { tTJSString result(*this); result += c; return result; }
+
+  bool operator==(const tTJSString &str) const { return mBuf == str.mBuf; }
+  bool operator!=(const tTJSString &str) const { return mBuf != str.mBuf; }
+  bool operator==(const tjs_char *str) const { return wcscmp(c_str(), str) == 0; }
+  bool operator!=(const tjs_char *str) const { return wcscmp(c_str(), str) != 0; }
+  bool operator<(const tTJSString &str) const { return wcscmp(c_str(), str.c_str()) < 0; }
+
+private:
+  void assign(const tjs_char *str, size_t length);
+  void append(const tjs_char *str, size_t length);
+  static int wcscmp(const tjs_char *s1, const tjs_char *s2);
+};
+typedef tTJSString ttstr;
+
+inline ttstr operator+(const tjs_char *s1, const ttstr &s2) { return ttstr(s1) + s2; }
+
+//----------------------------------------------------------------------
+// tTJSVariantOctet
+//----------------------------------------------------------------------
+class tTJSVariantOctet
+{
+  tjs_int mRefCount;
+  std::vector<tjs_uint8> mData;
+
+public:
+  tTJSVariantOctet(const tjs_uint8 *data, tjs_uint length)
+    : mRefCount(1), mData(data, data + length) {}
+  void AddRef() { mRefCount++; }
+  void Release() { if (--mRefCount == 0) delete this; }
+  const tjs_uint8 *GetData() const { return mData.empty() ? NULL : &mData[0]; }
+  tjs_uint GetLength() const { return tjs_uint(mData.size()); }
+};
+
+//----------------------------------------------------------------------
+// tTJSVariantClosure
+//----------------------------------------------------------------------
+class tTJSVariantClosure
+{
+public:
+  iTJSDispatch2 *Object;
+  iTJSDispatch2 *ObjThis;
+
+  tTJSVariantClosure() : Object(NULL), ObjThis(NULL) {}
+  tTJSVariantClosure(iTJSDispatch2 *obj, iTJSDispatch2 *objthis) : Object(obj), ObjThis(objthis) {}
+
+  tjs_error FuncCall(tjs_uint32 flag, const tjs_char *membername, tjs_uint32 *hint,
+                     tTJSVariant *result, tjs_int numparams, tTJSVariant **param,
+                     iTJSDispatch2 *objthis) const;
+  tjs_error IsInstanceOf(tjs_uint32 flag, const tjs_char *membername, tjs_uint32 *hint,
+                         const tjs_char *classname, iTJSDispatch2 *objthis) const;
+};
+
+//----------------------------------------------------------------------
+// tTJSVariant
+//----------------------------------------------------------------------
+enum tTJSVariantType {
+  tvtVoid,
+  tvtObject,
+  tvtString,
+  tvtOctet,
+  tvtInteger,
+  tvtReal,
+};
+
+class tTJSVariant
+{
+  tTJSVariantType mType;
+  union {
+    tjs_int64           mInteger;
+    tjs_real            mReal;
+    tTJSVariantOctet    *mOctet;
+  };
+  ttstr mString;
+  tTJSVariantClosure mObject;
+
+public:
+  tTJSVariant() : mType(tvtVoid), mInteger(0) {}
+  tTJSVariant(const tTJSVariant &value);
+  tTJSVariant(const ttstr &value) : mType(tvtString), mInteger(0), mString(value) {}
+  tTJSVariant(const tjs_char *value) : mType(tvtString), mInteger(0), mString(value) {}
+  tTJSVariant(bool value) : mType(tvtInteger), mInteger(value) {}
+  tTJSVariant(int value) : mType(tvtInteger), mInteger(value) {}
+  tTJSVariant(unsigned int value) : mType(tvtInteger), mInteger(value) {}
+  tTJSVariant(long value) : mType(tvtInteger), mInteger(value) {}
+  tTJSVariant(unsigned long value) : mType(tvtInteger), mInteger(tjs_int64(value)) {}
+  tTJSVariant(long long value) : mType(tvtInteger), mInteger(value) {}
+  tTJSVariant(unsigned long long value) : mType(tvtInteger), mInteger(tjs_int64(value)) {}
+  tTJSVariant(double value) : mType(tvtReal), mReal(value) {}
+  tTJSVariant(iTJSDispatch2 *obj);
+  tTJSVariant(iTJSDispatch2 *obj, iTJSDispatch2 *objthis);
+  tTJSVariant(const tjs_uint8 *data, tjs_uint length);
+  ~tTJSVariant() { clear(); }
+
+  tTJSVariant &operator=(const tTJSVariant &value);
+
+  tTJSVariantType Type() const { return mType; }
+
+  operator tjs_int() const { return tjs_int(asInteger()); }
+  operator tjs_uint() const { return tjs_uint(asInteger()); }
+  operator tjs_int64() const { return asInteger(); }
+  operator tjs_real() const;
+  operator bool() const;
+
+  const ttstr &getString() const { return mString; }
+  ttstr AsStringNoAddRef() const;
+  tjs_int64 AsInteger() const { return asInteger(); }
+  tjs_real AsReal() const { return tjs_real(*this); }
+  void ToInteger();
+  void Clear() { clear(); }
+
+  iTJSDispatch2 *AsObject();
+  iTJSDispatch2 *AsObjectNoAddRef() const { return mObject.Object; }
+  tTJSVariantClosure &AsObjectClosureNoAddRef() { return mObject; }
+  const tTJSVariantClosure &AsObjectClosureNoAddRef() const { return mObject; }
+  tTJSVariantOctet *AsOctetNoAddRef() const { return mType == tvtOctet ? mOctet : NULL; }
+
+private:
+  void clear();
+  tjs_int64 asInteger() const;
+};
+
+//----------------------------------------------------------------------
+// iTJSDispatch2
+//----------------------------------------------------------------------
+// the members used by main.cpp, with the kirikiri signatures.
+class iTJSDispatch2
+{
+public:
+  virtual ~iTJSDispatch2() {}
+
+  virtual tjs_uint TJS_INTF_METHOD AddRef(void) = 0;
+  virtual tjs_uint TJS_INTF_METHOD Release(void) = 0;
+
+  virtual tjs_error TJS_INTF_METHOD
+  FuncCall(tjs_uint32 flag, const tjs_char *membername, tjs_uint32 *hint,
+           tTJSVariant *result, tjs_int numparams, tTJSVariant **param,
+           iTJSDispatch2 *objthis) = 0;
+
+  virtual tjs_error TJS_INTF_METHOD
+  PropGet(tjs_uint32 flag, const tjs_char *membername, tjs_uint32 *hint,
+          tTJSVariant *result, iTJSDispatch2 *objthis) = 0;
+
+  virtual tjs_error TJS_INTF_METHOD
+  PropGetByNum(tjs_uint32 flag, tjs_int num, tTJSVariant *result,
+               iTJSDispatch2 *objthis) = 0;
+
+  virtual tjs_error TJS_INTF_METHOD
+  PropSet(tjs_uint32 flag, const tjs_char *membername, tjs_uint32 *hint,
+          const tTJSVariant *param, iTJSDispatch2 *objthis) = 0;
+
+  virtual tjs_error TJS_INTF_METHOD
+  PropSetByNum(tjs_uint32 flag, tjs_int num, const tTJSVariant *param,
+               iTJSDispatch2 *objthis) = 0;
+
+  virtual tjs_error TJS_INTF_METHOD
+  CreateNew(tjs_uint32 flag, const tjs_char *membername, tjs_uint32 *hint,
+            iTJSDispatch2 **result, tjs_int numparams, tTJSVariant **param,
+            iTJSDispatch2 *objthis) = 0;
+
+  virtual tjs_error TJS_INTF_METHOD
+  IsInstanceOf(tjs_uint32 flag, const tjs_char *membername, tjs_uint32 *hint,
+               const tjs_char *classname, iTJSDispatch2 *objthis) = 0;
+};
+
+//----------------------------------------------------------------------
+// tTJSDispatch
+//----------------------------------------------------------------------
+// base of the objects of the stand-in. every member is missing.
+class tTJSDispatch : public iTJSDispatch2
+{
+  tjs_uint mRefCount;
+
+public:
+  tTJSDispatch() : mRefCount(1) {}
+
+  virtual tjs_uint TJS_INTF_METHOD AddRef(void) { return ++mRefCount; }
+  virtual tjs_uint TJS_INTF_METHOD Release(void);
+
+  virtual tjs_error TJS_INTF_METHOD
+  FuncCall(tjs_uint32, const tjs_char *, tjs_uint32 *, tTJSVariant *, tjs_int, tTJSVariant **, iTJSDispatch2 *)
+  { return TJS_E_MEMBERNOTFOUND; }
+  virtual tjs_error TJS_INTF_METHOD
+  PropGet(tjs_uint32, const tjs_char *, tjs_uint32 *, tTJSVariant *, iTJSDispatch2 *)
+  { return TJS_E_MEMBERNOTFOUND; }
+  virtual tjs_error TJS_INTF_METHOD
+  PropGetByNum(tjs_uint32, tjs_int, tTJSVariant *, iTJSDispatch2 *)
+  { return TJS_E_MEMBERNOTFOUND; }
+  virtual tjs_error TJS_INTF_METHOD
+  PropSet(tjs_uint32, const tjs_char *, tjs_uint32 *, const tTJSVariant *, iTJSDispatch2 *)
+  { return TJS_E_MEMBERNOTFOUND; }
+  virtual tjs_error TJS_INTF_METHOD
+  PropSetByNum(tjs_uint32, tjs_int, const tTJSVariant *, iTJSDispatch2 *)
+  { return TJS_E_MEMBERNOTFOUND; }
+  virtual tjs_error TJS_INTF_METHOD
+  CreateNew(tjs_uint32, const tjs_char *, tjs_uint32 *, iTJSDispatch2 **, tjs_int, tTJSVariant **, iTJSDispatch2 *)
+  { return TJS_E_NOTIMPL; }
+  virtual tjs_error TJS_INTF_METHOD
+  IsInstanceOf(tjs_uint32, const tjs_char *, tjs_uint32 *, const tjs_char *, iTJSDispatch2 *)
+  { return TJS_S_FALSE; }
+};
+
+//----------------------------------------------------------------------
+// Objects
+//----------------------------------------------------------------------
+iTJSDispatch2 *TJSCreateArrayObject(void);
+iTJSDispatch2 *TJSCreateDictionaryObject(void);
+
+// number of the items of an Array object, for the benchmark.
+tjs_int TJSGetArrayCount(iTJSDispatch2 *array);
+
+//----------------------------------------------------------------------
+// Exceptions
+//----------------------------------------------------------------------
+class eTJSError
+{
+  ttstr mMessage;
+
+public:
+  eTJSError(const ttstr &message) : mMessage(message) {}
+  const ttstr &GetMessage() const { return mMessage; }
+};
+
+void TVPThrowExceptionMessage(const tjs_char *message);
+
+//----------------------------------------------------------------------
+// System
+//----------------------------------------------------------------------
+// the log goes to stderr, unless it is turned off.
+void TVPAddLog(const ttstr &message);
+void TVPSetLogEnabled(bool enabled);
+
+// only "Date" is known.
+void TVPExecuteExpression(const ttstr &content, tTJSVariant *result = NULL);
+
+class tTVPContinuousEventCallbackIntf
+{
+public:
+  virtual void TJS_INTF_METHOD OnContinuousCallback(tjs_uint64 tick) = 0;
+};
+
+void TVPAddContinuousEventHook(tTVPContinuousEventCallbackIntf *callback);
+void TVPRemoveContinuousEventHook(tTVPContinuousEventCallbackIntf *callback);
+
+// calls the hooks once, as the main loop of kirikiri does while idle.
+void TVPDeliverContinuousEvent(void);
+
+//----------------------------------------------------------------------
+// Streams
+//----------------------------------------------------------------------
+class tTJSBinaryStream
+{
+public:
+  virtual ~tTJSBinaryStream() {}
+  virtual tjs_uint TJS_INTF_METHOD Read(void *buffer, tjs_uint read_size) = 0;
+  virtual tjs_uint TJS_INTF_METHOD Write(const void *buffer, tjs_uint write_size) = 0;
+  virtual tjs_uint64 TJS_INTF_METHOD GetSize() = 0;
+  void TJS_INTF_METHOD Destruct() { delete this; }
+};
+
+// local file names only.
+tTJSBinaryStream *TVPCreateStream(const ttstr &name, tjs_uint32 flags = TJS_BS_READ);
+bool TVPIsExistentStorage(const ttstr &name);
+// the name itself, as all storages are local files.
+ttstr TVPGetLocallyAccessibleName(const ttstr &name);
+
+#endif
@@ -0,0 +1,144 @@
+//----------------------------------------------------------------------
+// windows.h stand-in for the benchmark build on Linux
+//----------------------------------------------------------------------
+// only what main.cpp uses, on top of pthreads and unixODBC.
+// wchar_t is 16 bits (-fshort-wchar), so the wide functions of the C
+// library can't be used and are replaced below.
+#ifndef BENCH_WINDOWS_H
+#define BENCH_WINDOWS_H
+
+// the headers main.cpp includes after this one. they are included first,
+// so that the replacements below don't change their declarations.
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <wchar.h>
+#include <algorithm>
+#include <list>
+#include <vector>
+
+// unixODBC defines BOOL, DWORD, WORD, HWND and WCHAR (wchar_t with
+// SQL_WCHART_CONVERT) unless windows.h did.
+#include <sql.h>
+#include <sqlext.h>
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#define WINAPI
+#define INFINITE 0xFFFFFFFF
+#define WAIT_OBJECT_0 0
+#define WAIT_TIMEOUT 258
+#define TLS_OUT_OF_INDEXES 0xFFFFFFFF
+
+typedef void *HANDLE;
+typedef int LONG;
+typedef unsigned int UINT;
+typedef void *LPVOID;
+typedef union {
+  struct {
+    DWORD LowPart;
+    LONG HighPart;
+  };
+  long long QuadPart;
+} LARGE_INTEGER;
+
+//----------------------------------------------------------------------
+// Synchronization
+//----------------------------------------------------------------------
+struct CRITICAL_SECTION {
+  void *mutex;
+};
+
+void InitializeCriticalSection(CRITICAL_SECTION *section);
+void DeleteCriticalSection(CRITICAL_SECTION *section);
+void EnterCriticalSection(CRITICAL_SECTION *section);
+void LeaveCriticalSection(CRITICAL_SECTION *section);
+
+HANDLE CreateEventW(void *attributes, BOOL manualReset, BOOL initialState, const wchar_t *name);
+#define CreateEvent CreateEventW
+BOOL SetEvent(HANDLE event);
+DWORD WaitForSingleObject(HANDLE handle, DWORD milliseconds);
+BOOL CloseHandle(HANDLE handle);
+
+DWORD TlsAlloc(void);
+BOOL TlsFree(DWORD index);
+LPVOID TlsGetValue(DWORD index);
+BOOL TlsSetValue(DWORD index, LPVOID value);
+
+void Sleep(DWORD milliseconds);
+
+//----------------------------------------------------------------------
+// Files
+//----------------------------------------------------------------------
+#define INVALID_HANDLE_VALUE ((HANDLE)(intptr_t)-1)
+#define GENERIC_READ 0x80000000
+#define FILE_SHARE_READ 0x00000001
+#define OPEN_EXISTING 3
+#define FILE_ATTRIBUTE_NORMAL 0x00000080
+#define PAGE_READONLY 0x02
+#define FILE_MAP_READ 0x0004
+
+// read only files and mappings of a whole file.
+HANDLE CreateFileW(const wchar_t *name, DWORD access, DWORD shareMode, void *attributes,
+                   DWORD creation, DWORD flags, HANDLE templateFile);
+#define CreateFile CreateFileW
+BOOL GetFileSizeEx(HANDLE file, LARGE_INTEGER *size);
+HANDLE CreateFileMappingW(HANDLE file, void *attributes, DWORD protect,
+                          DWORD maximumSizeHigh, DWORD maximumSizeLow, const wchar_t *name);
+#define CreateFileMapping CreateFileMappingW
+LPVOID MapViewOfFile(HANDLE mapping, DWORD access, DWORD offsetHigh, DWORD offsetLow, size_t size);
+BOOL UnmapViewOfFile(const void *view);
+
+//----------------------------------------------------------------------
+// Time
+//----------------------------------------------------------------------
+DWORD GetTickCount(void);
+BOOL QueryPerformanceCounter(LARGE_INTEGER *counter);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER *frequency);
+int localtime_s(struct tm *result, const time_t *time);
+
+//----------------------------------------------------------------------
+// Windows
+//----------------------------------------------------------------------
+// no dialog is shown, the connection string must be complete.
+inline HWND GetDesktopWindow(void) { return NULL; }
+
+//----------------------------------------------------------------------
+// Wide strings
+//----------------------------------------------------------------------
+// the MSVC format: %s is a wide string, and I is a size_t length.
+int bench_vswprintf(wchar_t *buffer, size_t size, const wchar_t *format, va_list args);
+int swprintf_s(wchar_t *buffer, size_t size, const wchar_t *format, ...);
+template <size_t size>
+int swprintf_s(wchar_t (&buffer)[size], const wchar_t *format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  int result = bench_vswprintf(buffer, size, format, args);
+  va_end(args);
+  return result;
+}
+
+#define CP_UTF8 65001
+// UTF-8 only. the string is not null terminated unless the length counts it.
+int WideCharToMultiByte(UINT codePage, DWORD flags, const wchar_t *wide, int wideLength,
+                        char *multiByte, int multiByteLength, const char *defaultChar, BOOL *usedDefaultChar);
+
+size_t bench_wcslen(const wchar_t *s);
+int bench_wcsncmp(const wchar_t *s1, const wchar_t *s2, size_t n);
+#define wcslen bench_wcslen
+#define wcsncmp bench_wcsncmp
+
+// UTF-16 <-> UTF-8, for file names and the console.
+void bench_toUtf8(const wchar_t *s, size_t length, std::vector<char> &utf8);
+void bench_fromUtf8(const char *s, std::vector<wchar_t> &utf16);
+
+#endif
@@ -0,0 +1,1022 @@
+//----------------------------------------------------------------------
+// implementation of the stand-ins for the benchmark build on Linux
+//----------------------------------------------------------------------
+#include <windows.h>
+#include <process.h>
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+
+#include "ncbind/ncbind.hpp"
+#include "tp_stub.h"
+
+//----------------------------------------------------------------------
+// Synchronization
+//----------------------------------------------------------------------
+void InitializeCriticalSection(CRITICAL_SECTION *section)
+{
+  // recursive, as the critical sections of windows.
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_t *mutex = new pthread_mutex_t;
+  pthread_mutex_init(mutex, &attr);
+  pthread_mutexattr_destroy(&attr);
+  section->mutex = mutex;
+}
+
+void DeleteCriticalSection(CRITICAL_SECTION *section)
+{
+  pthread_mutex_t *mutex = (pthread_mutex_t *)section->mutex;
+  pthread_mutex_destroy(mutex);
+  delete mutex;
+  section->mutex = NULL;
+}
+
+void EnterCriticalSection(CRITICAL_SECTION *section)
+{
+  pthread_mutex_lock((pthread_mutex_t *)section->mutex);
+}
+
+void LeaveCriticalSection(CRITICAL_SECTION *section)
+{
+  pthread_mutex_unlock((pthread_mutex_t *)section->mutex);
+}
+
+// events, threads, files and mappings share the handle type.
+struct Handle {
+  enum Kind { hkEvent, hkThread, hkFile, hkMapping } kind;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  bool manualReset;
+  bool signaled;
+  int refCount;
+  int fd;       /* file, and the file of a mapping */
+  size_t size;  /* mapping */
+
+  Handle(Kind _kind, bool _manualReset, bool _signaled)
+    : kind(_kind), manualReset(_manualReset), signaled(_signaled), refCount(1), fd(-1), size(0) {
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond, NULL);
+  }
+  ~Handle() {
+    if (kind == hkFile)
+      close(fd);
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mutex);
+  }
+
+  void release() {
+    pthread_mutex_lock(&mutex);
+    bool last = --refCount == 0;
+    pthread_mutex_unlock(&mutex);
+    if (last)
+      delete this;
+  }
+};
+
+HANDLE CreateEventW(void *attributes, BOOL manualReset, BOOL initialState, const wchar_t *name)
+{
+  return new Handle(Handle::hkEvent, manualReset != FALSE, initialState != FALSE);
+}
+
+BOOL SetEvent(HANDLE event)
+{
+  Handle *handle = (Handle *)event;
+  pthread_mutex_lock(&handle->mutex);
+  handle->signaled = true;
+  pthread_cond_broadcast(&handle->cond);
+  pthread_mutex_unlock(&handle->mutex);
+  return TRUE;
+}
+
+DWORD WaitForSingleObject(HANDLE _handle, DWORD milliseconds)
+{
+  Handle *handle = (Handle *)_handle;
+  struct timespec deadline;
+  if (milliseconds != INFINITE) {
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += milliseconds / 1000;
+    deadline.tv_nsec += long(milliseconds % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+  }
+  pthread_mutex_lock(&handle->mutex);
+  while (! handle->signaled) {
+    if (milliseconds == INFINITE)
+      pthread_cond_wait(&handle->cond, &handle->mutex);
+    else if (pthread_cond_timedwait(&handle->cond, &handle->mutex, &deadline) == ETIMEDOUT)
+      break;
+  }
+  bool signaled = handle->signaled;
+  if (signaled && ! handle->manualReset)
+    handle->signaled = false;
+  pthread_mutex_unlock(&handle->mutex);
+  return signaled ? WAIT_OBJECT_0 : WAIT_TIMEOUT;
+}
+
+BOOL CloseHandle(HANDLE handle)
+{
+  ((Handle *)handle)->release();
+  return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Files
+//----------------------------------------------------------------------
+HANDLE CreateFileW(const wchar_t *name, DWORD access, DWORD shareMode, void *attributes,
+                   DWORD creation, DWORD flags, HANDLE templateFile)
+{
+  std::vector<char> path;
+  bench_toUtf8(name, bench_wcslen(name), path);
+  int fd = open(&path[0], O_RDONLY);
+  if (fd < 0)
+    return INVALID_HANDLE_VALUE;
+  Handle *handle = new Handle(Handle::hkFile, true, true);
+  handle->fd = fd;
+  return handle;
+}
+
+BOOL GetFileSizeEx(HANDLE file, LARGE_INTEGER *size)
+{
+  struct stat st;
+  if (fstat(((Handle *)file)->fd, &st))
+    return FALSE;
+  size->QuadPart = st.st_size;
+  return TRUE;
+}
+
+// the mapping keeps the descriptor of the file, which outlives it.
+HANDLE CreateFileMappingW(HANDLE file, void *attributes, DWORD protect,
+                          DWORD maximumSizeHigh, DWORD maximumSizeLow, const wchar_t *name)
+{
+  LARGE_INTEGER size;
+  if (! GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    return NULL;
+  Handle *handle = new Handle(Handle::hkMapping, true, true);
+  handle->fd = ((Handle *)file)->fd;
+  handle->size = size_t(size.QuadPart);
+  return handle;
+}
+
+static pthread_mutex_t viewsLock = PTHREAD_MUTEX_INITIALIZER;
+static std::map<const void *, size_t> views;
+
+LPVOID MapViewOfFile(HANDLE mapping, DWORD access, DWORD offsetHigh, DWORD offsetLow, size_t size)
+{
+  Handle *handle = (Handle *)mapping;
+  void *view = mmap(NULL, handle->size, PROT_READ, MAP_PRIVATE, handle->fd, 0);
+  if (view == MAP_FAILED)
+    return NULL;
+  pthread_mutex_lock(&viewsLock);
+  views[view] = handle->size;
+  pthread_mutex_unlock(&viewsLock);
+  return view;
+}
+
+BOOL UnmapViewOfFile(const void *view)
+{
+  pthread_mutex_lock(&viewsLock);
+  std::map<const void *, size_t>::iterator iView = views.find(view);
+  bool found = iView != views.end();
+  if (found) {
+    munmap(const_cast<void *>(view), iView->second);
+    views.erase(iView);
+  }
+  pthread_mutex_unlock(&viewsLock);
+  return found ? TRUE : FALSE;
+}
+
+//----------------------------------------------------------------------
+// Threads
+//----------------------------------------------------------------------
+struct ThreadStart {
+  Handle *handle;
+  unsigned (*startAddress)(void *);
+  void *argument;
+};
+
+static void *threadProc(void *param)
+{
+  ThreadStart start = *(ThreadStart *)param;
+  delete (ThreadStart *)param;
+  start.startAddress(start.argument);
+  SetEvent(start.handle);
+  start.handle->release();
+  return NULL;
+}
+
+uintptr_t _beginthreadex(void *security,
+                         unsigned stackSize,
+                         unsigned (*startAddress)(void *),
+                         void *argument,
+                         unsigned initFlag,
+                         unsigned *threadId)
+{
+  // one reference for the caller and one for the thread itself.
+  Handle *handle = new Handle(Handle::hkThread, true, false);
+  handle->refCount = 2;
+  ThreadStart *start = new ThreadStart;
+  start->handle = handle;
+  start->startAddress = startAddress;
+  start->argument = argument;
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, threadProc, start)) {
+    delete start;
+    delete handle;
+    return 0;
+  }
+  pthread_detach(thread);
+  if (threadId)
+    *threadId = unsigned(uintptr_t(start));
+  return uintptr_t(handle);
+}
+
+DWORD TlsAlloc(void)
+{
+  pthread_key_t key;
+  if (pthread_key_create(&key, NULL))
+    return TLS_OUT_OF_INDEXES;
+  return DWORD(key);
+}
+
+BOOL TlsFree(DWORD index)
+{
+  return pthread_key_delete(pthread_key_t(index)) == 0;
+}
+
+LPVOID TlsGetValue(DWORD index)
+{
+  return pthread_getspecific(pthread_key_t(index));
+}
+
+BOOL TlsSetValue(DWORD index, LPVOID value)
+{
+  return pthread_setspecific(pthread_key_t(index), value) == 0;
+}
+
+void Sleep(DWORD milliseconds)
+{
+  struct timespec ts;
+  ts.tv_sec = milliseconds / 1000;
+  ts.tv_nsec = long(milliseconds % 1000) * 1000000;
+  nanosleep(&ts, NULL);
+}
+
+//----------------------------------------------------------------------
+// Time
+//----------------------------------------------------------------------
+DWORD GetTickCount(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return DWORD(tjs_uint64(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000);
+}
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER *counter)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  counter->QuadPart = (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+  return TRUE;
+}
+
+BOOL QueryPerformanceFrequency(LARGE_INTEGER *frequency)
+{
+  frequency->QuadPart = 1000000000;
+  return TRUE;
+}
+
+int localtime_s(struct tm *result, const time_t *time)
+{
+  return localtime_r(time, result) ? 0 : EINVAL;
+}
+
+//----------------------------------------------------------------------
+// Wide strings
+//----------------------------------------------------------------------
+size_t bench_wcslen(const wchar_t *s)
+{
+  const wchar_t *p = s;
+  while (*p)
+    p++;
+  return size_t(p - s);
+}
+
+int bench_wcsncmp(const wchar_t *s1, const wchar_t *s2, size_t n)
+{
+  for (; n; n--, s1++, s2++) {
+    if (*s1 != *s2)
+      return *s1 < *s2 ? -1 : 1;
+    if (! *s1)
+      break;
+  }
+  return 0;
+}
+
+int WideCharToMultiByte(UINT codePage, DWORD flags, const wchar_t *wide, int wideLength,
+                        char *multiByte, int multiByteLength, const char *defaultChar, BOOL *usedDefaultChar)
+{
+  std::vector<char> utf8;
+  bench_toUtf8(wide, wideLength < 0 ? bench_wcslen(wide) + 1 : size_t(wideLength), utf8);
+  int length = int(utf8.size() - 1);
+  if (! multiByte)
+    return length;
+  if (length > multiByteLength)
+    return 0;
+  std::copy(utf8.begin(), utf8.begin() + length, multiByte);
+  return length;
+}
+
+void bench_toUtf8(const wchar_t *s, size_t length, std::vector<char> &utf8)
+{
+  utf8.clear();
+  for (size_t i = 0; i < length; i++) {
+    uint32_t c = uint16_t(s[i]);
+    if (c >= 0xD800 && c < 0xDC00 && i + 1 < length
+        && uint16_t(s[i + 1]) >= 0xDC00 && uint16_t(s[i + 1]) < 0xE000)
+      c = 0x10000 + ((c - 0xD800) << 10) + (uint16_t(s[++i]) - 0xDC00);
+    if (c < 0x80) {
+      utf8.push_back(char(c));
+    } else if (c < 0x800) {
+      utf8.push_back(char(0xC0 | (c >> 6)));
+      utf8.push_back(char(0x80 | (c & 0x3F)));
+    } else if (c < 0x10000) {
+      utf8.push_back(char(0xE0 | (c >> 12)));
+      utf8.push_back(char(0x80 | ((c >> 6) & 0x3F)));
+      utf8.push_back(char(0x80 | (c & 0x3F)));
+    } else {
+      utf8.push_back(char(0xF0 | (c >> 18)));
+      utf8.push_back(char(0x80 | ((c >> 12) & 0x3F)));
+      utf8.push_back(char(0x80 | ((c >> 6) & 0x3F)));
+      utf8.push_back(char(0x80 | (c & 0x3F)));
+    }
+  }
+  utf8.push_back(0);
+}
+
+void bench_fromUtf8(const char *s, std::vector<wchar_t> &utf16)
+{
+  utf16.clear();
+  const unsigned char *p = (const unsigned char *)s;
+  while (*p) {
+    uint32_t c = *p++;
+    int follow = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+    if (follow)
+      c &= 0x3F >> follow;
+    for (; follow && (*p & 0xC0) == 0x80; follow--)
+      c = (c << 6) | (*p++ & 0x3F);
+    if (c >= 0x10000) {
+      utf16.push_back(wchar_t(0xD800 + ((c - 0x10000) >> 10)));
+      utf16.push_back(wchar_t(0xDC00 + ((c - 0x10000) & 0x3FF)));
+    } else {
+      utf16.push_back(wchar_t(c));
+    }
+  }
+  utf16.push_back(0);
+}
+
+// the conversions are done by snprintf, one at a time.
+int bench_vswprintf(wchar_t *buffer, size_t size, const wchar_t *format, va_list args)
+{
+  std::vector<wchar_t> out;
+  const wchar_t *f = format;
+  while (*f) {
+    if (*f != L'%') {
+      out.push_back(*f++);
+      continue;
+    }
+    const wchar_t *start = f++;
+    if (*f == L'%') {
+      out.push_back(*f++);
+      continue;
+    }
+    std::string spec("%");
+    while (*f == L'-' || *f == L'+' || *f == L' ' || *f == L'#' || *f == L'0')
+      spec += char(*f++);
+    int width = -1, precision = -1;
+    if (*f == L'*') {
+      width = va_arg(args, int);
+      f++;
+    } else {
+      for (; *f >= L'0' && *f <= L'9'; f++)
+        width = (width < 0 ? 0 : width * 10) + (*f - L'0');
+    }
+    if (*f == L'.') {
+      f++;
+      precision = 0;
+      if (*f == L'*') {
+        precision = va_arg(args, int);
+        f++;
+      } else {
+        for (; *f >= L'0' && *f <= L'9'; f++)
+          precision = precision * 10 + (*f - L'0');
+      }
+    }
+    enum { lnInt, lnShort, lnLong, lnLongLong, lnSize } length = lnInt;
+    if (*f == L'h') {
+      length = lnShort;
+      f++;
+    } else if (*f == L'l') {
+      length = lnLong;
+      if (*++f == L'l') {
+        length = lnLongLong;
+        f++;
+      }
+    } else if (*f == L'I') {
+      length = lnSize;
+      if (f[1] == L'6' && f[2] == L'4') {
+        length = lnLongLong;
+        f += 2;
+      } else if (f[1] == L'3' && f[2] == L'2') {
+        length = lnInt;
+        f += 2;
+      }
+      f++;
+    }
+    wchar_t conversion = *f;
+    if (! conversion) {
+      out.insert(out.end(), start, f);
+      break;
+    }
+    f++;
+    char text[512];
+    text[0] = 0;
+    if (width >= 0)
+      spec += std::to_string(width);
+    if (precision >= 0)
+      spec += "." + std::to_string(precision);
+    switch (conversion) {
+    case L's': {
+      const wchar_t *s = va_arg(args, const wchar_t *);
+      if (! s) s = L"(null)";
+      size_t len = bench_wcslen(s);
+      if (precision >= 0 && size_t(precision) < len)
+        len = size_t(precision);
+      size_t pad = width > 0 && size_t(width) > len ? size_t(width) - len : 0;
+      bool left = spec.find('-') != std::string::npos;
+      if (! left) out.insert(out.end(), pad, L' ');
+      out.insert(out.end(), s, s + len);
+      if (left) out.insert(out.end(), pad, L' ');
+      continue;
+    }
+    case L'c':
+      out.push_back(wchar_t(va_arg(args, int)));
+      continue;
+    case L'd': case L'i':
+      switch (length) {
+      case lnLong: case lnSize: case lnLongLong:
+        snprintf(text, sizeof(text), (spec + "lld").c_str(),
+                 length == lnLongLong ? va_arg(args, long long) : (long long)va_arg(args, long));
+        break;
+      case lnShort:
+        snprintf(text, sizeof(text), (spec + "d").c_str(), int(short(va_arg(args, int))));
+        break;
+      default:
+        snprintf(text, sizeof(text), (spec + "d").c_str(), va_arg(args, int));
+        break;
+      }
+      break;
+    case L'u': case L'x': case L'X': case L'o': {
+      char type[4] = { 'l', 'l', char(conversion), 0 };
+      unsigned long long value;
+      switch (length) {
+      case lnLong: case lnSize: value = va_arg(args, unsigned long); break;
+      case lnLongLong: value = va_arg(args, unsigned long long); break;
+      case lnShort: value = (unsigned short)va_arg(args, unsigned int); break;
+      default: value = va_arg(args, unsigned int); break;
+      }
+      snprintf(text, sizeof(text), (spec + type).c_str(), value);
+      break;
+    }
+    case L'f': case L'e': case L'E': case L'g': case L'G': {
+      char type[2] = { char(conversion), 0 };
+      snprintf(text, sizeof(text), (spec + type).c_str(), va_arg(args, double));
+      break;
+    }
+    case L'p':
+      snprintf(text, sizeof(text), "%p", va_arg(args, void *));
+      break;
+    default:
+      out.insert(out.end(), start, f);
+      continue;
+    }
+    for (const char *p = text; *p; p++)
+      out.push_back(wchar_t(*p));
+  }
+  if (! size)
+    return -1;
+  size_t count = std::min(out.size(), size - 1);
+  std::copy(out.begin(), out.begin() + count, buffer);
+  buffer[count] = 0;
+  return count == out.size() ? int(count) : -1;
+}
+
+int swprintf_s(wchar_t *buffer, size_t size, const wchar_t *format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  int result = bench_vswprintf(buffer, size, format, args);
+  va_end(args);
+  return result;
+}
+
+//----------------------------------------------------------------------
+// tTJSString
+//----------------------------------------------------------------------
+tTJSString::tTJSString(tjs_int n)
+{
+  wchar_t buf[16];
+  swprintf_s(buf, L"%d", n);
+  assign(buf, bench_wcslen(buf));
+}
+
+tTJSString::tTJSString(const tTJSVariant &value)
+{
+  *this = value.AsStringNoAddRef();
+}
+
+void tTJSString::assign(const tjs_char *str, size_t length)
+{
+  mBuf.clear();
+  append(str, length);
+}
+
+void tTJSString::append(const tjs_char *str, size_t length)
+{
+  if (! length)
+    return;
+  if (! mBuf.empty())
+    mBuf.pop_back();
+  mBuf.insert(mBuf.end(), str, str + length);
+  mBuf.push_back(0);
+}
+
+int tTJSString::wcscmp(const tjs_char *s1, const tjs_char *s2)
+{
+  for (; *s1 == *s2; s1++, s2++)
+    if (! *s1)
+      return 0;
+  return uint16_t(*s1) < uint16_t(*s2) ? -1 : 1;
+}
+
+//----------------------------------------------------------------------
+// tTJSVariantClosure
+//----------------------------------------------------------------------
+tjs_error tTJSVariantClosure::FuncCall(tjs_uint32 flag, const tjs_char *membername, tjs_uint32 *hint,
+                                       tTJSVariant *result, tjs_int numparams, tTJSVariant **param,
+                                       iTJSDispatch2 *objthis) const
+{
+  if (! Object)
+    return TJS_E_INVALIDOBJECT;
+  return Object->FuncCall(flag, membername, hint, result, numparams, param,
+                          ObjThis ? ObjThis : objthis);
+}
+
+tjs_error tTJSVariantClosure::IsInstanceOf(tjs_uint32 flag, const tjs_char *membername, tjs_uint32 *hint,
+                                           const tjs_char *classname, iTJSDispatch2 *objthis) const
+{
+  if (! Object)
+    return TJS_E_INVALIDOBJECT;
+  return Object->IsInstanceOf(flag, membername, hint, classname, ObjThis ? ObjThis : objthis);
+}
+
+//----------------------------------------------------------------------
+// tTJSVariant
+//----------------------------------------------------------------------
+tTJSVariant::tTJSVariant(const tTJSVariant &value)
+  : mType(tvtVoid), mInteger(0)
+{
+  *this = value;
+}
+
+tTJSVariant::tTJSVariant(iTJSDispatch2 *obj)
+  : mType(tvtObject), mInteger(0), mObject(obj, obj)
+{
+  if (obj) obj->AddRef();
+}
+
+tTJSVariant::tTJSVariant(iTJSDispatch2 *obj, iTJSDispatch2 *objthis)
+  : mType(tvtObject), mInteger(0), mObject(obj, objthis)
+{
+  if (obj) obj->AddRef();
+  if (objthis) objthis->AddRef();
+}
+
+tTJSVariant::tTJSVariant(const tjs_uint8 *data, tjs_uint length)
+  : mType(tvtOctet), mOctet(new tTJSVariantOctet(data, length))
+{
+}
+
+tTJSVariant &tTJSVariant::operator=(const tTJSVariant &value)
+{
+  if (this == &value)
+    return *this;
+  if (value.mType == tvtObject) {
+    if (value.mObject.Object) value.mObject.Object->AddRef();
+    if (value.mObject.ObjThis) value.mObject.ObjThis->AddRef();
+  } else if (value.mType == tvtOctet) {
+    value.mOctet->AddRef();
+  }
+  clear();
+  mType = value.mType;
+  switch (mType) {
+  case tvtObject: mObject = value.mObject; break;
+  case tvtString: mString = value.mString; break;
+  case tvtOctet: mOctet = value.mOctet; break;
+  case tvtReal: mReal = value.mReal; break;
+  default: mInteger = value.mInteger; break;
+  }
+  return *this;
+}
+
+void tTJSVariant::clear()
+{
+  if (mType == tvtObject) {
+    if (mObject.Object) mObject.Object->Release();
+    if (mObject.ObjThis) mObject.ObjThis->Release();
+    mObject = tTJSVariantClosure();
+  } else if (mType == tvtOctet) {
+    mOctet->Release();
+  } else if (mType == tvtString) {
+    mString = ttstr();
+  }
+  mType = tvtVoid;
+  mInteger = 0;
+}
+
+tjs_int64 tTJSVariant::asInteger() const
+{
+  switch (mType) {
+  case tvtInteger: return mInteger;
+  case tvtReal: return tjs_int64(mReal);
+  case tvtString: {
+    std::vector<char> utf8;
+    bench_toUtf8(mString.c_str(), mString.length(), utf8);
+    return strtoll(&utf8[0], NULL, 0);
+  }
+  default: return 0;
+  }
+}
+
+tTJSVariant::operator tjs_real() const
+{
+  switch (mType) {
+  case tvtReal: return mReal;
+  case tvtString: {
+    std::vector<char> utf8;
+    bench_toUtf8(mString.c_str(), mString.length(), utf8);
+    return strtod(&utf8[0], NULL);
+  }
+  default: return tjs_real(asInteger());
+  }
+}
+
+tTJSVariant::operator bool() const
+{
+  switch (mType) {
+  case tvtObject: return mObject.Object != NULL;
+  case tvtString: return ! mString.IsEmpty();
+  case tvtOctet: return true;
+  case tvtReal: return mReal != 0;
+  default: return mInteger != 0;
+  }
+}
+
+ttstr tTJSVariant::AsStringNoAddRef() const
+{
+  switch (mType) {
+  case tvtString: return mString;
+  case tvtInteger: {
+    wchar_t buf[32];
+    swprintf_s(buf, L"%lld", (long long)mInteger);
+    return ttstr(buf);
+  }
+  case tvtReal: {
+    wchar_t buf[64];
+    swprintf_s(buf, L"%.15g", mReal);
+    return ttstr(buf);
+  }
+  case tvtObject: return ttstr(L"(object)");
+  case tvtOctet: return ttstr(L"(octet)");
+  default: return ttstr();
+  }
+}
+
+void tTJSVariant::ToInteger()
+{
+  tjs_int64 value = asInteger();
+  clear();
+  mType = tvtInteger;
+  mInteger = value;
+}
+
+iTJSDispatch2 *tTJSVariant::AsObject()
+{
+  if (mObject.Object)
+    mObject.Object->AddRef();
+  return mObject.Object;
+}
+
+//----------------------------------------------------------------------
+// Objects
+//----------------------------------------------------------------------
+tjs_uint TJS_INTF_METHOD tTJSDispatch::Release(void)
+{
+  if (--mRefCount)
+    return mRefCount;
+  delete this;
+  return 0;
+}
+
+class ArrayObject : public tTJSDispatch
+{
+public:
+  std::vector<tTJSVariant> items;
+
+  virtual tjs_error TJS_INTF_METHOD
+  FuncCall(tjs_uint32 flag, const tjs_char *membername, tjs_uint32 *hint, tTJSVariant *result,
+           tjs_int numparams, tTJSVariant **param, iTJSDispatch2 *objthis) {
+    if (! membername || ttstr(membername) != L"add")
+      return TJS_E_MEMBERNOTFOUND;
+    if (numparams < 1)
+      return TJS_E_BADPARAMCOUNT;
+    items.push_back(*param[0]);
+    if (result)
+      *result = tjs_int(items.size() - 1);
+    return TJS_S_OK;
+  }
+
+  virtual tjs_error TJS_INTF_METHOD
+  PropGet(tjs_uint32 flag, const tjs_char *membername, tjs_uint32 *hint,
+          tTJSVariant *result, iTJSDispatch2 *objthis) {
+    if (! membername || ttstr(membername) != L"count")
+      return TJS_E_MEMBERNOTFOUND;
+    if (result)
+      *result = tjs_int(items.size());
+    return TJS_S_OK;
+  }
+
+  virtual tjs_error TJS_INTF_METHOD
+  PropGetByNum(tjs_uint32 flag, tjs_int num, tTJSVariant *result, iTJSDispatch2 *objthis) {
+    if (num < 0)
+      num += tjs_int(items.size());
+    if (result)
+      *result = num >= 0 && num < tjs_int(items.size()) ? items[num] : tTJSVariant();
+    return TJS_S_OK;
+  }
+
+  virtual tjs_error TJS_INTF_METHOD
+  PropSetByNum(tjs_uint32 flag, tjs_int num, const tTJSVariant *param, iTJSDispatch2 *objthis) {
+    if (num < 0)
+      return TJS_E_INVALIDPARAM;
+    if (num >= tjs_int(items.size()))
+      items.resize(num + 1);
+    items[num] = *param;
+    return TJS_S_OK;
+  }
+
+  virtual tjs_error TJS_INTF_METHOD
+  IsInstanceOf(tjs_uint32 flag, const tjs_char *membername, tjs_uint32 *hint,
+               const tjs_char *classname, iTJSDispatch2 *objthis) {
+    return ttstr(classname) == L"Array" ? TJS_S_TRUE : TJS_S_FALSE;
+  }
+};
+
+class DictionaryObject : public tTJSDispatch
+{
+public:
+  std::map<ttstr, tTJSVariant> items;
+
+  virtual tjs_error TJS_INTF_METHOD
+  PropGet(tjs_uint32 flag, const tjs_char *membername, tjs_uint32 *hint,
+          tTJSVariant *result, iTJSDispatch2 *objthis) {
+    if (! membername)
+      return TJS_E_NOTIMPL;
+    std::map<ttstr, tTJSVariant>::iterator i = items.find(ttstr(membername));
+    if (i == items.end())
+      return TJS_E_MEMBERNOTFOUND;
+    if (result)
+      *result = i->second;
+    return TJS_S_OK;
+  }
+
+  virtual tjs_error TJS_INTF_METHOD
+  PropSet(tjs_uint32 flag, const tjs_char *membername, tjs_uint32 *hint,
+          const tTJSVariant *param, iTJSDispatch2 *objthis) {
+    if (! membername)
+      return TJS_E_NOTIMPL;
+    items[ttstr(membername)] = *param;
+    return TJS_S_OK;
+  }
+
+  virtual tjs_error TJS_INTF_METHOD
+  IsInstanceOf(tjs_uint32 flag, const tjs_char *membername, tjs_uint32 *hint,
+               const tjs_char *classname, iTJSDispatch2 *objthis) {
+    return ttstr(classname) == L"Dictionary" ? TJS_S_TRUE : TJS_S_FALSE;
+  }
+};
+
+iTJSDispatch2 *TJSCreateArrayObject(void)
+{
+  return new ArrayObject();
+}
+
+iTJSDispatch2 *TJSCreateDictionaryObject(void)
+{
+  return new DictionaryObject();
+}
+
+tjs_int TJSGetArrayCount(iTJSDispatch2 *array)
+{
+  ArrayObject *obj = dynamic_cast<ArrayObject *>(array);
+  return obj ? tjs_int(obj->items.size()) : 0;
+}
+
+// milliseconds since the epoch, as the Date of TJS.
+class DateObject : public tTJSDispatch
+{
+  tjs_int64 mTime;
+
+public:
+  DateObject() : mTime(0) {}
+
+  virtual tjs_error TJS_INTF_METHOD
+  FuncCall(tjs_uint32 flag, const tjs_char *membername, tjs_uint32 *hint, tTJSVariant *result,
+           tjs_int numparams, tTJSVariant **param, iTJSDispatch2 *objthis) {
+    if (! membername)
+      return TJS_E_NOTIMPL;
+    ttstr name(membername);
+    if (name == L"getTime") {
+      if (result)
+        *result = mTime;
+      return TJS_S_OK;
+    }
+    if (name == L"setTime") {
+      if (numparams < 1)
+        return TJS_E_BADPARAMCOUNT;
+      mTime = tjs_int64(*param[0]);
+      return TJS_S_OK;
+    }
+    return TJS_E_MEMBERNOTFOUND;
+  }
+
+  virtual tjs_error TJS_INTF_METHOD
+  IsInstanceOf(tjs_uint32 flag, const tjs_char *membername, tjs_uint32 *hint,
+               const tjs_char *classname, iTJSDispatch2 *objthis) {
+    return ttstr(classname) == L"Date" ? TJS_S_TRUE : TJS_S_FALSE;
+  }
+};
+
+class DateClass : public tTJSDispatch
+{
+public:
+  virtual tjs_error TJS_INTF_METHOD
+  CreateNew(tjs_uint32 flag, const tjs_char *membername, tjs_uint32 *hint, iTJSDispatch2 **result,
+            tjs_int numparams, tTJSVariant **param, iTJSDispatch2 *objthis) {
+    *result = new DateObject();
+    return TJS_S_OK;
+  }
+};
+
+//----------------------------------------------------------------------
+// Exceptions
+//----------------------------------------------------------------------
+void TVPThrowExceptionMessage(const tjs_char *message)
+{
+  throw eTJSError(message);
+}
+
+//----------------------------------------------------------------------
+// System
+//----------------------------------------------------------------------
+static bool logEnabled = true;
+
+void TVPAddLog(const ttstr &message)
+{
+  if (! logEnabled)
+    return;
+  std::vector<char> utf8;
+  bench_toUtf8(message.c_str(), message.length(), utf8);
+  fprintf(stderr, "%s\n", &utf8[0]);
+}
+
+void TVPSetLogEnabled(bool enabled)
+{
+  logEnabled = enabled;
+}
+
+void TVPExecuteExpression(const ttstr &content, tTJSVariant *result)
+{
+  if (content != L"Date")
+    TVPThrowExceptionMessage((L"Unknown expression: " + content).c_str());
+  iTJSDispatch2 *obj = new DateClass();
+  if (result)
+    *result = tTJSVariant(obj, NULL);
+  obj->Release();
+}
+
+static std::vector<tTVPContinuousEventCallbackIntf *> continuousEventHooks;
+
+void TVPAddContinuousEventHook(tTVPContinuousEventCallbackIntf *callback)
+{
+  if (std::find(continuousEventHooks.begin(), continuousEventHooks.end(), callback)
+      == continuousEventHooks.end())
+    continuousEventHooks.push_back(callback);
+}
+
+void TVPRemoveContinuousEventHook(tTVPContinuousEventCallbackIntf *callback)
+{
+  std::vector<tTVPContinuousEventCallbackIntf *>::iterator i
+    = std::find(continuousEventHooks.begin(), continuousEventHooks.end(), callback);
+  if (i != continuousEventHooks.end())
+    *i = NULL;
+}
+
+void TVPDeliverContinuousEvent(void)
+{
+  // a hook may remove itself or add another while called.
+  tjs_uint64 tick = GetTickCount();
+  for (size_t i = 0; i < continuousEventHooks.size(); i++)
+    if (continuousEventHooks[i])
+      continuousEventHooks[i]->OnContinuousCallback(tick);
+  continuousEventHooks.erase(std::remove(continuousEventHooks.begin(), continuousEventHooks.end(),
+                                         (tTVPContinuousEventCallbackIntf *)NULL),
+                             continuousEventHooks.end());
+}
+
+//----------------------------------------------------------------------
+// Streams
+//----------------------------------------------------------------------
+class FileStream : public tTJSBinaryStream
+{
+  FILE *mFile;
+
+public:
+  FileStream(FILE *file) : mFile(file) {}
+  ~FileStream() { fclose(mFile); }
+
+  tjs_uint TJS_INTF_METHOD Read(void *buffer, tjs_uint read_size) {
+    return tjs_uint(fread(buffer, 1, read_size, mFile));
+  }
+
+  tjs_uint TJS_INTF_METHOD Write(const void *buffer, tjs_uint write_size) {
+    return tjs_uint(fwrite(buffer, 1, write_size, mFile));
+  }
+
+  tjs_uint64 TJS_INTF_METHOD GetSize() {
+    struct stat st;
+    return fstat(fileno(mFile), &st) ? 0 : tjs_uint64(st.st_size);
+  }
+};
+
+tTJSBinaryStream *TVPCreateStream(const ttstr &name, tjs_uint32 flags)
+{
+  std::vector<char> path;
+  bench_toUtf8(name.c_str(), name.length(), path);
+  FILE *file = fopen(&path[0], flags == TJS_BS_WRITE ? "wb" : "rb");
+  if (! file)
+    TVPThrowExceptionMessage((L"Cannot open storage: " + name).c_str());
+  return new FileStream(file);
+}
+
+bool TVPIsExistentStorage(const ttstr &name)
+{
+  std::vector<char> path;
+  bench_toUtf8(name.c_str(), name.length(), path);
+  return access(&path[0], R_OK) == 0;
+}
+
+ttstr TVPGetLocallyAccessibleName(const ttstr &name)
+{
+  return name;
+}
+
+//----------------------------------------------------------------------
+// ncbind
+//----------------------------------------------------------------------
+static std::vector<ncbCallback> &unregistCallbacks()
+{
+  static std::vector<ncbCallback> callbacks;
+  return callbacks;
+}
+
+void ncbAddUnregistCallback(ncbCallback callback)
+{
+  unregistCallbacks().push_back(callback);
+}
+
+void ncbUnregistAll(void)
+{
+  std::vector<ncbCallback> &callbacks = unregistCallbacks();
+  for (size_t i = 0; i < callbacks.size(); i++)
+    callbacks[i]();
+  callbacks.clear();
+}
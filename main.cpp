@@ -3,7 +3,9 @@
 #include <windows.h>
 #include <sql.h>
 #include <sqlext.h>
+#include <process.h>
 #include <stdio.h>
+#include <time.h>
 #include <algorithm>
 #include <list>
 #include <vector>
@@ -14,13 +16,18 @@
 //----------------------------------------------------------------------
 // Static Variables
 //----------------------------------------------------------------------
-static tjs_uint32 addHint, joinHint, getYearHint, getMonthHint, getDateHint, getHoursHint, getMinutesHint, getSecondsHint, countHint, shiftHint;
+static tjs_uint32 addHint, getTimeHint, setTimeHint;
+static iTJSDispatch2 *dateClass = NULL;
+
+// TJS objects made for the results, counted for the profile
+static tjs_int64 createdObjects = 0;
 
 //----------------------------------------------------------------------
 // Utility Functions
 //----------------------------------------------------------------------
 tTJSVariant createArray(void)
 {
+  createdObjects++;
   iTJSDispatch2 *obj = TJSCreateArrayObject();
   tTJSVariant result(obj, obj);
   obj->Release();
@@ -36,645 +43,7236 @@ tjs_uint countArray(tTJSVariant array)
 
 tTJSVariant createDictionary(void)
 {
+  createdObjects++;
   iTJSDispatch2 *obj = TJSCreateDictionaryObject();
   tTJSVariant result(obj, obj);
   obj->Release();
   return result;
 }
 
+tTJSVariant createOctet(const void *data, tjs_uint length)
+{
+  static const tjs_uint8 empty = 0;
+  createdObjects++;
+  return tTJSVariant(length ? (const tjs_uint8 *)data : &empty, length);
+}
+
+tTJSVariant createDate(tjs_int64 time)
+{
+  createdObjects++;
+  if (! dateClass) {
+    tTJSVariant value;
+    TVPExecuteExpression(L"Date", &value);
+    dateClass = value.AsObject();
+  }
+  iTJSDispatch2 *obj;
+  if (TJS_FAILED(dateClass->CreateNew(0, NULL, NULL, &obj, 0, NULL, dateClass)))
+    TVPThrowExceptionMessage(L"Unable to create a Date object");
+  tTJSVariant result(obj, obj);
+  obj->Release();
+  ncbPropAccessor resultObj(result);
+  resultObj.FuncCall(0, L"setTime", &setTimeHint, NULL, time);
+  return result;
+}
+
+bool isDateObject(tTJSVariant value)
+{
+  if (value.Type() != tvtObject)
+    return false;
+  tTJSVariantClosure &closure = value.AsObjectClosureNoAddRef();
+  return closure.Object
+    && closure.IsInstanceOf(0, NULL, NULL, L"Date", NULL) == TJS_S_TRUE;
+}
+
+tjs_int64 getDateTime(tTJSVariant date)
+{
+  tTJSVariant time;
+  ncbPropAccessor dateObj(date);
+  dateObj.FuncCall(0, L"getTime", &getTimeHint, &time);
+  return tjs_int64(time);
+}
+
+void releaseStaticObjects(void)
+{
+  if (dateClass) {
+    dateClass->Release();
+    dateClass = NULL;
+  }
+}
+
+// high resolution clock in microseconds
+tjs_int64 getMicroseconds(void)
+{
+  static LARGE_INTEGER frequency;
+  if (! frequency.QuadPart)
+    QueryPerformanceFrequency(&frequency);
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return counter.QuadPart / frequency.QuadPart * 1000000
+    + counter.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart;
+}
+
+// days since 1970-01-01 of the proleptic gregorian calendar date
+tjs_int64 daysFromCivil(tjs_int64 y, tjs_int m, tjs_int d)
+{
+  y -= m <= 2;
+  tjs_int64 era = (y >= 0 ? y : y - 399) / 400;
+  tjs_int64 yoe = y - era * 400;
+  tjs_int64 doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  tjs_int64 doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+void civilFromDays(tjs_int64 z, tjs_int &y, tjs_int &m, tjs_int &d)
+{
+  z += 719468;
+  tjs_int64 era = (z >= 0 ? z : z - 146096) / 146097;
+  tjs_int64 doe = z - era * 146097;
+  tjs_int64 yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  tjs_int64 doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  tjs_int64 mp = (5 * doy + 2) / 153;
+  d = tjs_int(doy - (153 * mp + 2) / 5 + 1);
+  m = tjs_int(mp < 10 ? mp + 3 : mp - 9);
+  y = tjs_int(yoe + era * 400 + (m <= 2));
+}
+
+// offset of the local time from UTC in seconds, around the given time.
+// localtime_s can't handle negative time_t, so older dates use the offset of the epoch.
+tjs_int64 localTimeOffset(tjs_int64 seconds)
+{
+  time_t probe = time_t(std::max(seconds, tjs_int64(0)));
+  struct tm lt;
+  if (localtime_s(&lt, &probe))
+    return 0;
+  tjs_int64 local = daysFromCivil(lt.tm_year + 1900, lt.tm_mon + 1, lt.tm_mday) * 86400
+    + lt.tm_hour * 3600 + lt.tm_min * 60 + lt.tm_sec;
+  return local - tjs_int64(probe);
+}
+
+// local SQL timestamp -> milliseconds since the epoch (same as Date.getTime())
+tjs_int64 timestampToTime(const SQL_TIMESTAMP_STRUCT &ts)
+{
+  tjs_int64 seconds = daysFromCivil(ts.year, ts.month, ts.day) * 86400
+    + ts.hour * 3600 + ts.minute * 60 + ts.second;
+  seconds -= localTimeOffset(seconds - localTimeOffset(seconds));
+  return seconds * 1000 + ts.fraction / 1000000;
+}
+
+// milliseconds since the epoch -> local SQL timestamp
+SQL_TIMESTAMP_STRUCT timeToTimestamp(tjs_int64 time)
+{
+  tjs_int64 seconds = (time >= 0 ? time : time - 999) / 1000;
+  tjs_int64 millis = time - seconds * 1000;
+  seconds += localTimeOffset(seconds);
+  tjs_int64 days = (seconds >= 0 ? seconds : seconds - 86399) / 86400;
+  tjs_int64 rest = seconds - days * 86400;
+  tjs_int y, m, d;
+  civilFromDays(days, y, m, d);
+  SQL_TIMESTAMP_STRUCT ts;
+  ts.year = SQLSMALLINT(y);
+  ts.month = SQLUSMALLINT(m);
+  ts.day = SQLUSMALLINT(d);
+  ts.hour = SQLUSMALLINT(rest / 3600);
+  ts.minute = SQLUSMALLINT(rest / 60 % 60);
+  ts.second = SQLUSMALLINT(rest % 60);
+  ts.fraction = SQLUINTEGER(millis * 1000000);
+  return ts;
+}
+
+//----------------------------------------------------------------------
+// Worker Thread Log
+//----------------------------------------------------------------------
+// TJS can't be used from a worker thread. while a worker runs a query,
+// its logs and error are kept here and reported on the main thread.
+struct WorkerLog {
+  std::list<std::vector<WCHAR> > messages;
+  std::vector<WCHAR> error;
+};
+
+// thrown on a worker thread instead of a TJS exception
+struct WorkerError {
+};
+
+static DWORD workerLogIndex = TLS_OUT_OF_INDEXES;
+
+static WorkerLog *getWorkerLog(void)
+{
+  if (workerLogIndex == TLS_OUT_OF_INDEXES)
+    return NULL;
+  return (WorkerLog *)TlsGetValue(workerLogIndex);
+}
+
+// the index is allocated by the first worker, and freed as the plugin
+// is unloaded.
+static void allocWorkerLog(void)
+{
+  if (workerLogIndex != TLS_OUT_OF_INDEXES)
+    return;
+  workerLogIndex = TlsAlloc();
+  if (workerLogIndex == TLS_OUT_OF_INDEXES)
+    TVPThrowExceptionMessage(L"Unable to allocate a thread local storage");
+}
+
+static void addLog(const WCHAR *message)
+{
+  WorkerLog *log = getWorkerLog();
+  if (log)
+    log->messages.push_back(std::vector<WCHAR>(message, message + wcslen(message) + 1));
+  else
+    TVPAddLog(message);
+}
+
+static void throwError(const WCHAR *message)
+{
+  WorkerLog *log = getWorkerLog();
+  if (log) {
+    log->error.assign(message, message + wcslen(message) + 1);
+    throw WorkerError();
+  }
+  TVPThrowExceptionMessage(message);
+}
+
 //----------------------------------------------------------------------
 // Macros
 //----------------------------------------------------------------------
-#define TRYODBC(h, ht, x)                               \
-  {   RETCODE rc = x;                                   \
-    if (rc != SQL_SUCCESS)                              \
-      {                                                 \
-        dumpDiagnosticRecord (h, ht, rc);               \
-      }                                                 \
-    if (rc == SQL_ERROR)                                \
-      {                                                 \
-        WCHAR buf[1024];                                \
-        swprintf_s(buf, 1023, L"Error in " L#x L"\n");  \
-        TVPThrowExceptionMessage(buf);                  \
-      }                                                 \
+// L#x is not portable, so the stringized argument is widened by pasting.
+#define WIDEN2(x) L ## x
+#define WIDEN(x) WIDEN2(x)
+
+#define TRYODBC(h, ht, x)                                       \
+  {   RETCODE rc = x;                                           \
+    if (rc != SQL_SUCCESS)                                      \
+      {                                                         \
+        dumpDiagnosticRecord (h, ht, rc);                       \
+      }                                                         \
+    if (rc == SQL_ERROR)                                        \
+      {                                                         \
+        WCHAR buf[1024];                                        \
+        swprintf_s(buf, 1023, L"Error in %s\n", WIDEN(#x));     \
+        throwError(buf);                                        \
+      }                                                         \
   }
 
 //----------------------------------------------------------------------
-// ODBC class
+// Diagnostic Functions
 //----------------------------------------------------------------------
-class ODBC
+static void dumpDiagnosticRecord (SQLHANDLE      handle,    
+                                  SQLSMALLINT    type,  
+                                  RETCODE        retCode)
 {
-public:
-  //----------------------------------------------------------------------
-  enum QueryResultType  {
-    qrtArray,
-    qrtDictionary,
-    qrtSingleColumnArray,
-  };
+  SQLSMALLINT rec = 0;
+  SQLINTEGER  error;
+  WCHAR       message[1000];
+  WCHAR       state[SQL_SQLSTATE_SIZE+1];
+  
+  if (retCode == SQL_INVALID_HANDLE) {
+    addLog(L"Invalid handle!");
+    return;
+  }
+  
+  while (SQLGetDiagRec(type,
+                       handle,
+                       ++rec,
+                       state,
+                       &error,
+                       message,
+                       (SQLSMALLINT)(sizeof(message) / sizeof(WCHAR)),
+                       (SQLSMALLINT *)NULL) == SQL_SUCCESS)
+    {
+      // Hide data truncated..
+      if (wcsncmp(state, L"01004", 5))
+        {
+          WCHAR buf[1024];
+          swprintf_s(buf, 1023, L"[%5.5s] %s (%d)\n", state, message, error);
+          addLog(buf);
+        }
+    }
+}
 
-private:
-  //----------------------------------------------------------------------
-  struct Binding {
-    WCHAR               *buffer;  /* column buffer   */
-    SQLLEN              ind;      /* size or null     */
-    SQLLEN              type;     /* column type */
-  };
-  typedef std::list<Binding> bindings;
+static void dumpAffectedRows(HANDLE hStmt)
+{
+  SQLLEN rowCount;
   
-  //----------------------------------------------------------------------
-  SQLHENV     mHEnv;
-  SQLHDBC     mHDbc;
-  SQLHSTMT    mHStmt;
+  TRYODBC(hStmt,
+          SQL_HANDLE_STMT,
+          SQLRowCount(hStmt, &rowCount));
   
-  bool mIsConnected;
-  bindings mBindings;
+  if (rowCount >= 0)
+    {
+      WCHAR buf[1024];                                                
+      swprintf_s(buf,
+                 L"%Id %s affected\n",
+                 rowCount,
+                 rowCount == 1 ? L"row" : L"rows");
+      addLog(buf);
+    }
+}
+
+//----------------------------------------------------------------------
+// Types
+//----------------------------------------------------------------------
+enum QueryResultType  {
+  qrtArray,
+  qrtDictionary,
+  qrtSingleColumnArray,
+  qrtColumns,
+  qrtPackedColumns,
+  qrtResultSet,
+};
+
+enum DecimalMode {
+  dmReal,
+  dmExact,
+};
+
+enum DateMode {
+  dtmDate,
+  dtmTime,
+};
+
+enum EscapeDialect {
+  edGeneric,
+  edAccess,
+  edSQLServer,
+  edOracle,
+  edMySQL,
+  edPostgreSQL,
+};
+
+enum ExportFormat {
+  efCSV,
+  efTSV,
+  efJSONLines,
+};
+
+enum ExportQuoting {
+  eqMinimal,      /* fields with a delimiter, a quote or a line break */
+  eqAll,
+  eqNonNumeric,
+  eqNone,
+};
+
+enum ExportEncoding {
+  eeUTF8,
+  eeUTF8BOM,
+  eeUTF16LE,      /* with BOM */
+};
+
+struct ExportOptions {
+  ExportFormat        format;
+  ExportQuoting       quoting;
+  ExportEncoding      encoding;
+  bool                header;     /* column names on the first line */
+  ttstr               delimiter;  /* between the fields of csv and tsv */
+  ttstr               newline;
+  ttstr               nullText;   /* NULL of csv and tsv */
+};
+
+struct FetchOptions {
+  SQLULEN             fetchRowsetSize;  /* rows fetched at once */
+  SQLLEN              lobChunkSize;     /* bytes read at once by SQLGetData */
+  DecimalMode         decimalMode;
+  DateMode            dateMode;
+  bool                logAffectedRows;  /* log rows affected by each statement */
+  SQLULEN             prefetchDepth;    /* rowsets a cursor fetches ahead */
+  SQLULEN             prefetchLimit;    /* bytes of the buffers of a cursor fetching ahead */
+  SQLULEN             queryTimeout;     /* seconds until the execution is cancelled, 0 for none */
+  SQLULEN             maxRows;          /* rows read from a result, 0 for all */
+  tjs_int64           maxBytes;         /* bytes fetched by an execution, 0 for no limit */
+};
+
+struct ColumnInfo {
+  SQLLEN              type;       /* concise type */
+  SQLLEN              length;
+  SQLLEN              scale;      /* decimal and numeric only */
+  SQLLEN              precision;  /* decimal and numeric only */
+  bool                isUnsigned; /* bigint only */
+  std::vector<WCHAR>  name;       /* null terminated */
+};
+typedef std::vector<ColumnInfo> columnInfos;
+
+// costs of an execution. times in microseconds.
+struct QueryProfile {
+  tjs_int64           executeTime;  /* SQLExecDirect / SQLExecute */
+  tjs_int64           fetchTime;    /* SQLFetch / SQLGetData */
+  tjs_int64           convertTime;  /* building the TJS result */
+  tjs_int64           rows;         /* rows fetched */
+  tjs_int64           bytes;        /* bytes of the fetched values */
+  tjs_int64           allocations;  /* column buffers and TJS objects made */
+};
 
+//----------------------------------------------------------------------
+// ColumnCache class
+//----------------------------------------------------------------------
+// descriptions of the result columns by the sql text, shared by the
+// statements of a connection. workers of asynchronous queries use it too.
+class ColumnCache
+{
   //----------------------------------------------------------------------
-  static void dumpDiagnosticRecord (SQLHANDLE      handle,    
-                                    SQLSMALLINT    type,  
-                                    RETCODE        retCode)
-  {
-    SQLSMALLINT rec = 0;
-    SQLINTEGER  error;
-    WCHAR       message[1000];
-    WCHAR       state[SQL_SQLSTATE_SIZE+1];
-    
-    if (retCode == SQL_INVALID_HANDLE) {
-      TVPAddLog(L"Invalid handle!");
-      return;
-    }
-    
-    while (SQLGetDiagRec(type,
-                         handle,
-                         ++rec,
-                         state,
-                         &error,
-                         message,
-                         (SQLSMALLINT)(sizeof(message) / sizeof(WCHAR)),
-                         (SQLSMALLINT *)NULL) == SQL_SUCCESS)
-      {
-        // Hide data truncated..
-        if (wcsncmp(state, L"01004", 5))
-          {
-            WCHAR buf[1024];
-            swprintf_s(buf, 1023, L"[%5.5s] %s (%d)\n", state, message, error);
-            TVPAddLog(buf);
-          }
-      }
-  }
+  struct Entry {
+    std::vector<WCHAR>  sql;
+    SQLSMALLINT         numResults; /* columns of the result */
+    columnInfos         columns;    /* described columns (from the first) */
+  };
+  typedef std::list<Entry> entries;
 
   //----------------------------------------------------------------------
-  static void dumpAffectedRows(HANDLE hStmt) {
-    SQLLEN rowCount;
-    
-    TRYODBC(hStmt,
-            SQL_HANDLE_STMT,
-            SQLRowCount(hStmt, &rowCount));
-    
-    if (rowCount >= 0)
-      {
-        WCHAR buf[1024];                                                
-        swprintf_s(buf,
-                   L"%Id %s affected\n",
-                   rowCount,
-                   rowCount == 1 ? L"row" : L"rows");
-        TVPAddLog(buf);
-      }
-  }
-  
+  CRITICAL_SECTION mLock;
+
+  // the most recently used one first.
+  entries mEntries;
+  tjs_int mSize;
+  tjs_int mHits;
+  tjs_int mMisses;
+
+  // changed by clear(), to invalidate the copies held by statements.
+  volatile LONG mGeneration;
+
 public:
   //----------------------------------------------------------------------
-  ODBC()
-    : mHEnv(NULL)
-    , mHDbc(NULL)
-    , mHStmt(NULL)
-    , mIsConnected(false)
+  ColumnCache()
+    : mSize(64)
+    , mHits(0)
+    , mMisses(0)
+    , mGeneration(0)
   {
+    InitializeCriticalSection(&mLock);
   }
 
   //----------------------------------------------------------------------
-  ~ODBC() {
-    disconnect();
-    freeBindings();
+  ~ColumnCache() {
+    DeleteCriticalSection(&mLock);
   }
 
   //----------------------------------------------------------------------
-  bool getConnected() {
-    return mIsConnected;
-  }
-  
-  //----------------------------------------------------------------------
-  static tjs_error TJS_INTF_METHOD connect(tTJSVariant *result,
-                                           tjs_int numparams,
-                                           tTJSVariant **param,
-                                           iTJSDispatch2 *objthis) {
-    ODBC *self = ncbInstanceAdaptor<ODBC>::GetNativeInstance(objthis);
-    if (! self) 
-      return TJS_E_NATIVECLASSCRASH;
-    ttstr connectStr;
-    if (numparams == 0) connectStr = L"";
-    else if (numparams == 1) connectStr = *param[0];
-    else return TJS_E_BADPARAMCOUNT;
-    ttstr resultConnectionStr = self->_connect(connectStr);
-    if (result)
-      *result = resultConnectionStr;
-    return TJS_S_OK;
+  tjs_int getSize() {
+    return mSize;
   }
 
-  //----------------------------------------------------------------------
-  ttstr _connect(ttstr connectStr) {
-    disconnect();
-    
-    // Allocate an environment
-    if (SQLAllocHandle(SQL_HANDLE_ENV, SQL_NULL_HANDLE, &mHEnv) == SQL_ERROR)
-      TVPThrowExceptionMessage(L"Unable to allocate an environment handle");
+  void setSize(tjs_int size) {
+    EnterCriticalSection(&mLock);
+    mSize = std::max(size, 0);
+    trim();
+    LeaveCriticalSection(&mLock);
+  }
 
-    TRYODBC(mHEnv,
-            SQL_HANDLE_ENV,
-            SQLSetEnvAttr(mHEnv,
-                          SQL_ATTR_ODBC_VERSION,
-                          (SQLPOINTER)SQL_OV_ODBC3,
-                          0));
-    
-    // Allocate a connection
-    TRYODBC(mHEnv,
-            SQL_HANDLE_ENV,
-            SQLAllocHandle(SQL_HANDLE_DBC, mHEnv, &mHDbc));
+  tjs_int getHits() {
+    return mHits;
+  }
 
-    // Connect to the driver.
-    WCHAR outConnectionStr[1024 + 1];
-    SQLSMALLINT outConnectionStringLength = 0;
-    RETCODE retCode;
-    
-    TRYODBC(mHDbc,
-            SQL_HANDLE_DBC,
-            retCode = SQLDriverConnect(mHDbc,
-                                       GetDesktopWindow(),
-                                       (SQLWCHAR*)connectStr.c_str(),
-                                       SQL_NTS,
-                                       outConnectionStr,
-                                       1024 + 1,
-                                       &outConnectionStringLength,
-                                       SQL_DRIVER_COMPLETE_REQUIRED));
-    
-    if (retCode == SQL_NO_DATA)
-      return L"";
-        
-    ttstr result;
-    if (outConnectionStringLength <= 1024)
-      result = outConnectionStr;
-    
-    TRYODBC(mHDbc,
-            SQL_HANDLE_DBC,
-            SQLAllocHandle(SQL_HANDLE_STMT, mHDbc, &mHStmt));
+  tjs_int getMisses() {
+    return mMisses;
+  }
 
-    mIsConnected = true;
+  LONG getGeneration() {
+    return mGeneration;
+  }
 
-    return result;
+  //----------------------------------------------------------------------
+  void clear() {
+    EnterCriticalSection(&mLock);
+    mEntries.clear();
+    mGeneration++;
+    LeaveCriticalSection(&mLock);
   }
 
   //----------------------------------------------------------------------
-  void disconnect(void) {
-    if (mHStmt)
-      {
-        SQLFreeHandle(SQL_HANDLE_STMT, mHStmt);
-        mHStmt = NULL;
+  // copies the first cCols columns of a result with numResults columns.
+  bool lookup(const std::vector<WCHAR> &sql, SQLSMALLINT numResults, SQLSMALLINT cCols, columnInfos &columns) {
+    bool found = false;
+    EnterCriticalSection(&mLock);
+    for (entries::iterator iEntry = mEntries.begin();
+         iEntry != mEntries.end();
+         iEntry++) {
+      if (iEntry->sql == sql) {
+        if (iEntry->numResults == numResults && iEntry->columns.size() >= size_t(cCols)) {
+          columns.assign(iEntry->columns.begin(), iEntry->columns.begin() + cCols);
+          mEntries.splice(mEntries.begin(), mEntries, iEntry);
+          found = true;
+        }
+        break;
       }
+    }
+    if (found)
+      mHits++;
+    else
+      mMisses++;
+    LeaveCriticalSection(&mLock);
+    return found;
+  }
 
-    if (mHDbc)
-      {
-        SQLDisconnect(mHDbc);
-        SQLFreeHandle(SQL_HANDLE_DBC, mHDbc);
-        mHDbc = NULL;
+  //----------------------------------------------------------------------
+  void store(const std::vector<WCHAR> &sql, SQLSMALLINT numResults, const columnInfos &columns) {
+    EnterCriticalSection(&mLock);
+    for (entries::iterator iEntry = mEntries.begin();
+         iEntry != mEntries.end();
+         iEntry++) {
+      if (iEntry->sql == sql) {
+        mEntries.erase(iEntry);
+        break;
       }
+    }
+    if (mSize > 0) {
+      mEntries.push_front(Entry());
+      mEntries.front().sql = sql;
+      mEntries.front().numResults = numResults;
+      mEntries.front().columns = columns;
+      trim();
+    }
+    LeaveCriticalSection(&mLock);
+  }
 
-    if (mHEnv)
-      {
-        SQLFreeHandle(SQL_HANDLE_ENV, mHEnv);
-        mHEnv = NULL;
-      }
+private:
+  //----------------------------------------------------------------------
+  // called in the lock
+  void trim() {
+    while (mEntries.size() > size_t(mSize))
+      mEntries.pop_back();
+  }
+};
 
-    mIsConnected = false;
+//----------------------------------------------------------------------
+// LobWriter class
+//----------------------------------------------------------------------
+// writes a large value chunk by chunk to a file given by a storage name,
+// or to an object by calling its write() with an Octet or a String.
+// text written to a file is encoded in UTF-8.
+class LobWriter
+{
+  tTJSVariant       mTarget;
+  tTJSBinaryStream  *mStream;
+  bool              mBinary;
+  WCHAR             mPending;   /* high surrogate left by the previous chunk */
+
+public:
+  //----------------------------------------------------------------------
+  LobWriter(tTJSVariant target, bool binary)
+    : mTarget(target)
+    , mStream(NULL)
+    , mBinary(binary)
+    , mPending(0)
+  {
+    if (target.Type() != tvtObject)
+      mStream = TVPCreateStream(ttstr(target), TJS_BS_WRITE);
   }
-  
+
   //----------------------------------------------------------------------
-  static tjs_error TJS_INTF_METHOD query(tTJSVariant *result,
-                                         tjs_int numparams,
-                                         tTJSVariant **param,
-                                         iTJSDispatch2 *objthis) {
-    ODBC *self = ncbInstanceAdaptor<ODBC>::GetNativeInstance(objthis);
-    if (! self) 
-      return TJS_E_NATIVECLASSCRASH;
-    if (numparams == 0)
-      return TJS_E_BADPARAMCOUNT;
-    ttstr sqlStr;
-    sqlStr = *param[0];
-    QueryResultType queryResultType = qrtArray;
-    if (numparams >= 2)
-      queryResultType = QueryResultType(tjs_int(*param[1]));
-    tTJSVariant queryResult;
-    queryResult = self->_query(sqlStr, queryResultType);
-    if (result)
-      *result = queryResult;
-    return TJS_S_OK;
+  ~LobWriter() {
+    if (mStream)
+      mStream->Destruct();
   }
 
   //----------------------------------------------------------------------
-  tTJSVariant _query(ttstr sqlString, QueryResultType queryResultType) {
-    if (! mIsConnected) 
-      TVPThrowExceptionMessage(L"SQL connection is not established.");
+  void write(const char *data, SQLLEN size) {
+    if (! mStream) {
+      static tjs_uint32 writeHint;
+      ncbPropAccessor targetObj(mTarget);
+      if (mBinary)
+        targetObj.FuncCall(0, L"write", &writeHint, NULL, createOctet(data, tjs_uint(size)));
+      else
+        targetObj.FuncCall(0, L"write", &writeHint, NULL,
+                           ttstr((const WCHAR *)data, tjs_int(size / sizeof(WCHAR))));
+      return;
+    }
+    if (mBinary) {
+      mStream->Write(data, tjs_uint(size));
+      return;
+    }
+    
+    // a surrogate pair split by the chunks is encoded with the next chunk.
+    std::vector<WCHAR> text;
+    if (mPending)
+      text.push_back(mPending);
+    text.insert(text.end(), (const WCHAR *)data, (const WCHAR *)(data + size));
+    mPending = 0;
+    if (! text.empty() && text.back() >= 0xd800 && text.back() < 0xdc00) {
+      mPending = text.back();
+      text.pop_back();
+    }
+    writeText(text);
+  }
 
-    RETCODE     retCode;
-    SQLSMALLINT numResults;
+  //----------------------------------------------------------------------
+  void close() {
+    if (mStream && mPending) {
+      std::vector<WCHAR> text(1, mPending);
+      mPending = 0;
+      writeText(text);
+    }
+  }
 
-    retCode = SQLExecDirect(mHStmt,(SQLWCHAR*)sqlString.c_str(), SQL_NTS);
-    tTJSVariant result;
+private:
+  //----------------------------------------------------------------------
+  void writeText(const std::vector<WCHAR> &text) {
+    if (text.empty())
+      return;
+    int length = WideCharToMultiByte(CP_UTF8, 0, &text[0], int(text.size()), NULL, 0, NULL, NULL);
+    if (length <= 0)
+      return;
+    std::vector<char> utf8(length);
+    WideCharToMultiByte(CP_UTF8, 0, &text[0], int(text.size()), &utf8[0], length, NULL, NULL);
+    mStream->Write(&utf8[0], tjs_uint(length));
+  }
+};
+
+//----------------------------------------------------------------------
+// ExportWriter class
+//----------------------------------------------------------------------
+// writes the rows of exportQuery to a file given by a storage name, as
+// csv, tsv or json lines. the fields are encoded into a buffer, which is
+// written out when a row makes it larger than kBufferSize.
+class ExportWriter
+{
+  static const size_t kBufferSize = 64 * 1024;
+
+  tTJSBinaryStream                *mStream;
+  ExportOptions                   mOptions;
+  std::vector<char>               mBuffer;
+  std::vector<std::vector<char> > mKeys;    /* encoded "name": of json lines */
+  size_t                          mField;   /* next field of the row */
+
+public:
+  //----------------------------------------------------------------------
+  ExportWriter(ttstr path, const ExportOptions &options)
+    : mStream(NULL)
+    , mOptions(options)
+    , mField(0)
+  {
+    mStream = TVPCreateStream(path, TJS_BS_WRITE);
+    mBuffer.reserve(kBufferSize);
+    switch (mOptions.encoding) {
+    case eeUTF8BOM: mBuffer.insert(mBuffer.end(), "\xef\xbb\xbf", "\xef\xbb\xbf" + 3); break;
+    case eeUTF16LE: mBuffer.insert(mBuffer.end(), "\xff\xfe", "\xff\xfe" + 2); break;
+    default: break;
+    }
+  }
+
+  //----------------------------------------------------------------------
+  ~ExportWriter() {
+    if (mStream)
+      mStream->Destruct();
+  }
+
+  //----------------------------------------------------------------------
+  // json lines encode the keys once, csv and tsv write the header.
+  void begin(const std::vector<ttstr> &names) {
+    if (mOptions.format == efJSONLines) {
+      mKeys.clear();
+      for (size_t col = 0; col < names.size(); col++) {
+        size_t start = mBuffer.size();
+        if (col > 0)
+          putAscii(",", 1);
+        putJsonString(names[col].c_str(), size_t(names[col].length()));
+        putAscii(":", 1);
+        mKeys.push_back(std::vector<char>(mBuffer.begin() + start, mBuffer.end()));
+        mBuffer.resize(start);
+      }
+      return;
+    }
+    if (! mOptions.header)
+      return;
+    beginRow();
+    for (size_t col = 0; col < names.size(); col++)
+      writeText(names[col].c_str(), size_t(names[col].length()), false);
+    endRow();
+  }
+
+  //----------------------------------------------------------------------
+  void beginRow() {
+    mField = 0;
+    if (mOptions.format == efJSONLines)
+      putAscii("{", 1);
+  }
+
+  //----------------------------------------------------------------------
+  void endRow() {
+    if (mOptions.format == efJSONLines)
+      putAscii("}", 1);
+    putText(mOptions.newline.c_str(), size_t(mOptions.newline.length()));
+    if (mBuffer.size() >= kBufferSize)
+      flush();
+  }
+
+  //----------------------------------------------------------------------
+  void writeNull() {
+    beginField();
+    if (mOptions.format == efJSONLines)
+      putAscii("null", 4);
+    else
+      putText(mOptions.nullText.c_str(), size_t(mOptions.nullText.length()));
+  }
+
+  //----------------------------------------------------------------------
+  void writeInteger(tjs_int64 value) {
+    char buf[32];
+    int length = snprintf(buf, sizeof(buf), "%lld", (long long)value);
+    writeNumber(buf, size_t(length));
+  }
+
+  //----------------------------------------------------------------------
+  // the shortest of 15 or 17 digits that reads back the same value.
+  // json has no NaN nor infinity, they are written as null.
+  void writeReal(double value) {
+    if (value != value || value - value != 0) {
+      if (mOptions.format == efJSONLines) {
+        writeNull();
+        return;
+      }
+      const char *text = value != value ? "NaN" : value > 0 ? "Infinity" : "-Infinity";
+      writeNumber(text, strlen(text));
+      return;
+    }
+    char buf[32];
+    int length = snprintf(buf, sizeof(buf), "%.15g", value);
+    if (strtod(buf, NULL) != value)
+      length = snprintf(buf, sizeof(buf), "%.17g", value);
+    writeNumber(buf, size_t(length));
+  }
+
+  //----------------------------------------------------------------------
+  // dates and times as "YYYY-MM-DD hh:mm:ss", with the fraction when it
+  // is not zero.
+  void writeTimestamp(const SQL_TIMESTAMP_STRUCT &timestamp, SQLLEN type) {
+    char buf[48];
+    int length = 0;
+    if (type != SQL_TYPE_TIME)
+      length += snprintf(buf + length, sizeof(buf) - length, "%04d-%02u-%02u",
+                         int(timestamp.year), unsigned(timestamp.month), unsigned(timestamp.day));
+    if (type != SQL_TYPE_DATE) {
+      length += snprintf(buf + length, sizeof(buf) - length, length > 0 ? " %02u:%02u:%02u" : "%02u:%02u:%02u",
+                         unsigned(timestamp.hour), unsigned(timestamp.minute), unsigned(timestamp.second));
+      if (timestamp.fraction > 0) {
+        length += snprintf(buf + length, sizeof(buf) - length, ".%09lu", (unsigned long)timestamp.fraction);
+        while (buf[length - 1] == '0')
+          length--;
+      }
+    }
+    writeAscii(buf, size_t(length));
+  }
+
+  //----------------------------------------------------------------------
+  // binary values are written in hex.
+  void writeBinary(const char *data, size_t size) {
+    static const char digits[] = "0123456789ABCDEF";
+    beginField();
+    bool quote = mOptions.format == efJSONLines || mOptions.quoting == eqAll || mOptions.quoting == eqNonNumeric;
+    if (quote)
+      putAscii("\"", 1);
+    for (size_t i = 0; i < size; i++) {
+      char hex[2] = { digits[(tjs_uint8)data[i] >> 4], digits[(tjs_uint8)data[i] & 15] };
+      putAscii(hex, 2);
+    }
+    if (quote)
+      putAscii("\"", 1);
+  }
+
+  //----------------------------------------------------------------------
+  // numeric text, such as decimals, is written as a json number when it
+  // is one.
+  void writeText(const WCHAR *text, size_t length, bool numeric) {
+    beginField();
+    if (mOptions.format == efJSONLines) {
+      if (numeric && isJsonNumber(text, length))
+        putText(text, length);
+      else
+        putJsonString(text, length);
+      return;
+    }
+    if (! needsQuote(text, length, numeric)) {
+      putText(text, length);
+      return;
+    }
+    
+    // quotes in the field are doubled.
+    putAscii("\"", 1);
+    size_t run = 0;
+    for (size_t i = 0; i < length; i++) {
+      if (text[i] != L'"')
+        continue;
+      putText(text + run, i + 1 - run);
+      putAscii("\"", 1);
+      run = i + 1;
+    }
+    putText(text + run, length - run);
+    putAscii("\"", 1);
+  }
+
+  //----------------------------------------------------------------------
+  void close() {
+    flush();
+  }
+
+private:
+  //----------------------------------------------------------------------
+  void flush() {
+    if (mBuffer.empty())
+      return;
+    mStream->Write(&mBuffer[0], tjs_uint(mBuffer.size()));
+    mBuffer.clear();
+  }
+
+  //----------------------------------------------------------------------
+  // the delimiter or the key before a field.
+  void beginField() {
+    if (mOptions.format == efJSONLines) {
+      if (mField < mKeys.size() && ! mKeys[mField].empty())
+        mBuffer.insert(mBuffer.end(), mKeys[mField].begin(), mKeys[mField].end());
+    } else if (mField > 0)
+      putText(mOptions.delimiter.c_str(), size_t(mOptions.delimiter.length()));
+    mField++;
+  }
+
+  //----------------------------------------------------------------------
+  void writeNumber(const char *text, size_t length) {
+    beginField();
+    bool quote = mOptions.format != efJSONLines && mOptions.quoting == eqAll;
+    if (quote)
+      putAscii("\"", 1);
+    putAscii(text, length);
+    if (quote)
+      putAscii("\"", 1);
+  }
+
+  //----------------------------------------------------------------------
+  // text without quotes nor escapes, such as a date.
+  void writeAscii(const char *text, size_t length) {
+    beginField();
+    bool quote = mOptions.format == efJSONLines || mOptions.quoting == eqAll || mOptions.quoting == eqNonNumeric;
+    if (quote)
+      putAscii("\"", 1);
+    putAscii(text, length);
+    if (quote)
+      putAscii("\"", 1);
+  }
+
+  //----------------------------------------------------------------------
+  bool needsQuote(const WCHAR *text, size_t length, bool numeric) const {
+    switch (mOptions.quoting) {
+    case eqNone: return false;
+    case eqAll: return true;
+    case eqNonNumeric:
+      if (! numeric)
+        return true;
+      break;
+    default:
+      break;
+    }
+    WCHAR delimiter = mOptions.delimiter.length() > 0 ? mOptions.delimiter.c_str()[0] : L'\0';
+    for (size_t i = 0; i < length; i++)
+      if (text[i] == L'"' || text[i] == L'\r' || text[i] == L'\n' || (delimiter && text[i] == delimiter))
+        return true;
+    return false;
+  }
+
+  //----------------------------------------------------------------------
+  // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+  static bool isJsonNumber(const WCHAR *text, size_t length) {
+    size_t i = 0;
+    if (i < length && text[i] == L'-')
+      i++;
+    if (i >= length || text[i] < L'0' || text[i] > L'9')
+      return false;
+    if (text[i++] != L'0')
+      while (i < length && text[i] >= L'0' && text[i] <= L'9')
+        i++;
+    if (i < length && text[i] == L'.') {
+      size_t digits = ++i;
+      while (i < length && text[i] >= L'0' && text[i] <= L'9')
+        i++;
+      if (i == digits)
+        return false;
+    }
+    if (i < length && (text[i] == L'e' || text[i] == L'E')) {
+      i++;
+      if (i < length && (text[i] == L'+' || text[i] == L'-'))
+        i++;
+      size_t digits = i;
+      while (i < length && text[i] >= L'0' && text[i] <= L'9')
+        i++;
+      if (i == digits)
+        return false;
+    }
+    return i == length;
+  }
+
+  //----------------------------------------------------------------------
+  void putJsonString(const WCHAR *text, size_t length) {
+    putAscii("\"", 1);
+    size_t run = 0;
+    for (size_t i = 0; i < length; i++) {
+      WCHAR c = text[i];
+      if (c != L'"' && c != L'\\' && c >= 0x20)
+        continue;
+      putText(text + run, i - run);
+      run = i + 1;
+      switch (c) {
+      case L'"': putAscii("\\\"", 2); break;
+      case L'\\': putAscii("\\\\", 2); break;
+      case L'\n': putAscii("\\n", 2); break;
+      case L'\r': putAscii("\\r", 2); break;
+      case L'\t': putAscii("\\t", 2); break;
+      case L'\b': putAscii("\\b", 2); break;
+      case L'\f': putAscii("\\f", 2); break;
+      default: {
+        char code[8];
+        snprintf(code, sizeof(code), "\\u%04x", unsigned(c));
+        putAscii(code, 6);
+        break;
+      }
+      }
+    }
+    putText(text + run, length - run);
+    putAscii("\"", 1);
+  }
+
+  //----------------------------------------------------------------------
+  void putAscii(const char *text, size_t length) {
+    if (mOptions.encoding != eeUTF16LE) {
+      mBuffer.insert(mBuffer.end(), text, text + length);
+      return;
+    }
+    for (size_t i = 0; i < length; i++) {
+      mBuffer.push_back(text[i]);
+      mBuffer.push_back(0);
+    }
+  }
+
+  //----------------------------------------------------------------------
+  // encodes the text. a surrogate without its pair is written as U+FFFD
+  // in UTF-8.
+  void putText(const WCHAR *text, size_t length) {
+    if (mOptions.encoding == eeUTF16LE) {
+      for (size_t i = 0; i < length; i++) {
+        mBuffer.push_back(char(text[i] & 0xff));
+        mBuffer.push_back(char(text[i] >> 8));
+      }
+      return;
+    }
+    for (size_t i = 0; i < length; i++) {
+      tjs_uint32 c = text[i];
+      if (c < 0x80) {
+        mBuffer.push_back(char(c));
+        continue;
+      }
+      if (c < 0x800) {
+        mBuffer.push_back(char(0xc0 | (c >> 6)));
+        mBuffer.push_back(char(0x80 | (c & 0x3f)));
+        continue;
+      }
+      if (c >= 0xd800 && c < 0xe000) {
+        if (c < 0xdc00 && i + 1 < length && text[i + 1] >= 0xdc00 && text[i + 1] < 0xe000) {
+          c = 0x10000 + ((c - 0xd800) << 10) + (text[++i] - 0xdc00);
+          mBuffer.push_back(char(0xf0 | (c >> 18)));
+          mBuffer.push_back(char(0x80 | ((c >> 12) & 0x3f)));
+          mBuffer.push_back(char(0x80 | ((c >> 6) & 0x3f)));
+          mBuffer.push_back(char(0x80 | (c & 0x3f)));
+          continue;
+        }
+        c = 0xfffd;
+      }
+      mBuffer.push_back(char(0xe0 | (c >> 12)));
+      mBuffer.push_back(char(0x80 | ((c >> 6) & 0x3f)));
+      mBuffer.push_back(char(0x80 | (c & 0x3f)));
+    }
+  }
+};
+
+//----------------------------------------------------------------------
+// SnapshotFile class
+//----------------------------------------------------------------------
+// contents of a file written by ODBC::saveSnapshot. a local file is mapped
+// into memory, a storage which is not, such as one in an archive, is read
+// into a buffer.
+class SnapshotFile
+{
+  HANDLE              mFile;
+  HANDLE              mMapping;
+  const char          *mView;
+  std::vector<char>   mBuffer;
+  size_t              mSize;
+
+public:
+  //----------------------------------------------------------------------
+  SnapshotFile()
+    : mFile(INVALID_HANDLE_VALUE)
+    , mMapping(NULL)
+    , mView(NULL)
+    , mSize(0)
+  {
+  }
+
+  //----------------------------------------------------------------------
+  ~SnapshotFile() {
+    if (mView)
+      UnmapViewOfFile(mView);
+    if (mMapping)
+      CloseHandle(mMapping);
+    if (mFile != INVALID_HANDLE_VALUE)
+      CloseHandle(mFile);
+  }
+
+  //----------------------------------------------------------------------
+  // false when there is no such storage.
+  bool open(const ttstr &path) {
+    if (! TVPIsExistentStorage(path))
+      return false;
+    ttstr localName = TVPGetLocallyAccessibleName(path);
+    if (localName.IsEmpty()) {
+      readStorage(path);
+      return true;
+    }
+
+    mFile = CreateFile(localName.c_str(),
+                       GENERIC_READ,
+                       FILE_SHARE_READ,
+                       NULL,
+                       OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL,
+                       NULL);
+    LARGE_INTEGER size;
+    if (mFile == INVALID_HANDLE_VALUE || ! GetFileSizeEx(mFile, &size))
+      TVPThrowExceptionMessage((L"Cannot open the snapshot file: " + path).c_str());
+    mSize = size_t(size.QuadPart);
+    if (mSize == 0)
+      return true;
+    mMapping = CreateFileMapping(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mMapping)
+      mView = (const char *)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+    if (! mView)
+      TVPThrowExceptionMessage((L"Cannot map the snapshot file: " + path).c_str());
+    return true;
+  }
+
+  //----------------------------------------------------------------------
+  const char *getData() {
+    if (mView)
+      return mView;
+    return mBuffer.empty() ? NULL : &mBuffer[0];
+  }
+
+  size_t getSize() {
+    return mSize;
+  }
+
+private:
+  //----------------------------------------------------------------------
+  void readStorage(const ttstr &path) {
+    tTJSBinaryStream *stream = TVPCreateStream(path, TJS_BS_READ);
+    try {
+      mSize = size_t(stream->GetSize());
+      mBuffer.resize(mSize);
+      if (mSize > 0 && stream->Read(&mBuffer[0], tjs_uint(mSize)) != mSize)
+        TVPThrowExceptionMessage((L"Cannot read the snapshot file: " + path).c_str());
+    } catch (...) {
+      stream->Destruct();
+      throw;
+    }
+    stream->Destruct();
+  }
+};
+
+//----------------------------------------------------------------------
+// Statement class
+//----------------------------------------------------------------------
+class Statement
+{
+  //----------------------------------------------------------------------
+  struct Binding {
+    char                *buffer;  /* column buffer (rowset size * width) */
+    SQLLEN              *ind;     /* size or null (per row) */
+    SQLLEN              width;    /* buffer width per row in bytes */
+    SQLLEN              type;     /* column type */
+    SQLSMALLINT         cType;    /* bound C type */
+    bool                deferred; /* not bound, read by SQLGetData */
+  };
+  typedef std::vector<Binding> bindings;
+
+  //----------------------------------------------------------------------
+  struct ColumnValues {
+    bool                    packed;   /* numbers are packed into data */
+    tTJSVariant             array;    /* values of a column not packed */
+    std::vector<char>       data;     /* packed values */
+    std::vector<tjs_uint8>  nulls;    /* null bitmap of packed values */
+  };
+
+  // upper limit of the column buffers allocated for one rowset
+  static const SQLLEN kRowsetBufferLimit = 4 * 1024 * 1024;
+
+  // text and binary columns longer than this are read by SQLGetData
+  static const SQLLEN kLargeColumnLength = 8000;
+
+  // alignment of the column buffers in the arena
+  static const size_t kArenaAlignment = 16;
+
+  // errors of a batch in a row taken as a driver not moving to the next
+  // result
+  static const int kMaxBatchErrors = 256;
+  
+  //----------------------------------------------------------------------
+  struct Parameter {
+    tTJSVariant         value;    /* parameter value */
+    ttstr               string;   /* keeps the text of string parameters */
+    union {
+      SQLBIGINT               integer;
+      SQLDOUBLE               real;
+      SQL_TIMESTAMP_STRUCT    timestamp;
+    };
+    SQLLEN              ind;      /* size or null */
+  };
+  typedef std::vector<Parameter> parameters;
+
+  //----------------------------------------------------------------------
+  struct ParameterArray {
+    std::vector<char>   buffer;   /* column buffer (rows * width) */
+    std::vector<SQLLEN> ind;      /* size or null (per row) */
+    SQLLEN              width;    /* buffer width per row in bytes */
+  };
+  typedef std::vector<ParameterArray> parameterArrays;
+
+  //----------------------------------------------------------------------
+  // rows read by a worker thread, returned by fetchRowset afterwards.
+  struct ReadAhead {
+    std::vector<std::vector<char> >   buffers;  /* column values (per binding) */
+    std::vector<std::vector<SQLLEN> > inds;     /* size or null (per binding) */
+    std::vector<std::vector<size_t> > offsets;  /* row offsets of deferred columns */
+    std::vector<SQLUSMALLINT>         status;   /* row status */
+    SQLULEN                           rows;     /* rows read */
+    SQLULEN                           next;     /* next row to return */
+  };
+
+  //----------------------------------------------------------------------
+  // rowsets of an open cursor fetched ahead by a helper thread. each slot
+  // is a set of the column buffers in the arena, chosen by the bind offset.
+  struct Prefetch {
+    HANDLE                    thread;
+    HANDLE                    filled;     /* a slot is filled, or the fetch ended */
+    HANDLE                    freed;      /* a slot is freed, or stop is asked */
+    CRITICAL_SECTION          lock;
+    bindings                  base;       /* bindings of the first slot */
+    std::vector<SQLUSMALLINT> status;     /* row status (per slot) */
+    std::vector<SQLULEN>      rows;       /* rows fetched (per slot) */
+    size_t                    head;       /* slot read next by the main thread */
+    size_t                    count;      /* slots filled and not read yet */
+    bool                      reading;    /* the slot before head is being read */
+    bool                      done;       /* the helper thread has finished */
+    bool                      stop;
+    bool                      failed;
+    tjs_int64                 fetchTime;
+    WorkerLog                 log;        /* read after the helper thread ended */
+
+    Prefetch()
+      : thread(NULL)
+      , head(0)
+      , count(0)
+      , reading(false)
+      , done(false)
+      , stop(false)
+      , failed(false)
+      , fetchTime(0)
+    {
+      filled = CreateEvent(NULL, FALSE, FALSE, NULL);
+      freed = CreateEvent(NULL, FALSE, FALSE, NULL);
+      InitializeCriticalSection(&lock);
+    }
+
+    ~Prefetch() {
+      if (thread)
+        CloseHandle(thread);
+      CloseHandle(filled);
+      CloseHandle(freed);
+      DeleteCriticalSection(&lock);
+    }
+  };
+
+  //----------------------------------------------------------------------
+  // sections of a snapshot file, each aligned to 8 bytes:
+  //   header, sql (UTF-16),
+  //   per column: column header and name (UTF-16),
+  //   row status (per row),
+  //   per column: indicators (per row), row offsets of a deferred column,
+  //   values as they were in the column buffers.
+  // a file of another version, or of a build with another size of SQLLEN
+  // (indicators) or size_t (row offsets), is not read.
+  struct SnapshotHeader {
+    char                magic[8];     /* "ODBCSNAP" */
+    tjs_uint32          version;
+    tjs_uint32          lengthSize;   /* sizeof(SQLLEN) */
+    tjs_uint32          columns;
+    tjs_uint32          rowsetSize;
+    tjs_uint64          rows;
+    tjs_uint64          schemaHash;
+    tjs_uint32          sqlLength;
+    tjs_uint32          offsetSize;   /* sizeof(size_t) */
+  };
+
+  struct SnapshotColumnHeader {
+    tjs_int64           type;
+    tjs_int64           length;
+    tjs_int64           scale;
+    tjs_int64           precision;
+    tjs_int64           width;        /* of the binding */
+    tjs_uint64          dataSize;
+    tjs_uint64          offsetCount;
+    tjs_int32           cType;
+    tjs_uint8           isUnsigned;
+    tjs_uint8           deferred;
+    tjs_uint8           reserved[2];
+    tjs_uint32          nameLength;
+    tjs_uint32          reserved2;
+  };
+
+  static const tjs_uint32 kSnapshotVersion = 1;
+
+public:
+  //----------------------------------------------------------------------
+  // a column of the rows of a snapshot, in the rows or in a snapshot file.
+  struct SnapshotColumn {
+    const char          *data;        /* values */
+    size_t              size;
+    const SQLLEN        *inds;        /* size or null (per row) */
+    const size_t        *offsets;     /* row offsets of a deferred column */
+    size_t              offsetCount;
+  };
+
+  //----------------------------------------------------------------------
+  // rows of a result kept natively, to build the result again later.
+  struct Snapshot {
+    bindings            types;      /* bindings without buffers */
+    columnInfos         columns;
+    ReadAhead           rows;       /* status and count only, when mapped */
+    std::vector<SnapshotColumn> mapped; /* columns read from a snapshot file */
+    SQLULEN             rowsetSize;
+    size_t              size;       /* bytes used */
+  };
+
+private:
+  //----------------------------------------------------------------------
+  SQLHSTMT    mHStmt;
+  ttstr       mSql;
+
+  FetchOptions mOptions;
+  bindings mBindings;
+  std::vector<ttstr> mTitles;
+  std::vector<tjs_uint32> mTitleHints;
+
+  // bound column buffers of the current result. reused by the following
+  // results, and grows when they need more.
+  std::vector<char> mArena;
+
+  // sql of the result and its described columns. the columns are reused
+  // while the same sql returns the same number of columns.
+  ColumnCache *mColumnCache;
+  std::vector<WCHAR> mResultSql;
+  columnInfos mColumns;
+  SQLSMALLINT mResultColumns;
+  LONG mColumnsGeneration;
+  bool mTitlesValid;
+  parameters mParameters;
+  parameterArrays mParameterArrays;
+
+  SQLULEN mRowsetSize;
+  SQLULEN mRowsFetched;
+  std::vector<SQLUSMALLINT> mRowStatus;
+
+  // position of an open cursor in the current rowset
+  SQLULEN mCursorRow;
+  SQLULEN mCursorRows;
+
+  ReadAhead mReadAhead;
+  bool mHasReadAhead;
+
+  // sets of the column buffers in the arena. a cursor fetching ahead has
+  // more than one.
+  size_t mBufferSlots;
+  size_t mSlotSize;
+  SQLLEN mBindOffset;
+  Prefetch *mPrefetch;
+
+  // limits of the execution. the attributes are set again only when they
+  // change. cancel() may be called from another thread.
+  SQLULEN mQueryTimeout;
+  SQLULEN mMaxRows;
+  SQLULEN mFetchedRows;
+  tjs_int64 mFetchedBytes;
+  volatile bool mCancelled;
+
+  // lock of the connection taken while a worker or a helper thread calls
+  // the driver, so that they do not use the connection at the same time.
+  CRITICAL_SECTION *mConnectionLock;
+
+  QueryProfile mProfile;
+
+public:
+  //----------------------------------------------------------------------
+  Statement(SQLHDBC hDbc, ColumnCache *columnCache, CRITICAL_SECTION *connectionLock = NULL)
+    : mHStmt(NULL)
+    , mColumnCache(columnCache)
+    , mResultColumns(0)
+    , mColumnsGeneration(0)
+    , mTitlesValid(false)
+    , mRowsetSize(1)
+    , mRowsFetched(0)
+    , mCursorRow(0)
+    , mCursorRows(0)
+    , mHasReadAhead(false)
+    , mBufferSlots(1)
+    , mSlotSize(0)
+    , mBindOffset(0)
+    , mPrefetch(NULL)
+    , mQueryTimeout(0)
+    , mMaxRows(0)
+    , mFetchedRows(0)
+    , mFetchedBytes(0)
+    , mCancelled(false)
+    , mConnectionLock(connectionLock)
+    , mProfile()
+  {
+    // a statement without a connection only restores snapshots.
+    if (hDbc)
+      TRYODBC(hDbc,
+              SQL_HANDLE_DBC,
+              SQLAllocHandle(SQL_HANDLE_STMT, hDbc, &mHStmt));
+  }
+
+  //----------------------------------------------------------------------
+  ~Statement() {
+    freeBindings();
+    if (mHStmt)
+      SQLFreeHandle(SQL_HANDLE_STMT, mHStmt);
+  }
+
+  //----------------------------------------------------------------------
+  const ttstr &getSql() {
+    return mSql;
+  }
+
+  //----------------------------------------------------------------------
+  // costs of the executions since the last reset.
+  const QueryProfile &getProfile() {
+    return mProfile;
+  }
+
+  void resetProfile() {
+    mProfile = QueryProfile();
+  }
+
+  //----------------------------------------------------------------------
+  void prepare(ttstr sqlString) {
+    TRYODBC(mHStmt,
+            SQL_HANDLE_STMT,
+            SQLPrepare(mHStmt, (SQLWCHAR*)sqlString.c_str(), SQL_NTS));
+    mSql = sqlString;
+    setResultSql(sqlString.c_str());
+  }
+
+  //----------------------------------------------------------------------
+  tTJSVariant execDirect(ttstr sqlString, QueryResultType queryResultType, const FetchOptions &options) {
+    mOptions = options;
+    setResultSql(sqlString.c_str());
+    RETCODE retCode = timedExecDirect(sqlString.c_str());
+    return getResult(retCode, queryResultType);
+  }
+
+  //----------------------------------------------------------------------
+  tTJSVariant execute(tTJSVariant params, QueryResultType queryResultType, const FetchOptions &options) {
+    mOptions = options;
+    bindParameters(params);
+    RETCODE retCode = timedExecute();
+    return getResult(retCode, queryResultType);
+  }
+
+  //----------------------------------------------------------------------
+  // executes sql that may return several results, such as a batch of
+  // statements or a stored procedure. returns an array of the results:
+  // rows as execDirect returns them, or the number of the affected rows.
+  tTJSVariant execDirectBatch(ttstr sqlString, QueryResultType queryResultType, const FetchOptions &options) {
+    mOptions = options;
+    tTJSVariant results = createArray();
+    ncbPropAccessor resultsObj(results);
+    
+    // the results differ in their columns.
+    setResultSql(NULL);
+    RETCODE retCode = timedExecDirect(sqlString.c_str());
+    int errors = 0;
+    for (;;) {
+      tTJSVariant result;
+      SQLSMALLINT numResults = checkResult(retCode);
+      if (numResults > 0)
+        result = fetchResults(numResults, queryResultType);
+      else if (retCode == SQL_NO_DATA)
+        result = tjs_int64(0);
+      else if (SQL_SUCCEEDED(retCode)) {
+        SQLLEN rowCount;
+        if (SQL_SUCCEEDED(SQLRowCount(mHStmt, &rowCount)))
+          result = tjs_int64(rowCount);
+      }
+      resultsObj.FuncCall(0, L"add", &addHint, NULL, result);
+
+      // an invalid handle is thrown by checkResult.
+      retCode = SQLMoreResults(mHStmt);
+      if (retCode == SQL_NO_DATA)
+        break;
+      if (retCode != SQL_ERROR)
+        errors = 0;
+      else if (++errors > kMaxBatchErrors) {
+        SQLFreeStmt(mHStmt, SQL_CLOSE);
+        throwError(L"The batch does not move to its next result.");
+      }
+    }
+    
+    SQLFreeStmt(mHStmt, SQL_CLOSE);
+    return results;
+  }
+
+  //----------------------------------------------------------------------
+  tTJSVariant execDirectLob(ttstr sqlString, tTJSVariant target, const FetchOptions &options) {
+    mOptions = options;
+    RETCODE retCode = timedExecDirect(sqlString.c_str());
+    return readLob(retCode, target);
+  }
+
+  //----------------------------------------------------------------------
+  tTJSVariant executeLob(tTJSVariant params, tTJSVariant target, const FetchOptions &options) {
+    mOptions = options;
+    bindParameters(params);
+    RETCODE retCode = timedExecute();
+    return readLob(retCode, target);
+  }
+
+  //----------------------------------------------------------------------
+  tjs_int64 execDirectExport(ttstr sqlString, ExportWriter &writer, const FetchOptions &options) {
+    mOptions = options;
+    setResultSql(sqlString.c_str());
+    RETCODE retCode = timedExecDirect(sqlString.c_str());
+    return exportResults(retCode, writer);
+  }
+
+  //----------------------------------------------------------------------
+  tjs_int64 executeExport(tTJSVariant params, ExportWriter &writer, const FetchOptions &options) {
+    mOptions = options;
+    bindParameters(params);
+    RETCODE retCode = timedExecute();
+    return exportResults(retCode, writer);
+  }
+
+  //----------------------------------------------------------------------
+  bool execDirectCursor(ttstr sqlString, QueryResultType queryResultType, const FetchOptions &options) {
+    mOptions = options;
+    setResultSql(sqlString.c_str());
+    RETCODE retCode = timedExecDirect(sqlString.c_str());
+    return openCursor(retCode, queryResultType);
+  }
+
+  //----------------------------------------------------------------------
+  bool executeCursor(tTJSVariant params, QueryResultType queryResultType, const FetchOptions &options) {
+    mOptions = options;
+    bindParameters(params);
+    RETCODE retCode = timedExecute();
+    return openCursor(retCode, queryResultType);
+  }
+
+  //----------------------------------------------------------------------
+  // worker thread half of an asynchronous query. executes the sql and reads
+  // all rows into native buffers without touching any TJS object.
+  void execDirectAsync(const WCHAR *sqlString, QueryResultType queryResultType, const FetchOptions &options) {
+    lockConnection();
+    try {
+      mOptions = options;
+      setResultSql(sqlString);
+      RETCODE retCode = timedExecDirect(sqlString);
+      SQLSMALLINT numResults = checkResult(retCode);
+      if (numResults > 0) {
+        allocateBindings(queryResultType == qrtSingleColumnArray ? 1 : numResults, numResults);
+        readAhead();
+      }
+    } catch (...) {
+      unlockConnection();
+      throw;
+    }
+    unlockConnection();
+  }
+
+  //----------------------------------------------------------------------
+  // executes the sql, and keeps the rows in the snapshot as well as
+  // returning them. returns false when there is no result set.
+  bool execDirectSnapshot(ttstr sqlString, QueryResultType queryResultType, const FetchOptions &options,
+                          tTJSVariant &result, Snapshot &snapshot) {
+    mOptions = options;
+    setResultSql(sqlString.c_str());
+    RETCODE retCode = timedExecDirect(sqlString.c_str());
+    SQLSMALLINT numResults = checkResult(retCode);
+    if (numResults <= 0)
+      return false;
+    
+    allocateBindings(queryResultType == qrtSingleColumnArray ? 1 : numResults, numResults);
+    readAhead();
+    makeSnapshot(snapshot);
+    snapshot.rows = mReadAhead;
+    snapshot.size += getSnapshotRowsSize(snapshot);
+
+    result = collectResults(queryResultType);
+    SQLFreeStmt(mHStmt, SQL_CLOSE);
+    return true;
+  }
+
+  //----------------------------------------------------------------------
+  // made by the result set class defined later. the result set owns the
+  // snapshot, and the file its rows are in. they are freed even when the
+  // result set cannot be made.
+  static tTJSVariant createResultSet(Snapshot *snapshot, DateMode dateMode, SnapshotFile *file = NULL);
+
+  //----------------------------------------------------------------------
+  // a value of the rows kept in a snapshot, read as getColumnValue reads
+  // it from the column buffers.
+  static tTJSVariant getSnapshotValue(const Snapshot &snapshot, SQLULEN row, size_t col, DateMode dateMode) {
+    Binding binding = snapshot.types[col];
+    SnapshotColumn column = getSnapshotColumn(snapshot, col);
+    binding.ind = const_cast<SQLLEN *>(&column.inds[row]);
+    if (binding.deferred) {
+      // a row of its own, which keeps only the bytes used.
+      size_t begin = column.offsets[row];
+      size_t end = row + 1 < column.offsetCount ? column.offsets[row + 1] : column.size;
+      binding.buffer = const_cast<char *>(end > begin ? column.data + begin : NULL);
+      binding.width = SQLLEN(end - begin);
+      if (*binding.ind != SQL_NULL_DATA && binding.width == 0)
+        return binding.cType == SQL_C_BINARY ? createOctet(NULL, 0) : tTJSVariant(ttstr());
+    } else
+      binding.buffer = const_cast<char *>(column.data + row * binding.width);
+    return getColumnValue(binding, 0, dateMode);
+  }
+
+  //----------------------------------------------------------------------
+  static SnapshotColumn getSnapshotColumn(const Snapshot &snapshot, size_t col) {
+    if (! snapshot.mapped.empty())
+      return snapshot.mapped[col];
+    const ReadAhead &rows = snapshot.rows;
+    SnapshotColumn column;
+    column.data = rows.buffers[col].empty() ? NULL : &rows.buffers[col][0];
+    column.size = rows.buffers[col].size();
+    column.inds = rows.inds[col].empty() ? NULL : &rows.inds[col][0];
+    column.offsets = rows.offsets[col].empty() ? NULL : &rows.offsets[col][0];
+    column.offsetCount = rows.offsets[col].size();
+    return column;
+  }
+
+  //----------------------------------------------------------------------
+  // builds the result kept by execDirectSnapshot again.
+  tTJSVariant restoreSnapshot(const Snapshot &snapshot, QueryResultType queryResultType, const FetchOptions &options) {
+    freeBindings();
+    mOptions = options;
+
+    // the columns no longer belong to the last sql.
+    mColumns = snapshot.columns;
+    mResultColumns = 0;
+    mTitlesValid = false;
+    
+    mRowsetSize = snapshot.rowsetSize;
+    mRowStatus.resize(mRowsetSize);
+    // the driver keeps the address of the row status, which may have moved.
+    if (mHStmt)
+      SQLSetStmtAttr(mHStmt, SQL_ATTR_ROW_STATUS_PTR, &mRowStatus[0], 0);
+    mBindings = snapshot.types;
+
+    size_t arenaSize = 0;
+    for (bindings::iterator iBinding = mBindings.begin();
+         iBinding != mBindings.end();
+         iBinding++)
+      arenaSize += alignArena(sizeof(SQLLEN) * mRowsetSize)
+        + (iBinding->deferred ? 0 : alignArena(iBinding->width * mRowsetSize));
+    if (mArena.size() < arenaSize) {
+      mArena.resize(arenaSize);
+      mProfile.allocations++;
+    }
+    
+    size_t arenaUsed = 0;
+    for (bindings::iterator iBinding = mBindings.begin();
+         iBinding != mBindings.end();
+         iBinding++) {
+      iBinding->ind = (SQLLEN *)&mArena[arenaUsed];
+      arenaUsed += alignArena(sizeof(SQLLEN) * mRowsetSize);
+      if (iBinding->deferred) {
+        iBinding->buffer = (char *)malloc(std::max(iBinding->width, SQLLEN(1)));
+        if (! iBinding->buffer)
+          throwError(L"Unable to allocate a column buffer");
+        mProfile.allocations++;
+        continue;
+      }
+      iBinding->buffer = &mArena[arenaUsed];
+      arenaUsed += alignArena(iBinding->width * mRowsetSize);
+    }
+
+    if (snapshot.mapped.empty())
+      mReadAhead = snapshot.rows;
+    else
+      copyMappedRows(snapshot);
+    mReadAhead.next = 0;
+    mHasReadAhead = true;
+    return collectResults(queryResultType);
+  }
+
+  //----------------------------------------------------------------------
+  // the rows of a snapshot read from a file, copied to be fetched again.
+  void copyMappedRows(const Snapshot &snapshot) {
+    size_t count = snapshot.mapped.size();
+    SQLULEN rows = snapshot.rows.rows;
+    mReadAhead.buffers.resize(count);
+    mReadAhead.inds.resize(count);
+    mReadAhead.offsets.resize(count);
+    for (size_t col = 0; col < count; col++) {
+      const SnapshotColumn &column = snapshot.mapped[col];
+      mReadAhead.buffers[col].assign(column.data, column.data + column.size);
+      mReadAhead.inds[col].assign(column.inds, column.inds + rows);
+      mReadAhead.offsets[col].assign(column.offsets, column.offsets + column.offsetCount);
+    }
+    mReadAhead.status = snapshot.rows.status;
+    mReadAhead.rows = rows;
+  }
+
+  //----------------------------------------------------------------------
+  // executes the sql, and keeps all the columns of the rows in the
+  // snapshot without building a result. returns false when there is no
+  // result set.
+  bool execDirectToSnapshot(ttstr sqlString, const FetchOptions &options, Snapshot &snapshot) {
+    mOptions = options;
+    setResultSql(sqlString.c_str());
+    RETCODE retCode = timedExecDirect(sqlString.c_str());
+    return keepSnapshot(retCode, snapshot);
+  }
+
+  //----------------------------------------------------------------------
+  bool executeToSnapshot(tTJSVariant params, const FetchOptions &options, Snapshot &snapshot) {
+    mOptions = options;
+    bindParameters(params);
+    RETCODE retCode = timedExecute();
+    return keepSnapshot(retCode, snapshot);
+  }
+
+  //----------------------------------------------------------------------
+  bool keepSnapshot(RETCODE retCode, Snapshot &snapshot) {
+    SQLSMALLINT numResults = checkResult(retCode);
+    if (numResults <= 0)
+      return false;
+
+    allocateBindings(numResults, numResults);
+    readAhead();
+    makeSnapshot(snapshot);
+    std::swap(snapshot.rows, mReadAhead);
+    snapshot.rows.next = 0;
+    snapshot.size += getSnapshotRowsSize(snapshot);
+    freeBindings();
+    SQLFreeStmt(mHStmt, SQL_CLOSE);
+    return true;
+  }
+
+  //----------------------------------------------------------------------
+  static tjs_uint64 hashBytes(tjs_uint64 hash, const void *data, size_t size) {
+    const tjs_uint8 *bytes = (const tjs_uint8 *)data;
+    for (size_t i = 0; i < size; i++) {
+      hash ^= bytes[i];
+      hash *= 1099511628211ULL;
+    }
+    return hash;
+  }
+
+  //----------------------------------------------------------------------
+  // writes a section of a snapshot file, padded to 8 bytes.
+  static void writeSection(tTJSBinaryStream *stream, const void *data, size_t size) {
+    static const char padding[8] = {};
+    if (size > 0 && stream->Write(data, tjs_uint(size)) != size)
+      TVPThrowExceptionMessage(L"Cannot write the snapshot file.");
+    size_t pad = (8 - size % 8) % 8;
+    if (pad > 0 && stream->Write(padding, tjs_uint(pad)) != pad)
+      TVPThrowExceptionMessage(L"Cannot write the snapshot file.");
+  }
+
+  //----------------------------------------------------------------------
+  // a section of a snapshot file, checked to be inside the file.
+  static const char *readSection(const char *data, size_t size, size_t &offset, tjs_uint64 sectionSize) {
+    tjs_uint64 padded = sectionSize + (8 - sectionSize % 8) % 8;
+    if (padded < sectionSize || padded > size - offset)
+      TVPThrowExceptionMessage(L"Broken snapshot file.");
+    const char *section = data + offset;
+    offset += size_t(padded);
+    return section;
+  }
+
+  //----------------------------------------------------------------------
+  // hash of the column descriptions, saved in the snapshot files to tell
+  // the ones saved before the columns changed.
+  static tjs_uint64 getSchemaHash(const columnInfos &columns) {
+    // FNV-1a
+    tjs_uint64 hash = 14695981039346656037ULL;
+    for (columnInfos::const_iterator iColumn = columns.begin();
+         iColumn != columns.end();
+         iColumn++) {
+      tjs_int64 values[] = {
+        iColumn->type, iColumn->length, iColumn->scale, iColumn->precision, iColumn->isUnsigned
+      };
+      hash = hashBytes(hash, values, sizeof(values));
+      hash = hashBytes(hash, &iColumn->name[0], iColumn->name.size() * sizeof(WCHAR));
+    }
+    return hash;
+  }
+
+  //----------------------------------------------------------------------
+  // the schema hash of the columns the sql returns. the sql is prepared,
+  // not executed.
+  tjs_uint64 describeSchema(ttstr sqlString) {
+    TRYODBC(mHStmt,
+            SQL_HANDLE_STMT,
+            SQLPrepare(mHStmt, (SQLWCHAR*)sqlString.c_str(), SQL_NTS));
+    SQLSMALLINT numResults = 0;
+    TRYODBC(mHStmt,
+            SQL_HANDLE_STMT,
+            SQLNumResultCols(mHStmt, &numResults));
+    if (numResults <= 0)
+      return getSchemaHash(columnInfos());
+    setResultSql(sqlString.c_str());
+    describeColumns(numResults, numResults);
+    return getSchemaHash(columnInfos(mColumns.begin(), mColumns.begin() + numResults));
+  }
+
+  //----------------------------------------------------------------------
+  // writes the snapshot in the format of the snapshot files.
+  static void writeSnapshot(tTJSBinaryStream *stream, const Snapshot &snapshot, const ttstr &sqlString) {
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "ODBCSNAP", sizeof(header.magic));
+    header.version = kSnapshotVersion;
+    header.lengthSize = sizeof(SQLLEN);
+    header.offsetSize = sizeof(size_t);
+    header.columns = tjs_uint32(snapshot.types.size());
+    header.rowsetSize = tjs_uint32(snapshot.rowsetSize);
+    header.rows = snapshot.rows.rows;
+    header.schemaHash = getSchemaHash(snapshot.columns);
+    header.sqlLength = tjs_uint32(sqlString.length());
+    writeSection(stream, &header, sizeof(header));
+    writeSection(stream, sqlString.c_str(), sqlString.length() * sizeof(WCHAR));
+
+    for (size_t col = 0; col < snapshot.types.size(); col++) {
+      const Binding &binding = snapshot.types[col];
+      const ColumnInfo &column = snapshot.columns[col];
+      SnapshotColumn values = getSnapshotColumn(snapshot, col);
+      SnapshotColumnHeader columnHeader;
+      memset(&columnHeader, 0, sizeof(columnHeader));
+      columnHeader.type = column.type;
+      columnHeader.length = column.length;
+      columnHeader.scale = column.scale;
+      columnHeader.precision = column.precision;
+      columnHeader.width = binding.width;
+      columnHeader.dataSize = values.size;
+      columnHeader.offsetCount = values.offsetCount;
+      columnHeader.cType = binding.cType;
+      columnHeader.isUnsigned = column.isUnsigned;
+      columnHeader.deferred = binding.deferred;
+      columnHeader.nameLength = tjs_uint32(column.name.size() - 1);
+      writeSection(stream, &columnHeader, sizeof(columnHeader));
+      writeSection(stream, &column.name[0], columnHeader.nameLength * sizeof(WCHAR));
+    }
+
+    const std::vector<SQLUSMALLINT> &status = snapshot.rows.status;
+    writeSection(stream, status.empty() ? NULL : &status[0], status.size() * sizeof(SQLUSMALLINT));
+    for (size_t col = 0; col < snapshot.types.size(); col++) {
+      SnapshotColumn values = getSnapshotColumn(snapshot, col);
+      writeSection(stream, values.inds, size_t(snapshot.rows.rows) * sizeof(SQLLEN));
+      writeSection(stream, values.offsets, values.offsetCount * sizeof(size_t));
+      writeSection(stream, values.data, values.size);
+    }
+  }
+
+  //----------------------------------------------------------------------
+  // reads a snapshot file. the columns point into the data, which must be
+  // kept while the snapshot is used. returns false for a file of another
+  // version or build.
+  static bool readSnapshot(const char *data, size_t size, Snapshot &snapshot, tjs_uint64 &schemaHash) {
+    size_t offset = 0;
+    const SnapshotHeader *header = (const SnapshotHeader *)readSection(data, size, offset, sizeof(SnapshotHeader));
+    if (memcmp(header->magic, "ODBCSNAP", sizeof(header->magic)))
+      TVPThrowExceptionMessage(L"Not a snapshot file.");
+    if (header->version != kSnapshotVersion
+        || header->lengthSize != sizeof(SQLLEN)
+        || header->offsetSize != sizeof(size_t))
+      return false;
+    if (header->rows > size)
+      TVPThrowExceptionMessage(L"Broken snapshot file.");
+    SQLULEN rows = SQLULEN(header->rows);
+    readSection(data, size, offset, tjs_uint64(header->sqlLength) * sizeof(WCHAR));
+
+    snapshot.types.resize(header->columns);
+    snapshot.columns.resize(header->columns);
+    std::vector<SnapshotColumnHeader> columnHeaders(header->columns);
+    for (size_t col = 0; col < header->columns; col++) {
+      const SnapshotColumnHeader &columnHeader = columnHeaders[col] =
+        *(const SnapshotColumnHeader *)readSection(data, size, offset, sizeof(SnapshotColumnHeader));
+      ColumnInfo &column = snapshot.columns[col];
+      column.type = SQLLEN(columnHeader.type);
+      column.length = SQLLEN(columnHeader.length);
+      column.scale = SQLLEN(columnHeader.scale);
+      column.precision = SQLLEN(columnHeader.precision);
+      column.isUnsigned = columnHeader.isUnsigned != 0;
+      const WCHAR *name = (const WCHAR *)readSection(data, size, offset,
+                                                     tjs_uint64(columnHeader.nameLength) * sizeof(WCHAR));
+      column.name.assign(name, name + columnHeader.nameLength);
+      column.name.push_back(0);
+
+      Binding &binding = snapshot.types[col];
+      binding.buffer = NULL;
+      binding.ind = NULL;
+      binding.width = SQLLEN(columnHeader.width);
+      binding.type = column.type;
+      binding.cType = SQLSMALLINT(columnHeader.cType);
+      binding.deferred = columnHeader.deferred != 0;
+    }
+
+    const SQLUSMALLINT *status = (const SQLUSMALLINT *)readSection(data, size, offset,
+                                                                   tjs_uint64(rows) * sizeof(SQLUSMALLINT));
+    snapshot.rows.status.assign(status, status + rows);
+    snapshot.rows.rows = rows;
+    snapshot.rows.next = 0;
+
+    snapshot.mapped.resize(header->columns);
+    for (size_t col = 0; col < header->columns; col++) {
+      const SnapshotColumnHeader &columnHeader = columnHeaders[col];
+      SnapshotColumn &column = snapshot.mapped[col];
+      column.inds = (const SQLLEN *)readSection(data, size, offset, tjs_uint64(rows) * sizeof(SQLLEN));
+      column.offsets = (const size_t *)readSection(data, size, offset, columnHeader.offsetCount * sizeof(size_t));
+      column.offsetCount = size_t(columnHeader.offsetCount);
+      column.data = readSection(data, size, offset, columnHeader.dataSize);
+      column.size = size_t(columnHeader.dataSize);
+
+      // the values are read without further checks.
+      bool valid;
+      if (columnHeader.deferred) {
+        valid = column.offsetCount == rows;
+        for (size_t row = 0; valid && row < column.offsetCount; row++)
+          valid = column.offsets[row] <= column.size && (row == 0 || column.offsets[row - 1] <= column.offsets[row]);
+      } else
+        valid = columnHeader.width >= 0 && columnHeader.dataSize >= tjs_uint64(rows) * columnHeader.width;
+      if (! valid)
+        TVPThrowExceptionMessage(L"Broken snapshot file.");
+    }
+
+    // the rows are copied to the column buffers a rowset at a time, which
+    // need not be larger than the rows.
+    snapshot.rowsetSize = std::max(std::min(SQLULEN(header->rowsetSize), rows), SQLULEN(1));
+    snapshot.size = size;
+    schemaHash = header->schemaHash;
+    return true;
+  }
+
+  //----------------------------------------------------------------------
+  // main thread half of an asynchronous query. builds the result from the
+  // rows read by execDirectAsync.
+  tTJSVariant getAsyncResult(QueryResultType queryResultType) {
+    if (mBindings.empty())
+      return tTJSVariant();
+    tTJSVariant result = collectResults(queryResultType);
+    SQLFreeStmt(mHStmt, SQL_CLOSE);
+    return result;
+  }
+
+  //----------------------------------------------------------------------
+  // stops the execution, or the fetch between two rowsets. safe to call
+  // from another thread than the one running the statement.
+  void cancel() {
+    mCancelled = true;
+    SQLCancel(mHStmt);
+  }
+
+  //----------------------------------------------------------------------
+  // SQLFetch, failing as a cancel when cancel() interrupted it.
+  RETCODE fetch() {
+    RETCODE retCode = SQLFetch(mHStmt);
+    if (retCode == SQL_ERROR && mCancelled)
+      throwError(L"Query cancelled.");
+    return retCode;
+  }
+
+  //----------------------------------------------------------------------
+  // forgets the cancel of the last use. called before the statement is
+  // visible to cancel(), so that a cancel before the execution is kept.
+  void clearCancel() {
+    mCancelled = false;
+  }
+
+  //----------------------------------------------------------------------
+  tTJSVariant getTitles() {
+    tTJSVariant result = createArray();
+    ncbPropAccessor resultObj(result);
+    for (std::vector<ttstr>::iterator iTitle = mTitles.begin();
+         iTitle != mTitles.end();
+         iTitle++)
+      resultObj.FuncCall(0, L"add", &addHint, NULL, *iTitle);
+    return result;
+  }
+
+  //----------------------------------------------------------------------
+  // next row of the open cursor, or void when all rows are read.
+  tTJSVariant fetchRow(QueryResultType queryResultType) {
+    for (;;) {
+      if (mCursorRow >= mCursorRows) {
+        if (mBindings.empty())
+          return tTJSVariant();
+        mCursorRow = 0;
+        mCursorRows = fetchRowset();
+        if (mCursorRows == 0) {
+          closeCursor();
+          return tTJSVariant();
+        }
+      }
+      SQLULEN row = mCursorRow++;
+      if (mRowStatus[row] != SQL_ROW_ERROR)
+        return fetchRowValue(row, queryResultType);
+    }
+  }
+
+  //----------------------------------------------------------------------
+  // returns the statement to the state just after allocated.
+  void reset() {
+    stopPrefetch();
+    SQLFreeStmt(mHStmt, SQL_CLOSE);
+    SQLFreeStmt(mHStmt, SQL_RESET_PARAMS);
+    freeBindings();
+    mParameters.clear();
+    mCursorRow = mCursorRows = 0;
+  }
+
+  //----------------------------------------------------------------------
+  void closeCursor() {
+    stopPrefetch();
+    if (! mBindings.empty())
+      SQLFreeStmt(mHStmt, SQL_CLOSE);
+    freeBindings();
+    mCursorRow = mCursorRows = 0;
+  }
+
+  //----------------------------------------------------------------------
+  tTJSVariant executeBatch(tTJSVariant rows, SQLULEN batchSize) {
+    ncbPropAccessor rowsObj(rows);
+    tjs_int rowCount = countArray(rows);
+
+    tTJSVariant statusList = createArray();
+    ncbPropAccessor statusListObj(statusList);
+    tjs_int64 affectedRows = 0;
+    
+    TRYODBC(mHStmt,
+            SQL_HANDLE_STMT,
+            SQLFreeStmt(mHStmt, SQL_RESET_PARAMS));
+    mParameters.clear();
+
+    // drivers without parameter arrays execute the rows one by one.
+    if (! SQL_SUCCEEDED(SQLSetStmtAttr(mHStmt,
+                                       SQL_ATTR_PARAMSET_SIZE,
+                                       (SQLPOINTER)batchSize,
+                                       0)))
+      batchSize = 1;
+
+    std::vector<SQLUSMALLINT> status(batchSize);
+    SQLULEN processed = 0;
+
+    try {
+      TRYODBC(mHStmt,
+              SQL_HANDLE_STMT,
+              SQLSetStmtAttr(mHStmt,
+                             SQL_ATTR_PARAM_BIND_TYPE,
+                             (SQLPOINTER)SQL_PARAM_BIND_BY_COLUMN,
+                             0));
+      TRYODBC(mHStmt,
+              SQL_HANDLE_STMT,
+              SQLSetStmtAttr(mHStmt,
+                             SQL_ATTR_PARAM_STATUS_PTR,
+                             &status[0],
+                             0));
+      TRYODBC(mHStmt,
+              SQL_HANDLE_STMT,
+              SQLSetStmtAttr(mHStmt,
+                             SQL_ATTR_PARAMS_PROCESSED_PTR,
+                             &processed,
+                             0));
+
+      // the first row decides the number of parameters.
+      tjs_int columns = 0;
+      if (rowCount > 0)
+        columns = countArray(rowsObj.GetValue(0, ncbTypedefs::Tag<tTJSVariant>()));
+      mParameterArrays.resize(columns);
+
+      std::vector<tTJSVariant> values;
+      for (tjs_int first = 0; first < rowCount; first += tjs_int(batchSize)) {
+        tjs_int count = std::min(tjs_int(batchSize), rowCount - first);
+
+        values.assign(count * columns, tTJSVariant());
+        for (tjs_int row = 0; row < count; row++) {
+          tTJSVariant rowValues = rowsObj.GetValue(first + row, ncbTypedefs::Tag<tTJSVariant>());
+          ncbPropAccessor rowObj(rowValues);
+          tjs_int valueCount = std::min(tjs_int(countArray(rowValues)), columns);
+          for (tjs_int col = 0; col < valueCount; col++)
+            values[row * columns + col] = rowObj.GetValue(col, ncbTypedefs::Tag<tTJSVariant>());
+        }
+
+        for (tjs_int col = 0; col < columns; col++)
+          bindParameterArray(SQLUSMALLINT(col + 1), mParameterArrays[col], values, columns, count);
+
+        TRYODBC(mHStmt,
+                SQL_HANDLE_STMT,
+                SQLSetStmtAttr(mHStmt,
+                               SQL_ATTR_PARAMSET_SIZE,
+                               (SQLPOINTER)SQLULEN(count),
+                               0));
+        
+        processed = 0;
+        std::fill(status.begin(), status.end(), SQLUSMALLINT(SQL_PARAM_UNUSED));
+        RETCODE retCode = timedExecute();
+        
+        switch (retCode) {
+        case SQL_SUCCESS_WITH_INFO:
+          dumpDiagnosticRecord(mHStmt, SQL_HANDLE_STMT, retCode);
+          // fall through
+        case SQL_SUCCESS: {
+          SQLLEN chunkRows;
+          if (SQL_SUCCEEDED(SQLRowCount(mHStmt, &chunkRows)) && chunkRows > 0)
+            affectedRows += chunkRows;
+          break;
+        }
+        case SQL_NO_DATA:
+          break;
+        case SQL_ERROR:
+          dumpDiagnosticRecord(mHStmt, SQL_HANDLE_STMT, retCode);
+          break;
+        default: {
+          WCHAR buf[1024];                                                
+          swprintf_s(buf, 1023, L"Unexpected return code %hd!", retCode);
+          TVPThrowExceptionMessage(buf);
+        }
+        }
+        SQLFreeStmt(mHStmt, SQL_CLOSE);
+
+        // some drivers don't report the status of a single row.
+        if (processed == 0)
+          std::fill(status.begin(), status.begin() + count,
+                    SQLUSMALLINT(retCode == SQL_ERROR ? SQL_PARAM_ERROR : SQL_PARAM_SUCCESS));
+
+        for (tjs_int row = 0; row < count; row++)
+          statusListObj.FuncCall(0, L"add", &addHint, NULL, tjs_int(status[row]));
+      }
+    } catch (...) {
+      resetParameterArrays();
+      throw;
+    }
+    resetParameterArrays();
+
+    tTJSVariant result = createDictionary();
+    ncbPropAccessor resultObj(result);
+    resultObj.SetValue(L"rowCount", affectedRows);
+    resultObj.SetValue(L"status", statusList);
+    return result;
+  }
+
+private:
+  //----------------------------------------------------------------------
+  RETCODE timedExecDirect(const WCHAR *sqlString) {
+    applyLimits();
+    tjs_int64 start = getMicroseconds();
+    RETCODE retCode = SQLExecDirect(mHStmt, (SQLWCHAR*)sqlString, SQL_NTS);
+    mProfile.executeTime += getMicroseconds() - start;
+    return retCode;
+  }
+
+  //----------------------------------------------------------------------
+  RETCODE timedExecute() {
+    applyLimits();
+    tjs_int64 start = getMicroseconds();
+    RETCODE retCode = SQLExecute(mHStmt);
+    mProfile.executeTime += getMicroseconds() - start;
+    return retCode;
+  }
+
+  //----------------------------------------------------------------------
+  // sets the limits of the options to the statement before an execution.
+  // drivers without them are limited by the fetch alone.
+  void applyLimits() {
+    if (mOptions.queryTimeout != mQueryTimeout
+        && SQL_SUCCEEDED(SQLSetStmtAttr(mHStmt,
+                                        SQL_ATTR_QUERY_TIMEOUT,
+                                        (SQLPOINTER)mOptions.queryTimeout,
+                                        0)))
+      mQueryTimeout = mOptions.queryTimeout;
+    if (mOptions.maxRows != mMaxRows
+        && SQL_SUCCEEDED(SQLSetStmtAttr(mHStmt,
+                                        SQL_ATTR_MAX_ROWS,
+                                        (SQLPOINTER)mOptions.maxRows,
+                                        0)))
+      mMaxRows = mOptions.maxRows;
+    mFetchedRows = 0;
+    mFetchedBytes = 0;
+  }
+
+  //----------------------------------------------------------------------
+  tTJSVariant getResult(RETCODE retCode, QueryResultType queryResultType) {
+    SQLSMALLINT numResults = checkResult(retCode);
+    if (numResults > 0) {
+      tTJSVariant result = fetchResults(numResults, queryResultType);
+      SQLFreeStmt(mHStmt, SQL_CLOSE);
+      return result;
+    }
+    return tTJSVariant();
+  }
+
+  //----------------------------------------------------------------------
+  bool openCursor(RETCODE retCode, QueryResultType queryResultType) {
+    SQLSMALLINT numResults = checkResult(retCode);
+    if (numResults > 0) {
+      allocateBindings(queryResultType == qrtSingleColumnArray ? 1 : numResults, numResults, true);
+      updateTitles();
+      mCursorRow = mCursorRows = 0;
+      if (mBufferSlots > 1)
+        startPrefetch();
+      return true;
+    }
+    return false;
+  }
+
+  //----------------------------------------------------------------------
+  // starts the helper thread fetching into the other buffer slots.
+  // drivers without the bind offset are read on the main thread.
+  void startPrefetch() {
+    mBindOffset = 0;
+    if (! SQL_SUCCEEDED(SQLSetStmtAttr(mHStmt, SQL_ATTR_ROW_BIND_OFFSET_PTR, &mBindOffset, 0)))
+      return;
+    allocWorkerLog();
+
+    Prefetch *prefetch = new Prefetch();
+    prefetch->base = mBindings;
+    prefetch->status.resize(mBufferSlots * mRowsetSize);
+    prefetch->rows.assign(mBufferSlots, 0);
+    mPrefetch = prefetch;
+    uintptr_t thread = _beginthreadex(NULL, 0, prefetchProc, this, 0, NULL);
+    if (! thread) {
+      mPrefetch = NULL;
+      delete prefetch;
+      SQLSetStmtAttr(mHStmt, SQL_ATTR_ROW_BIND_OFFSET_PTR, NULL, 0);
+      return;
+    }
+    prefetch->thread = (HANDLE)thread;
+  }
+
+  //----------------------------------------------------------------------
+  // waits for the helper thread, and fetches on the main thread again.
+  void stopPrefetch() {
+    if (! mPrefetch)
+      return;
+    Prefetch *prefetch = mPrefetch;
+    EnterCriticalSection(&prefetch->lock);
+    prefetch->stop = true;
+    LeaveCriticalSection(&prefetch->lock);
+    SetEvent(prefetch->freed);
+    WaitForSingleObject(prefetch->thread, INFINITE);
+
+    mProfile.fetchTime += prefetch->fetchTime;
+    mBindings = prefetch->base;
+    mPrefetch = NULL;
+    delete prefetch;
+
+    SQLSetStmtAttr(mHStmt, SQL_ATTR_ROW_BIND_OFFSET_PTR, NULL, 0);
+    SQLSetStmtAttr(mHStmt, SQL_ATTR_ROW_STATUS_PTR, &mRowStatus[0], 0);
+    SQLSetStmtAttr(mHStmt, SQL_ATTR_ROWS_FETCHED_PTR, &mRowsFetched, 0);
+  }
+
+  //----------------------------------------------------------------------
+  static unsigned __stdcall prefetchProc(void *param) {
+    Statement *self = (Statement *)param;
+    Prefetch *prefetch = self->mPrefetch;
+    TlsSetValue(workerLogIndex, &prefetch->log);
+    try {
+      self->prefetchRowsets();
+    } catch (WorkerError &) {
+      prefetch->failed = true;
+    } catch (...) {
+      static const WCHAR message[] = L"Unexpected error in a worker thread";
+      prefetch->log.error.assign(message, message + sizeof(message) / sizeof(WCHAR));
+      prefetch->failed = true;
+    }
+    TlsSetValue(workerLogIndex, NULL);
+
+    EnterCriticalSection(&prefetch->lock);
+    prefetch->done = true;
+    LeaveCriticalSection(&prefetch->lock);
+    SetEvent(prefetch->filled);
+    return 0;
+  }
+
+  //----------------------------------------------------------------------
+  void lockConnection() {
+    if (mConnectionLock)
+      EnterCriticalSection(mConnectionLock);
+  }
+
+  void unlockConnection() {
+    if (mConnectionLock)
+      LeaveCriticalSection(mConnectionLock);
+  }
+
+  //----------------------------------------------------------------------
+  // helper thread half of the prefetch. fills the free slots one by one
+  // until the rows end or stop is asked.
+  void prefetchRowsets() {
+    Prefetch *prefetch = mPrefetch;
+    for (;;) {
+      EnterCriticalSection(&prefetch->lock);
+      while (! prefetch->stop
+             && prefetch->count + (prefetch->reading ? 1 : 0) >= mBufferSlots) {
+        LeaveCriticalSection(&prefetch->lock);
+        WaitForSingleObject(prefetch->freed, INFINITE);
+        EnterCriticalSection(&prefetch->lock);
+      }
+      bool stop = prefetch->stop;
+      size_t slot = (prefetch->head + prefetch->count) % mBufferSlots;
+      LeaveCriticalSection(&prefetch->lock);
+      if (stop)
+        return;
+      if (mCancelled)
+        throwError(L"Query cancelled.");
+
+      RETCODE retCode = SQL_SUCCESS;
+      tjs_int64 start = getMicroseconds();
+      mBindOffset = SQLLEN(slot * mSlotSize);
+      prefetch->rows[slot] = 0;
+      SQLSetStmtAttr(mHStmt, SQL_ATTR_ROW_STATUS_PTR, &prefetch->status[slot * mRowsetSize], 0);
+      SQLSetStmtAttr(mHStmt, SQL_ATTR_ROWS_FETCHED_PTR, &prefetch->rows[slot], 0);
+      lockConnection();
+      try {
+        TRYODBC(mHStmt, SQL_HANDLE_STMT, retCode = fetch());
+      } catch (...) {
+        unlockConnection();
+        throw;
+      }
+      unlockConnection();
+      prefetch->fetchTime += getMicroseconds() - start;
+      if (retCode == SQL_NO_DATA_FOUND)
+        return;
+
+      EnterCriticalSection(&prefetch->lock);
+      prefetch->count++;
+      LeaveCriticalSection(&prefetch->lock);
+      SetEvent(prefetch->filled);
+    }
+  }
+
+  //----------------------------------------------------------------------
+  // main thread half of the prefetch. gives back the slot read so far,
+  // and points the bindings at the next filled one.
+  SQLULEN fetchPrefetched() {
+    Prefetch *prefetch = mPrefetch;
+    EnterCriticalSection(&prefetch->lock);
+    if (prefetch->reading) {
+      prefetch->reading = false;
+      SetEvent(prefetch->freed);
+    }
+    while (prefetch->count == 0 && ! prefetch->done) {
+      LeaveCriticalSection(&prefetch->lock);
+      WaitForSingleObject(prefetch->filled, INFINITE);
+      EnterCriticalSection(&prefetch->lock);
+    }
+    if (prefetch->count == 0) {
+      LeaveCriticalSection(&prefetch->lock);
+
+      // the logs and the error of the helper thread are reported here.
+      WorkerLog log = prefetch->log;
+      bool failed = prefetch->failed;
+      stopPrefetch();
+      for (std::list<std::vector<WCHAR> >::iterator iMessage = log.messages.begin();
+           iMessage != log.messages.end();
+           iMessage++)
+        TVPAddLog(&(*iMessage)[0]);
+      if (failed)
+        TVPThrowExceptionMessage(&log.error[0]);
+      return 0;
+    }
+    size_t slot = prefetch->head;
+    prefetch->head = (slot + 1) % mBufferSlots;
+    prefetch->count--;
+    prefetch->reading = true;
+    LeaveCriticalSection(&prefetch->lock);
+
+    size_t offset = slot * mSlotSize;
+    for (size_t col = 0; col < mBindings.size(); col++) {
+      mBindings[col].buffer = prefetch->base[col].buffer + offset;
+      mBindings[col].ind = (SQLLEN *)((char *)prefetch->base[col].ind + offset);
+    }
+    SQLULEN rowCount = prefetch->rows[slot];
+    std::copy(prefetch->status.begin() + slot * mRowsetSize,
+              prefetch->status.begin() + slot * mRowsetSize + rowCount,
+              mRowStatus.begin());
+    return countRowset(rowCount);
+  }
+
+  //----------------------------------------------------------------------
+  // reports the result of an execution, and returns the number of the
+  // result columns. 0 when the statement returned no rows.
+  SQLSMALLINT checkResult(RETCODE retCode) {
+    SQLSMALLINT numResults = 0;
+    
+    switch(retCode)
+      {
+      case SQL_SUCCESS_WITH_INFO:
+        {
+          dumpDiagnosticRecord(mHStmt, SQL_HANDLE_STMT, retCode);
+          // fall through
+        }
+      case SQL_SUCCESS:
+        {
+          // If this is a row-returning query, display
+          // results
+          TRYODBC(mHStmt,
+                  SQL_HANDLE_STMT,
+                  SQLNumResultCols(mHStmt,&numResults));
+          
+          if (numResults <= 0 && mOptions.logAffectedRows)
+            dumpAffectedRows(mHStmt);
+          break;
+        }
+        
+      case SQL_NO_DATA:
+        // searched update or delete that affected no rows
+        break;
+
+      case SQL_ERROR:
+        {
+          dumpDiagnosticRecord(mHStmt, SQL_HANDLE_STMT, retCode);
+          if (mCancelled)
+            throwError(L"Query cancelled.");
+          break;
+        }
+        
+      default: {
+        WCHAR buf[1024];                                                
+        swprintf_s(buf, 1023, L"Unexpected return code %hd!", retCode);
+        throwError(buf);
+      }
+      }
+
+    return std::max(numResults, SQLSMALLINT(0));
+  }
+
+  //----------------------------------------------------------------------
+  void bindParameters(tTJSVariant params) {
+    TRYODBC(mHStmt,
+            SQL_HANDLE_STMT,
+            SQLFreeStmt(mHStmt, SQL_RESET_PARAMS));
+    mParameters.clear();
+    
+    if (params.Type() != tvtObject)
+      return;
+
+    ncbPropAccessor paramsObj(params);
+    tjs_int count = countArray(params);
+
+    // the buffers must not move once bound, so allocate them all first.
+    mParameters.resize(count);
+    for (tjs_int i = 0; i < count; i++) {
+      mParameters[i].value = paramsObj.GetValue(i, ncbTypedefs::Tag<tTJSVariant>());
+      bindParameter(SQLUSMALLINT(i + 1), mParameters[i]);
+    }
+  }
+
+  //----------------------------------------------------------------------
+  void bindParameter(SQLUSMALLINT number, Parameter &parameter) {
+    SQLSMALLINT cType, sqlType, digits = 0;
+    SQLULEN     columnSize = 0;
+    SQLPOINTER  buffer = NULL;
+    SQLLEN      bufferLength = 0;
+    
+    parameter.ind = 0;
+    
+    switch (parameter.value.Type()) {
+    case tvtVoid:
+      cType = SQL_C_WCHAR;
+      sqlType = SQL_WVARCHAR;
+      columnSize = 1;
+      parameter.ind = SQL_NULL_DATA;
+      break;
+    case tvtInteger:
+      parameter.integer = parameter.value.AsInteger();
+      cType = SQL_C_SBIGINT;
+      sqlType = SQL_BIGINT;
+      buffer = &parameter.integer;
+      break;
+    case tvtReal:
+      parameter.real = parameter.value.AsReal();
+      cType = SQL_C_DOUBLE;
+      sqlType = SQL_DOUBLE;
+      buffer = &parameter.real;
+      break;
+    case tvtOctet: {
+      tTJSVariantOctet *octet = parameter.value.AsOctetNoAddRef();
+      parameter.ind = octet ? octet->GetLength() : 0;
+      cType = SQL_C_BINARY;
+      sqlType = parameter.ind > 8000 ? SQL_LONGVARBINARY : SQL_VARBINARY;
+      columnSize = std::max(parameter.ind, SQLLEN(1));
+      buffer = octet ? (SQLPOINTER)octet->GetData() : NULL;
+      bufferLength = parameter.ind;
+      break;
+    }
+    default:
+      if (isDateObject(parameter.value)) {
+        parameter.timestamp = timeToTimestamp(getDateTime(parameter.value));
+        cType = SQL_C_TYPE_TIMESTAMP;
+        sqlType = SQL_TYPE_TIMESTAMP;
+        columnSize = 23;
+        digits = 3;
+        buffer = &parameter.timestamp;
+        bufferLength = sizeof(parameter.timestamp);
+      } else {
+        // strings, and any other object as its string representation
+        parameter.string = ttstr(parameter.value);
+        parameter.ind = parameter.string.length() * sizeof(WCHAR);
+        cType = SQL_C_WCHAR;
+        sqlType = parameter.string.length() > 4000 ? SQL_WLONGVARCHAR : SQL_WVARCHAR;
+        columnSize = std::max(parameter.string.length(), 1);
+        buffer = (SQLPOINTER)parameter.string.c_str();
+        bufferLength = parameter.ind + sizeof(WCHAR);
+      }
+      break;
+    }
+
+    TRYODBC(mHStmt,
+            SQL_HANDLE_STMT,
+            SQLBindParameter(mHStmt,
+                             number,
+                             SQL_PARAM_INPUT,
+                             cType,
+                             sqlType,
+                             columnSize,
+                             digits,
+                             buffer,
+                             bufferLength,
+                             &parameter.ind));
+  }
+
+  //----------------------------------------------------------------------
+  void bindParameterArray(SQLUSMALLINT number,
+                          ParameterArray &array,
+                          const std::vector<tTJSVariant> &values,
+                          tjs_int columns,
+                          tjs_int rows) {
+    // the values of a column share one type. integers mixed with reals are
+    // sent as reals, any other mixture as strings.
+    tTJSVariantType type = tvtVoid;
+    for (tjs_int row = 0; row < rows; row++) {
+      const tTJSVariant &value = values[row * columns + number - 1];
+      tTJSVariantType valueType = value.Type();
+      if (valueType == tvtObject && ! isDateObject(value))
+        valueType = tvtString;
+      if (valueType == tvtVoid || valueType == type)
+        continue;
+      if (type == tvtVoid)
+        type = valueType;
+      else if ((type == tvtInteger || type == tvtReal)
+               && (valueType == tvtInteger || valueType == tvtReal))
+        type = tvtReal;
+      else
+        type = tvtString;
+    }
+
+    SQLSMALLINT cType, sqlType, digits = 0;
+    SQLULEN     columnSize = 0;
+    std::vector<ttstr> strings;
+    
+    switch (type) {
+    case tvtInteger:
+      cType = SQL_C_SBIGINT;
+      sqlType = SQL_BIGINT;
+      array.width = sizeof(SQLBIGINT);
+      break;
+    case tvtReal:
+      cType = SQL_C_DOUBLE;
+      sqlType = SQL_DOUBLE;
+      array.width = sizeof(SQLDOUBLE);
+      break;
+    case tvtObject:
+      cType = SQL_C_TYPE_TIMESTAMP;
+      sqlType = SQL_TYPE_TIMESTAMP;
+      columnSize = 23;
+      digits = 3;
+      array.width = sizeof(SQL_TIMESTAMP_STRUCT);
+      break;
+    case tvtOctet:
+      columnSize = 1;
+      for (tjs_int row = 0; row < rows; row++) {
+        tTJSVariantOctet *octet = values[row * columns + number - 1].AsOctetNoAddRef();
+        if (octet)
+          columnSize = std::max(columnSize, SQLULEN(octet->GetLength()));
+      }
+      cType = SQL_C_BINARY;
+      sqlType = columnSize > 8000 ? SQL_LONGVARBINARY : SQL_VARBINARY;
+      array.width = SQLLEN(columnSize);
+      break;
+    default:
+      // strings, and any other object as its string representation
+      columnSize = 1;
+      strings.resize(rows);
+      for (tjs_int row = 0; row < rows; row++) {
+        const tTJSVariant &value = values[row * columns + number - 1];
+        if (value.Type() != tvtVoid) {
+          strings[row] = ttstr(value);
+          columnSize = std::max(columnSize, SQLULEN(strings[row].length()));
+        }
+      }
+      cType = SQL_C_WCHAR;
+      sqlType = columnSize > 4000 ? SQL_WLONGVARCHAR : SQL_WVARCHAR;
+      array.width = SQLLEN(columnSize + 1) * sizeof(WCHAR);
+      break;
+    }
+
+    array.buffer.assign(array.width * rows, 0);
+    array.ind.assign(rows, 0);
+    
+    for (tjs_int row = 0; row < rows; row++) {
+      const tTJSVariant &value = values[row * columns + number - 1];
+      char *data = &array.buffer[row * array.width];
+      if (value.Type() == tvtVoid) {
+        array.ind[row] = SQL_NULL_DATA;
+        continue;
+      }
+      switch (type) {
+      case tvtInteger:
+        *(SQLBIGINT *)data = tjs_int64(value);
+        break;
+      case tvtReal:
+        *(SQLDOUBLE *)data = tjs_real(value);
+        break;
+      case tvtObject:
+        *(SQL_TIMESTAMP_STRUCT *)data = timeToTimestamp(getDateTime(value));
+        break;
+      case tvtOctet: {
+        tTJSVariantOctet *octet = value.AsOctetNoAddRef();
+        if (octet) {
+          memcpy(data, octet->GetData(), octet->GetLength());
+          array.ind[row] = octet->GetLength();
+        }
+        break;
+      }
+      default:
+        memcpy(data, strings[row].c_str(), strings[row].length() * sizeof(WCHAR));
+        array.ind[row] = strings[row].length() * sizeof(WCHAR);
+        break;
+      }
+    }
+
+    TRYODBC(mHStmt,
+            SQL_HANDLE_STMT,
+            SQLBindParameter(mHStmt,
+                             number,
+                             SQL_PARAM_INPUT,
+                             cType,
+                             sqlType,
+                             columnSize,
+                             digits,
+                             &array.buffer[0],
+                             array.width,
+                             &array.ind[0]));
+  }
+
+  //----------------------------------------------------------------------
+  void resetParameterArrays() {
+    SQLSetStmtAttr(mHStmt, SQL_ATTR_PARAMSET_SIZE, (SQLPOINTER)1, 0);
+    SQLSetStmtAttr(mHStmt, SQL_ATTR_PARAM_STATUS_PTR, NULL, 0);
+    SQLSetStmtAttr(mHStmt, SQL_ATTR_PARAMS_PROCESSED_PTR, NULL, 0);
+    SQLFreeStmt(mHStmt, SQL_RESET_PARAMS);
+    mParameterArrays.clear();
+  }
+
+  //----------------------------------------------------------------------
+  tTJSVariant fetchResults(SQLSMALLINT cCols, QueryResultType queryResultType) {
+    // a single column array needs only the first column.
+    allocateBindings(queryResultType == qrtSingleColumnArray ? 1 : cCols, cCols);
+    return collectResults(queryResultType);
+  }
+
+  //----------------------------------------------------------------------
+  // builds the result from the bound columns. the cursor is left open, so
+  // that the following result sets can be read.
+  tTJSVariant collectResults(QueryResultType queryResultType) {
+    if (queryResultType == qrtResultSet)
+      return collectResultSet();
+
+    // conversion is the time not spent in fetching.
+    tjs_int64 start = getMicroseconds();
+    tjs_int64 fetchTime = mProfile.fetchTime;
+    tjs_int64 objects = createdObjects;
+
+    tTJSVariant result;
+    updateTitles();
+    if (queryResultType == qrtColumns || queryResultType == qrtPackedColumns)
+      result = fetchColumnResults(queryResultType == qrtPackedColumns);
+    else {
+      // the container of the rows is made only for the row-wise types.
+      result = createArray();
+      ncbPropAccessor resultObj(result);
+      if (queryResultType == qrtArray)
+        resultObj.FuncCall(0, L"add", &addHint, NULL, getTitles());
+
+      SQLULEN rowCount;
+      while ((rowCount = fetchRowset()) > 0) {
+        for (SQLULEN row = 0; row < rowCount; row++) {
+          if (mRowStatus[row] == SQL_ROW_ERROR)
+            continue;
+          tTJSVariant columns = fetchRowValue(row, queryResultType);
+          resultObj.FuncCall(0, L"add", &addHint, NULL, columns);
+        }
+      }
+    }
+        
+    freeBindings();
+
+    mProfile.convertTime += getMicroseconds() - start - (mProfile.fetchTime - fetchTime);
+    mProfile.allocations += createdObjects - objects;
+    return result;
+  }
+
+  //----------------------------------------------------------------------
+  // keeps the rows natively in a snapshot, which the returned result set
+  // reads when the script asks for the values.
+  tTJSVariant collectResultSet() {
+    if (! mHasReadAhead)
+      readAhead();
+
+    tjs_int64 objects = createdObjects;
+    Snapshot *snapshot = new Snapshot();
+    try {
+      makeSnapshot(*snapshot);
+      std::swap(snapshot->rows, mReadAhead);
+      snapshot->rows.next = 0;
+      snapshot->size += getSnapshotRowsSize(*snapshot);
+      freeBindings();
+    } catch (...) {
+      delete snapshot;
+      throw;
+    }
+
+    tTJSVariant result = createResultSet(snapshot, mOptions.dateMode);
+    mProfile.allocations += createdObjects - objects;
+    return result;
+  }
+
+  //----------------------------------------------------------------------
+  // the bound columns without their buffers. the rows are added by the
+  // caller.
+  void makeSnapshot(Snapshot &snapshot) {
+    snapshot.types = mBindings;
+    for (bindings::iterator iBinding = snapshot.types.begin();
+         iBinding != snapshot.types.end();
+         iBinding++) {
+      iBinding->buffer = NULL;
+      iBinding->ind = NULL;
+    }
+    snapshot.columns.assign(mColumns.begin(), mColumns.begin() + mBindings.size());
+    snapshot.rowsetSize = mRowsetSize;
+    snapshot.size = sizeof(snapshot);
+  }
+
+  //----------------------------------------------------------------------
+  static size_t getSnapshotRowsSize(const Snapshot &snapshot) {
+    size_t size = snapshot.rows.status.size() * sizeof(SQLUSMALLINT);
+    for (size_t col = 0; col < snapshot.types.size(); col++)
+      size += sizeof(Binding) + sizeof(ColumnInfo)
+        + snapshot.columns[col].name.size() * sizeof(WCHAR)
+        + snapshot.rows.buffers[col].size()
+        + snapshot.rows.inds[col].size() * sizeof(SQLLEN)
+        + snapshot.rows.offsets[col].size() * sizeof(size_t);
+    return size;
+  }
+
+  //----------------------------------------------------------------------
+  // reads all rows into one array per column. when pack is true, integer
+  // and real columns are returned as octets of native int64 / double
+  // values with a null bitmap, instead of an array of variants.
+  tTJSVariant fetchColumnResults(bool pack) {
+    static const char zero[sizeof(SQLDOUBLE)] = {};
+    std::vector<ColumnValues> columns(mBindings.size());
+    
+    size_t col = 0;
+    for (bindings::iterator iBinding = mBindings.begin();
+         iBinding != mBindings.end();
+         iBinding++, col++) {
+      columns[col].packed = pack && (iBinding->cType == SQL_C_SBIGINT
+                                     || iBinding->cType == SQL_C_DOUBLE);
+      if (! columns[col].packed)
+        columns[col].array = createArray();
+    }
+
+    tjs_uint count = 0;
+    SQLULEN rowCount;
+    
+    while ((rowCount = fetchRowset()) > 0) {
+      for (SQLULEN row = 0; row < rowCount; row++) {
+        if (mRowStatus[row] == SQL_ROW_ERROR)
+          continue;
+        col = 0;
+        for (bindings::iterator iBinding = mBindings.begin();
+             iBinding != mBindings.end();
+             iBinding++, col++) {
+          ColumnValues &column = columns[col];
+          if (column.packed) {
+            const char *data = iBinding->buffer + row * iBinding->width;
+            if (count % 8 == 0)
+              column.nulls.push_back(0);
+            if (iBinding->ind[row] == SQL_NULL_DATA) {
+              column.nulls.back() |= tjs_uint8(1 << (count % 8));
+              data = zero;
+            }
+            column.data.insert(column.data.end(), data, data + iBinding->width);
+          } else {
+            tTJSVariant value = getColumnValue(*iBinding, row);
+            tTJSVariant *args[] = { &value };
+            iTJSDispatch2 *array = column.array.AsObjectNoAddRef();
+            array->FuncCall(0, L"add", &addHint, NULL, 1, args, array);
+          }
+        }
+        count++;
+      }
+    }
+
+    tTJSVariant result = createDictionary();
+    ncbPropAccessor resultObj(result);
+    
+    col = 0;
+    for (bindings::iterator iBinding = mBindings.begin();
+         iBinding != mBindings.end();
+         iBinding++, col++) {
+      ColumnValues &column = columns[col];
+      tTJSVariant values = column.array;
+      if (column.packed) {
+        values = createDictionary();
+        ncbPropAccessor valuesObj(values);
+        valuesObj.SetValue(L"type", ttstr(iBinding->cType == SQL_C_SBIGINT ? L"int64" : L"double"));
+        valuesObj.SetValue(L"count", tjs_int(count));
+        valuesObj.SetValue(L"data", createOctet(column.data.empty() ? NULL : &column.data[0],
+                                                tjs_uint(column.data.size())));
+        valuesObj.SetValue(L"nulls", createOctet(column.nulls.empty() ? NULL : &column.nulls[0],
+                                                 tjs_uint(column.nulls.size())));
+      }
+      resultObj.SetValue(mTitles[col].c_str(), values, 0, &mTitleHints[col]);
+    }
+    
+    return result;
+  }
+
+  //----------------------------------------------------------------------
+  // writes the rows straight from the column buffers, so that no more
+  // than a rowset is kept in memory. returns the number of the rows.
+  tjs_int64 exportResults(RETCODE retCode, ExportWriter &writer) {
+    SQLSMALLINT numResults = checkResult(retCode);
+    if (numResults <= 0)
+      return 0;
+    allocateBindings(numResults, numResults);
+
+    // conversion is the time not spent in fetching.
+    tjs_int64 start = getMicroseconds();
+    tjs_int64 fetchTime = mProfile.fetchTime;
+
+    updateTitles();
+    writer.begin(mTitles);
+
+    tjs_int64 count = 0;
+    SQLULEN rowCount;
+    while ((rowCount = fetchRowset()) > 0) {
+      for (SQLULEN row = 0; row < rowCount; row++) {
+        if (mRowStatus[row] == SQL_ROW_ERROR)
+          continue;
+        writer.beginRow();
+        for (bindings::iterator iBinding = mBindings.begin();
+             iBinding != mBindings.end();
+             iBinding++)
+          exportColumnValue(writer, *iBinding, row);
+        writer.endRow();
+        count++;
+      }
+    }
+
+    freeBindings();
+    SQLFreeStmt(mHStmt, SQL_CLOSE);
+
+    mProfile.convertTime += getMicroseconds() - start - (mProfile.fetchTime - fetchTime);
+    return count;
+  }
+
+  //----------------------------------------------------------------------
+  // binds the first cCols columns of a result with numResults columns.
+  // a cursor may prefetch, which needs more than one set of the buffers.
+  void allocateBindings(SQLSMALLINT cCols, SQLSMALLINT numResults, bool prefetch = false) {
+    freeBindings();
+    describeColumns(cCols, numResults);
+    
+    SQLSMALLINT     col;
+    SQLLEN          rowWidth = 0;
+    bool            deferred = false;
+    
+    mBindings.reserve(cCols);
+    for (col = 1; col <= cCols; col++) {
+      const ColumnInfo &column = mColumns[col - 1];
+      Binding binding = {};
+
+      // get column type
+      binding.type = column.type;
+
+      // large and unbounded columns are left unbound and read by SQLGetData.
+      // drivers may not allow bound columns after them, so the following
+      // columns are read so too.
+      deferred = deferred || isLargeColumn(column);
+      binding.deferred = deferred;
+
+      // numbers are bound as native values, everything else as text.
+      switch (binding.type) {
+      case SQL_SMALLINT:
+      case SQL_INTEGER:
+      case SQL_TINYINT:
+        binding.cType = SQL_C_SBIGINT;
+        break;
+      case SQL_BIGINT:
+        // unsigned bigint may not fit into tjs_int64.
+        if (! column.isUnsigned)
+          binding.cType = SQL_C_SBIGINT;
+        break;
+      case SQL_REAL:
+      case SQL_FLOAT:
+      case SQL_DOUBLE:
+        binding.cType = SQL_C_DOUBLE;
+        break;
+      case SQL_DECIMAL:
+      case SQL_NUMERIC:
+        // dmExact keeps every digit: integers as Integer, others as String.
+        if (mOptions.decimalMode == dmReal)
+          binding.cType = SQL_C_DOUBLE;
+        else if (column.scale == 0 && column.precision <= 18)
+          binding.cType = SQL_C_SBIGINT;
+        break;
+      case SQL_TYPE_DATE:
+      case SQL_TYPE_TIME:
+      case SQL_TYPE_TIMESTAMP:
+        binding.cType = SQL_C_TYPE_TIMESTAMP;
+        break;
+      case SQL_BINARY:
+      case SQL_VARBINARY:
+      case SQL_LONGVARBINARY:
+        binding.cType = SQL_C_BINARY;
+        break;
+      }
+
+      switch (binding.cType) {
+      case SQL_C_SBIGINT:
+        binding.width = sizeof(SQLBIGINT);
+        break;
+      case SQL_C_DOUBLE:
+        binding.width = sizeof(SQLDOUBLE);
+        break;
+      case SQL_C_TYPE_TIMESTAMP:
+        binding.width = sizeof(SQL_TIMESTAMP_STRUCT);
+        break;
+      case SQL_C_BINARY:
+        // deferred buffers grow while reading.
+        binding.width = deferred ? 0 : std::max(column.length, SQLLEN(1));
+        break;
+      default:
+        binding.cType = SQL_C_TCHAR;
+        binding.width = deferred ? 0 : (column.length + 1) * sizeof(WCHAR);
+        break;
+      }
+
+      rowWidth += binding.width + sizeof(SQLLEN);
+      mBindings.push_back(binding);
+    }
+
+    // decide how many rows are fetched at once. wide rows get a smaller
+    // rowset so that the column buffers stay within kRowsetBufferLimit.
+    // SQLGetData reads one row at a time.
+    mRowsetSize = std::max(SQLULEN(1),
+                           std::min(mOptions.fetchRowsetSize,
+                                    SQLULEN(kRowsetBufferLimit / std::max(rowWidth, SQLLEN(1)))));
+    if (deferred)
+      mRowsetSize = 1;
+
+    TRYODBC(mHStmt,
+            SQL_HANDLE_STMT,
+            SQLSetStmtAttr(mHStmt,
+                           SQL_ATTR_ROW_BIND_TYPE,
+                           (SQLPOINTER)SQL_BIND_BY_COLUMN,
+                           0));
+    
+    // the driver may not support block cursors. then it falls back to
+    // another value, so read back the actual rowset size.
+    SQLSetStmtAttr(mHStmt,
+                   SQL_ATTR_ROW_ARRAY_SIZE,
+                   (SQLPOINTER)mRowsetSize,
+                   0);
+    TRYODBC(mHStmt,
+            SQL_HANDLE_STMT,
+            SQLGetStmtAttr(mHStmt,
+                           SQL_ATTR_ROW_ARRAY_SIZE,
+                           &mRowsetSize,
+                           0,
+                           NULL));
+
+    mRowStatus.resize(mRowsetSize);
+    
+    TRYODBC(mHStmt,
+            SQL_HANDLE_STMT,
+            SQLSetStmtAttr(mHStmt,
+                           SQL_ATTR_ROW_STATUS_PTR,
+                           &mRowStatus[0],
+                           0));
+    
+    TRYODBC(mHStmt,
+            SQL_HANDLE_STMT,
+            SQLSetStmtAttr(mHStmt,
+                           SQL_ATTR_ROWS_FETCHED_PTR,
+                           &mRowsFetched,
+                           0));
+    
+    // carve the buffers from the arena. deferred columns have their own
+    // buffers, which grow while reading.
+    size_t arenaSize = 0;
+    for (bindings::iterator iBinding = mBindings.begin();
+         iBinding != mBindings.end();
+         iBinding++) {
+      arenaSize += alignArena(sizeof(SQLLEN) * mRowsetSize);
+      if (! iBinding->deferred)
+        arenaSize += alignArena(iBinding->width * mRowsetSize);
+    }
+
+    // a set for each rowset fetched ahead and the one being read, as
+    // many as the depth and the limit allow.
+    mBufferSlots = 1;
+    mSlotSize = arenaSize;
+    if (prefetch && ! deferred && mOptions.prefetchDepth > 0) {
+      size_t slots = std::min(size_t(mOptions.prefetchDepth) + 1,
+                              size_t(mOptions.prefetchLimit) / std::max(arenaSize, size_t(1)));
+      if (slots >= 2)
+        mBufferSlots = slots;
+    }
+    if (mArena.size() < arenaSize * mBufferSlots) {
+      mArena.resize(arenaSize * mBufferSlots);
+      mProfile.allocations++;
+    }
+    
+    size_t arenaUsed = 0;
+    col = 1;
+    for (bindings::iterator iBinding = mBindings.begin();
+         iBinding != mBindings.end();
+         iBinding++, col++) {
+      // allocate column buffer.
+      iBinding->ind = (SQLLEN *)&mArena[arenaUsed];
+      arenaUsed += alignArena(sizeof(SQLLEN) * mRowsetSize);
+
+      if (iBinding->deferred) {
+        iBinding->buffer = (char *)malloc(std::max(iBinding->width, SQLLEN(1)));
+        if (! iBinding->buffer)
+          throwError(L"Unable to allocate a column buffer");
+        mProfile.allocations++;
+        continue;
+      }
+      iBinding->buffer = &mArena[arenaUsed];
+      arenaUsed += alignArena(iBinding->width * mRowsetSize);
+      
+      // bind buffer to column
+      TRYODBC(mHStmt,
+              SQL_HANDLE_STMT,
+              SQLBindCol(mHStmt,
+                         col,
+                         iBinding->cType,
+                         (SQLPOINTER) iBinding->buffer,
+                         iBinding->width,
+                         iBinding->ind));
+    }
+  }
+
+  //----------------------------------------------------------------------
+  // writes the first column of the first row to the target chunk by chunk.
+  // returns the length of the value, or void for NULL or no row.
+  tTJSVariant readLob(RETCODE retCode, tTJSVariant target) {
+    if (checkResult(retCode) <= 0)
+      return tTJSVariant();
+
+    SQLLEN type = getColumnAttribute(1, SQL_DESC_CONCISE_TYPE);
+    bool binary = type == SQL_BINARY || type == SQL_VARBINARY || type == SQL_LONGVARBINARY;
+
+    // SQLGetData reads a single row.
+    SQLSetStmtAttr(mHStmt, SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER)1, 0);
+    TRYODBC(mHStmt, SQL_HANDLE_STMT, retCode = fetch());
+    if (retCode == SQL_NO_DATA) {
+      SQLFreeStmt(mHStmt, SQL_CLOSE);
+      return tTJSVariant();
+    }
+
+    LobWriter writer(target, binary);
+    SQLLEN terminator = binary ? 0 : sizeof(WCHAR);
+    SQLLEN chunk = std::max(mOptions.lobChunkSize, SQLLEN(64)) & ~SQLLEN(1);
+    std::vector<char> buffer(chunk + terminator);
+    tjs_int64 length = 0;
+    
+    for (;;) {
+      SQLLEN ind;
+      retCode = SQLGetData(mHStmt,
+                           1,
+                           binary ? SQL_C_BINARY : SQL_C_WCHAR,
+                           &buffer[0],
+                           SQLLEN(buffer.size()),
+                           &ind);
+      if (retCode == SQL_NO_DATA)
+        break;
+      if (retCode == SQL_ERROR) {
+        dumpDiagnosticRecord(mHStmt, SQL_HANDLE_STMT, retCode);
+        SQLFreeStmt(mHStmt, SQL_CLOSE);
+        TVPThrowExceptionMessage(L"Error in SQLGetData");
+      }
+      if (ind == SQL_NULL_DATA) {
+        SQLFreeStmt(mHStmt, SQL_CLOSE);
+        return tTJSVariant();
+      }
+      SQLLEN size = (ind == SQL_NO_TOTAL || ind > chunk) ? chunk : ind;
+      writer.write(&buffer[0], size);
+      length += binary ? size : size / SQLLEN(sizeof(WCHAR));
+      // the value continues while the buffer is filled (01004).
+      if (ind != SQL_NO_TOTAL && ind <= chunk)
+        break;
+    }
+    writer.close();
+
+    SQLFreeStmt(mHStmt, SQL_CLOSE);
+    return tTJSVariant(length);
+  }
+
+  //----------------------------------------------------------------------
+  static size_t alignArena(size_t size) {
+    return (size + kArenaAlignment - 1) & ~(kArenaAlignment - 1);
+  }
+
+  //----------------------------------------------------------------------
+  // remembers the sql of the next result, to find its column descriptions.
+  // NULL for sql of which results can't share them.
+  void setResultSql(const WCHAR *sqlString) {
+    size_t length = sqlString ? wcslen(sqlString) + 1 : 0;
+    if (mResultSql.size() == length
+        && std::equal(mResultSql.begin(), mResultSql.end(), sqlString))
+      return;
+    mResultSql.assign(sqlString, sqlString + length);
+    mResultColumns = 0;
+  }
+
+  //----------------------------------------------------------------------
+  // describes the first cCols columns of the result into mColumns. they
+  // come from the last result or the cache when the sql is the same.
+  void describeColumns(SQLSMALLINT cCols, SQLSMALLINT numResults) {
+    bool cacheable = ! mResultSql.empty() && mColumnCache;
+    if (cacheable
+        && mResultColumns == numResults
+        && mColumns.size() >= size_t(cCols)
+        && mColumnsGeneration == mColumnCache->getGeneration())
+      return;
+
+    mTitlesValid = false;
+    if (cacheable) {
+      mColumnsGeneration = mColumnCache->getGeneration();
+      if (mColumnCache->lookup(mResultSql, numResults, cCols, mColumns)) {
+        mResultColumns = numResults;
+        return;
+      }
+    }
+    
+    mResultColumns = 0;
+    mColumns.resize(cCols);
+    for (SQLSMALLINT col = 1; col <= cCols; col++) {
+      ColumnInfo &column = mColumns[col - 1];
+      column.type = getColumnAttribute(col, SQL_DESC_CONCISE_TYPE);
+      column.length = getColumnAttribute(col, SQL_DESC_LENGTH);
+      column.isUnsigned = column.type == SQL_BIGINT && getColumnAttribute(col, SQL_DESC_UNSIGNED);
+      column.scale = column.precision = 0;
+      if (column.type == SQL_DECIMAL || column.type == SQL_NUMERIC) {
+        column.scale = getColumnAttribute(col, SQL_DESC_SCALE);
+        column.precision = getColumnAttribute(col, SQL_DESC_PRECISION);
+      }
+      getColumnName(col, column.name);
+    }
+
+    if (cacheable) {
+      mResultColumns = numResults;
+      mColumnCache->store(mResultSql, numResults, mColumns);
+    }
+  }
+
+  //----------------------------------------------------------------------
+  void getColumnName(SQLSMALLINT col, std::vector<WCHAR> &name) {
+    // most names fit the first buffer. a longer one is read again.
+    name.resize(64);
+    for (;;) {
+      SQLSMALLINT nameLength = 0;
+      TRYODBC(mHStmt,
+              SQL_HANDLE_STMT,
+              SQLColAttribute(mHStmt,
+                              col,
+                              SQL_DESC_NAME,
+                              &name[0],
+                              SQLSMALLINT(name.size() * sizeof(WCHAR)),
+                              &nameLength,
+                              NULL));
+      size_t length = nameLength / sizeof(WCHAR);
+      if (length < name.size()) {
+        name.resize(length + 1);
+        name[length] = 0;
+        return;
+      }
+      name.resize(length + 1);
+    }
+  }
+
+  //----------------------------------------------------------------------
+  bool isLargeColumn(const ColumnInfo &column) {
+    switch (column.type) {
+    case SQL_LONGVARCHAR:
+    case SQL_WLONGVARCHAR:
+    case SQL_LONGVARBINARY:
+      return true;
+    case SQL_CHAR:
+    case SQL_VARCHAR:
+    case SQL_WCHAR:
+    case SQL_WVARCHAR:
+    case SQL_BINARY:
+    case SQL_VARBINARY: {
+      // (max) columns report 0 or a huge length.
+      return column.length <= 0 || column.length > kLargeColumnLength;
+    }
+    }
+    return false;
+  }
+
+  //----------------------------------------------------------------------
+  // reads the value of a deferred column of the current row into its
+  // buffer, growing the buffer by lobChunkSize.
+  void readDeferredColumn(Binding &binding, SQLUSMALLINT col) {
+    if (binding.cType != SQL_C_BINARY && binding.cType != SQL_C_TCHAR) {
+      TRYODBC(mHStmt,
+              SQL_HANDLE_STMT,
+              SQLGetData(mHStmt, col, binding.cType, binding.buffer, binding.width, binding.ind));
+      return;
+    }
+
+    // text is terminated by a null character on every call.
+    SQLLEN terminator = binding.cType == SQL_C_BINARY ? 0 : sizeof(WCHAR);
+    SQLLEN chunk = std::max(mOptions.lobChunkSize, SQLLEN(64)) & ~SQLLEN(1);
+    SQLLEN length = 0;
+    
+    for (;;) {
+      if (binding.width < length + chunk + terminator)
+        growBuffer(binding, length + chunk + terminator);
+
+      SQLLEN ind;
+      RETCODE rc = SQLGetData(mHStmt,
+                              col,
+                              binding.cType,
+                              binding.buffer + length,
+                              binding.width - length,
+                              &ind);
+      if (rc == SQL_NO_DATA)
+        break;
+      if (rc == SQL_ERROR) {
+        dumpDiagnosticRecord(mHStmt, SQL_HANDLE_STMT, rc);
+        throwError(L"Error in SQLGetData");
+      }
+      if (ind == SQL_NULL_DATA) {
+        binding.ind[0] = SQL_NULL_DATA;
+        return;
+      }
+      // the buffer was filled when the value is longer (01004).
+      SQLLEN filled = binding.width - length - terminator;
+      if (rc == SQL_SUCCESS_WITH_INFO && (ind == SQL_NO_TOTAL || ind > filled)) {
+        length += filled;
+        continue;
+      }
+      length += ind;
+      break;
+    }
+    if (terminator)
+      memset(binding.buffer + length, 0, terminator);
+    binding.ind[0] = length;
+  }
+
+  //----------------------------------------------------------------------
+  // deferred columns have a buffer for one row, which grows as needed.
+  void growBuffer(Binding &binding, SQLLEN width) {
+    char *buffer = (char *)realloc(binding.buffer, width);
+    if (! buffer)
+      throwError(L"Unable to allocate a column buffer");
+    binding.buffer = buffer;
+    binding.width = width;
+    mProfile.allocations++;
+  }
+
+  //----------------------------------------------------------------------
+  SQLLEN getColumnAttribute(SQLSMALLINT col, SQLUSMALLINT field) {
+    SQLLEN value = 0;
+    TRYODBC(mHStmt,
+            SQL_HANDLE_STMT,
+            SQLColAttribute(mHStmt,
+                            col,
+                            field,
+                            NULL,
+                            0,
+                            NULL,
+                            &value));
+    return value;
+  }
+
+  //----------------------------------------------------------------------
+  void freeBindings() {
+    stopPrefetch();
+    if (mHStmt)
+      SQLFreeStmt(mHStmt, SQL_UNBIND);
+
+    // bound columns use the arena.
+    for (bindings::iterator iBinding = mBindings.begin();
+         iBinding != mBindings.end();
+         iBinding++)
+      if (iBinding->deferred)
+        free(iBinding->buffer);
+
+    mBindings.clear();
+    mReadAhead = ReadAhead();
+    mHasReadAhead = false;
+  }
+
+  //----------------------------------------------------------------------
+  // titles of the bound columns. they are made again only when the column
+  // descriptions changed, keeping the hints for the dictionary rows.
+  void updateTitles() {
+    if (mTitlesValid && mTitles.size() == mBindings.size())
+      return;
+    
+    mTitles.clear();
+    for (size_t col = 0; col < mBindings.size(); col++)
+      mTitles.push_back(ttstr(&mColumns[col].name[0]));
+    mTitleHints.assign(mTitles.size(), 0);
+    mTitlesValid = true;
+  }
+
+  //----------------------------------------------------------------------
+  void readAhead() {
+    mReadAhead.buffers.assign(mBindings.size(), std::vector<char>());
+    mReadAhead.inds.assign(mBindings.size(), std::vector<SQLLEN>());
+    mReadAhead.offsets.assign(mBindings.size(), std::vector<size_t>());
+    mReadAhead.status.clear();
+    mReadAhead.rows = mReadAhead.next = 0;
+
+    SQLULEN rowCount;
+    while ((rowCount = fetchRowset()) > 0) {
+      size_t col = 0;
+      for (bindings::iterator iBinding = mBindings.begin();
+           iBinding != mBindings.end();
+           iBinding++, col++) {
+        // a deferred column keeps only the bytes used by the row.
+        SQLLEN size = iBinding->width * rowCount;
+        if (iBinding->deferred) {
+          mReadAhead.offsets[col].push_back(mReadAhead.buffers[col].size());
+          if (iBinding->cType == SQL_C_BINARY || iBinding->cType == SQL_C_TCHAR)
+            size = std::min(size, std::max(iBinding->ind[0], SQLLEN(0)) + SQLLEN(sizeof(WCHAR)));
+        }
+        mReadAhead.buffers[col].insert(mReadAhead.buffers[col].end(),
+                                       iBinding->buffer,
+                                       iBinding->buffer + size);
+        mReadAhead.inds[col].insert(mReadAhead.inds[col].end(),
+                                    iBinding->ind,
+                                    iBinding->ind + rowCount);
+      }
+      mReadAhead.status.insert(mReadAhead.status.end(),
+                               mRowStatus.begin(),
+                               mRowStatus.begin() + rowCount);
+      mReadAhead.rows += rowCount;
+    }
+    mHasReadAhead = true;
+  }
+
+  //----------------------------------------------------------------------
+  // copies the next rowset of the rows read ahead into the column buffers.
+  SQLULEN fetchReadAhead() {
+    SQLULEN rowCount = std::min(mRowsetSize, mReadAhead.rows - mReadAhead.next);
+    size_t col = 0;
+    for (bindings::iterator iBinding = mBindings.begin();
+         iBinding != mBindings.end() && rowCount > 0;
+         iBinding++, col++) {
+      std::vector<char> &buffer = mReadAhead.buffers[col];
+      if (iBinding->deferred) {
+        std::vector<size_t> &offsets = mReadAhead.offsets[col];
+        size_t begin = offsets[mReadAhead.next];
+        size_t end = mReadAhead.next + 1 < offsets.size() ? offsets[mReadAhead.next + 1] : buffer.size();
+        if (iBinding->width < SQLLEN(end - begin))
+          growBuffer(*iBinding, SQLLEN(end - begin));
+        if (end > begin)
+          memcpy(iBinding->buffer, &buffer[begin], end - begin);
+      } else
+        memcpy(iBinding->buffer,
+               &buffer[mReadAhead.next * iBinding->width],
+               iBinding->width * rowCount);
+      memcpy(iBinding->ind,
+             &mReadAhead.inds[col][mReadAhead.next],
+             sizeof(SQLLEN) * rowCount);
+    }
+    if (rowCount > 0)
+      std::copy(mReadAhead.status.begin() + mReadAhead.next,
+                mReadAhead.status.begin() + mReadAhead.next + rowCount,
+                mRowStatus.begin());
+    mReadAhead.next += rowCount;
+    return rowCount;
+  }
+
+  //----------------------------------------------------------------------
+  SQLULEN fetchRowset() {
+    if (mHasReadAhead)
+      return fetchReadAhead();
+    if (limitReached()) {
+      stopPrefetch();
+      return 0;
+    }
+    if (mPrefetch)
+      return fetchPrefetched();
+
+    RETCODE         RetCode = SQL_SUCCESS;
+    tjs_int64       start = getMicroseconds();
+
+    mRowsFetched = 0;
+    TRYODBC(mHStmt, SQL_HANDLE_STMT, RetCode = fetch());
+    
+    if (RetCode == SQL_NO_DATA_FOUND) {
+      mProfile.fetchTime += getMicroseconds() - start;
+      return 0;
+    }
+
+    // deferred columns make the rowset a single row.
+    SQLUSMALLINT col = 1;
+    for (bindings::iterator iBinding = mBindings.begin();
+         iBinding != mBindings.end();
+         iBinding++, col++)
+      if (iBinding->deferred && mRowStatus[0] != SQL_ROW_ERROR)
+        readDeferredColumn(*iBinding, col);
+
+    mProfile.fetchTime += getMicroseconds() - start;
+    return countRowset(mRowsFetched);
+  }
+
+  //----------------------------------------------------------------------
+  // true when the fetch of the execution is to end. a cancelled statement
+  // and one over maxBytes throw instead.
+  bool limitReached() {
+    if (mCancelled)
+      throwError(L"Query cancelled.");
+    checkMaxBytes();
+    return mOptions.maxRows > 0 && mFetchedRows >= mOptions.maxRows;
+  }
+
+  //----------------------------------------------------------------------
+  // the rows over maxBytes are not returned as a whole result.
+  void checkMaxBytes() {
+    if (mOptions.maxBytes > 0 && mFetchedBytes >= mOptions.maxBytes) {
+      WCHAR buf[128];
+      swprintf_s(buf, 127, L"Fetch stopped at %llu rows by maxBytes.", (unsigned long long)mFetchedRows);
+      throwError(buf);
+    }
+  }
+
+  //----------------------------------------------------------------------
+  // counts a fetched rowset toward the profile and the limits. the rows
+  // over maxRows are dropped, as drivers may ignore SQL_ATTR_MAX_ROWS.
+  SQLULEN countRowset(SQLULEN rowCount) {
+    if (mOptions.maxRows > 0)
+      rowCount = std::min(rowCount, mOptions.maxRows - mFetchedRows);
+    logRowErrors(rowCount);
+    tjs_int64 bytes = countFetchedBytes(rowCount);
+    mFetchedRows += rowCount;
+    mFetchedBytes += bytes;
+    mProfile.rows += rowCount;
+    mProfile.bytes += bytes;
+    checkMaxBytes();
+    return rowCount;
+  }
+
+  //----------------------------------------------------------------------
+  // the rows the driver failed to fetch are left out of the results. the
+  // diagnostics of SQLFetch are logged by TRYODBC, and the rows here.
+  void logRowErrors(SQLULEN rowCount) {
+    for (SQLULEN row = 0; row < rowCount; row++)
+      if (mRowStatus[row] == SQL_ROW_ERROR) {
+        WCHAR buf[128];
+        swprintf_s(buf, 127, L"Row %llu of the result is skipped by a fetch error.",
+                   (unsigned long long)(mFetchedRows + row + 1));
+        addLog(buf);
+      }
+  }
+
+  //----------------------------------------------------------------------
+  // bytes of the values in the rowset. numbers and dates count their
+  // width, text and binary their length.
+  tjs_int64 countFetchedBytes(SQLULEN rowCount) {
+    tjs_int64 bytes = 0;
+    for (bindings::iterator iBinding = mBindings.begin();
+         iBinding != mBindings.end();
+         iBinding++) {
+      if (iBinding->cType != SQL_C_TCHAR && iBinding->cType != SQL_C_BINARY) {
+        bytes += iBinding->width * rowCount;
+        continue;
+      }
+      for (SQLULEN row = 0; row < rowCount; row++)
+        bytes += std::max(iBinding->ind[row], SQLLEN(0));
+    }
+    return bytes;
+  }
+
+  //----------------------------------------------------------------------
+  tTJSVariant fetchColumns(SQLULEN row) {
+    tTJSVariant result = createArray();
+    ncbPropAccessor resultObj(result);
+
+    for (bindings::iterator iBinding = mBindings.begin();
+         iBinding != mBindings.end();
+         iBinding++) {
+      resultObj.FuncCall(0, L"add", &addHint, NULL, getColumnValue(*iBinding, row));
+    }
+    
+    return result;
+  }
+
+  //----------------------------------------------------------------------
+  tTJSVariant fetchDictionary(SQLULEN row) {
+    tTJSVariant result = createDictionary();
+    ncbPropAccessor resultObj(result);
+
+    // the hints of the column names are computed by the first row and
+    // reused by the following rows of the query.
+    size_t col = 0;
+    for (bindings::iterator iBinding = mBindings.begin();
+         iBinding != mBindings.end();
+         iBinding++, col++) {
+      resultObj.SetValue(mTitles[col].c_str(), getColumnValue(*iBinding, row), 0, &mTitleHints[col]);
+    }
+    
+    return result;
+  }
+
+  //----------------------------------------------------------------------
+  tTJSVariant fetchRowValue(SQLULEN row, QueryResultType queryResultType) {
+    switch (queryResultType) {
+    case qrtDictionary: return fetchDictionary(row);
+    case qrtSingleColumnArray: return getColumnValue(mBindings.front(), row);
+    default: return fetchColumns(row);
+    }
+  }
+
+  //----------------------------------------------------------------------
+  tTJSVariant getColumnValue(const Binding &binding, SQLULEN row) {
+    return getColumnValue(binding, row, mOptions.dateMode);
+  }
+
+  //----------------------------------------------------------------------
+  static tTJSVariant getColumnValue(const Binding &binding, SQLULEN row, DateMode dateMode) {
+    if (binding.ind[row] == SQL_NULL_DATA)
+      return tTJSVariant();
+
+    const char *data = binding.buffer + row * binding.width;
+    switch (binding.cType) {
+    case SQL_C_SBIGINT:
+      return tTJSVariant(tjs_int64(*(const SQLBIGINT *)data));
+    case SQL_C_DOUBLE:
+      return tTJSVariant(tjs_real(*(const SQLDOUBLE *)data));
+    case SQL_C_TYPE_TIMESTAMP: {
+      tjs_int64 time = timestampToTime(*(const SQL_TIMESTAMP_STRUCT *)data);
+      if (dateMode == dtmTime)
+        return tTJSVariant(time);
+      return createDate(time);
+    }
+    case SQL_C_BINARY: {
+      // a bound value longer than the column is truncated.
+      SQLLEN length = binding.ind[row];
+      if (length == SQL_NO_TOTAL || length > binding.width)
+        length = binding.width;
+      return createOctet(data, tjs_uint(length));
+    }
+    }
+
+    tTJSVariant columnValue = ttstr((const WCHAR *)data);
+    if (binding.type == SQL_BIGINT)
+      columnValue.ToInteger();
+    return columnValue;
+  }
+
+  //----------------------------------------------------------------------
+  // writes a value as getColumnValue reads it.
+  void exportColumnValue(ExportWriter &writer, const Binding &binding, SQLULEN row) {
+    if (binding.ind[row] == SQL_NULL_DATA) {
+      writer.writeNull();
+      return;
+    }
+
+    const char *data = binding.buffer + row * binding.width;
+    switch (binding.cType) {
+    case SQL_C_SBIGINT:
+      writer.writeInteger(tjs_int64(*(const SQLBIGINT *)data));
+      return;
+    case SQL_C_DOUBLE:
+      writer.writeReal(*(const SQLDOUBLE *)data);
+      return;
+    case SQL_C_TYPE_TIMESTAMP:
+      if (mOptions.dateMode == dtmTime)
+        writer.writeInteger(timestampToTime(*(const SQL_TIMESTAMP_STRUCT *)data));
+      else
+        writer.writeTimestamp(*(const SQL_TIMESTAMP_STRUCT *)data, binding.type);
+      return;
+    case SQL_C_BINARY: {
+      // a bound value longer than the column is truncated.
+      SQLLEN length = binding.ind[row];
+      if (length == SQL_NO_TOTAL || length > binding.width)
+        length = binding.width;
+      writer.writeBinary(data, size_t(length));
+      return;
+    }
+    }
+
+    // the text ends at the terminator within the buffer.
+    const WCHAR *text = (const WCHAR *)data;
+    size_t length = 0;
+    size_t capacity = size_t(binding.width / sizeof(WCHAR));
+    while (length < capacity && text[length])
+      length++;
+    writer.writeText(text, length,
+                     binding.type == SQL_BIGINT || binding.type == SQL_DECIMAL || binding.type == SQL_NUMERIC);
+  }
+};
+
+//----------------------------------------------------------------------
+// SQL table names
+//----------------------------------------------------------------------
+// a word, a name or a punctuation of a sql. comments and literals are
+// left out.
+struct SqlToken {
+  ttstr               text;     /* lower case unless quoted */
+  bool                quoted;   /* quoted name, never a keyword */
+};
+typedef std::vector<SqlToken> sqlTokens;
+
+//----------------------------------------------------------------------
+static bool isSqlWordChar(tjs_char c)
+{
+  return (c >= L'a' && c <= L'z')
+    || (c >= L'A' && c <= L'Z')
+    || (c >= L'0' && c <= L'9')
+    || c == L'_' || c == L'$' || c == L'#' || c >= 0x80;
+}
+
+//----------------------------------------------------------------------
+// table names are compared in ASCII case folding only.
+static ttstr foldTableName(const tjs_char *s, size_t length)
+{
+  ttstr name;
+  for (size_t i = 0; i < length; i++)
+    name += tjs_char(s[i] >= L'A' && s[i] <= L'Z' ? s[i] - L'A' + L'a' : s[i]);
+  return name;
+}
+
+//----------------------------------------------------------------------
+static void tokenizeSql(const tjs_char *s, sqlTokens &tokens)
+{
+  while (*s) {
+    tjs_char c = *s;
+    if (c == L'-' && s[1] == L'-') {
+      while (*s && *s != L'\n')
+        s++;
+    } else if (c == L'/' && s[1] == L'*') {
+      s += 2;
+      while (*s && ! (s[0] == L'*' && s[1] == L'/'))
+        s++;
+      if (*s)
+        s += 2;
+    } else if (c == L'\'') {
+      // a literal, '' is a quote in it.
+      for (s++; *s; s++)
+        if (*s == L'\'' && *++s != L'\'')
+          break;
+      SqlToken token = { L"'", false };
+      tokens.push_back(token);
+    } else if (c == L'"' || c == L'[' || c == L'`') {
+      tjs_char close = c == L'[' ? L']' : c;
+      SqlToken token = { L"", true };
+      for (s++; *s && *s != close; s++)
+        token.text += *s;
+      if (*s)
+        s++;
+      tokens.push_back(token);
+    } else if (isSqlWordChar(c)) {
+      const tjs_char *begin = s;
+      while (isSqlWordChar(*s))
+        s++;
+      SqlToken token = { foldTableName(begin, s - begin), false };
+      tokens.push_back(token);
+    } else {
+      if (c > L' ') {
+        SqlToken token = { ttstr(s, 1), false };
+        tokens.push_back(token);
+      }
+      s++;
+    }
+  }
+}
+
+//----------------------------------------------------------------------
+static bool isSqlKeyword(const sqlTokens &tokens, size_t i, const tjs_char *keyword)
+{
+  return i < tokens.size() && ! tokens[i].quoted && tokens[i].text == keyword;
+}
+
+//----------------------------------------------------------------------
+// words that may follow a table name in FROM, other than an alias.
+static bool isSqlClauseKeyword(const sqlTokens &tokens, size_t i)
+{
+  static const tjs_char *keywords[] = {
+    L"where", L"join", L"inner", L"left", L"right", L"full", L"cross",
+    L"natural", L"outer", L"on", L"using", L"group", L"order", L"having",
+    L"union", L"except", L"intersect", L"limit", L"offset", L"fetch",
+    L"for", L"with", L"window", NULL
+  };
+  for (const tjs_char **keyword = keywords; *keyword; keyword++)
+    if (isSqlKeyword(tokens, i, *keyword))
+      return true;
+  return false;
+}
+
+//----------------------------------------------------------------------
+// reads a table name at i, skipping its schema. returns an empty string
+// when there is no name.
+static ttstr readSqlTableName(const sqlTokens &tokens, size_t &i)
+{
+  if (i >= tokens.size()
+      || (! tokens[i].quoted && ! isSqlWordChar(tokens[i].text.c_str()[0])))
+    return L"";
+  ttstr name = tokens[i++].text;
+  while (isSqlKeyword(tokens, i, L".") && i + 1 < tokens.size()) {
+    name = tokens[i + 1].text;
+    i += 2;
+  }
+  return name;
+}
+
+//----------------------------------------------------------------------
+// tables read by the sql, after FROM and JOIN.
+static void findReadTables(const ttstr &sql, std::vector<ttstr> &tables)
+{
+  sqlTokens tokens;
+  tokenizeSql(sql.c_str(), tokens);
+  for (size_t i = 0; i < tokens.size(); i++) {
+    bool from = isSqlKeyword(tokens, i, L"from");
+    if (! from && ! isSqlKeyword(tokens, i, L"join"))
+      continue;
+    i++;
+    for (;;) {
+      ttstr name = readSqlTableName(tokens, i);
+      if (name.IsEmpty())
+        break;
+      tables.push_back(name);
+      // FROM a [AS] x, b [AS] y
+      if (isSqlKeyword(tokens, i, L"as"))
+        i++;
+      if (i < tokens.size()
+          && (tokens[i].quoted || isSqlWordChar(tokens[i].text.c_str()[0]))
+          && ! isSqlClauseKeyword(tokens, i))
+        i++;
+      if (! from || ! isSqlKeyword(tokens, i, L","))
+        break;
+      i++;
+    }
+    i--;
+  }
+}
+
+//----------------------------------------------------------------------
+// tables changed by the statements of the sql.
+static void findWrittenTables(const ttstr &sql, std::vector<ttstr> &tables)
+{
+  sqlTokens tokens;
+  tokenizeSql(sql.c_str(), tokens);
+  bool start = true;
+  for (size_t i = 0; i < tokens.size(); i++) {
+    if (isSqlKeyword(tokens, i, L";")) {
+      start = true;
+      continue;
+    }
+    if (! start)
+      continue;
+    start = false;
+
+    size_t name = i + 1;
+    if (isSqlKeyword(tokens, i, L"insert")
+        || isSqlKeyword(tokens, i, L"merge")
+        || isSqlKeyword(tokens, i, L"replace")) {
+      if (isSqlKeyword(tokens, name, L"into"))
+        name++;
+    } else if (isSqlKeyword(tokens, i, L"delete")) {
+      if (isSqlKeyword(tokens, name, L"from"))
+        name++;
+    } else if (isSqlKeyword(tokens, i, L"truncate")) {
+      if (isSqlKeyword(tokens, name, L"table"))
+        name++;
+    } else if (isSqlKeyword(tokens, i, L"drop")
+               || isSqlKeyword(tokens, i, L"alter")) {
+      if (! isSqlKeyword(tokens, name, L"table"))
+        continue;
+      name++;
+      if (isSqlKeyword(tokens, name, L"if") && isSqlKeyword(tokens, name + 1, L"exists"))
+        name += 2;
+    } else if (! isSqlKeyword(tokens, i, L"update"))
+      continue;
+
+    ttstr table = readSqlTableName(tokens, name);
+    if (! table.IsEmpty())
+      tables.push_back(table);
+  }
+}
+
+//----------------------------------------------------------------------
+// ResultCache class
+//----------------------------------------------------------------------
+// results of queries kept natively, and built again for each hit.
+// used on the main thread only.
+class ResultCache
+{
+  //----------------------------------------------------------------------
+  struct Entry {
+    ttstr               sql;
+    QueryResultType     queryResultType;
+    DecimalMode         decimalMode;    /* changes the bound types */
+    std::vector<ttstr>  tags;           /* tables read by the sql */
+    DWORD               storedAt;       /* tick count when stored */
+    Statement::Snapshot snapshot;
+  };
+  typedef std::list<Entry> entries;
+
+  //----------------------------------------------------------------------
+  // the most recently used one first.
+  entries mEntries;
+  tjs_int mTtl;       /* milliseconds, 0 to keep until invalidated */
+  tjs_int mBudget;    /* bytes */
+  size_t  mBytes;
+  tjs_int mHits;
+  tjs_int mMisses;
+
+public:
+  //----------------------------------------------------------------------
+  ResultCache()
+    : mTtl(60000)
+    , mBudget(4 * 1024 * 1024)
+    , mBytes(0)
+    , mHits(0)
+    , mMisses(0)
+  {}
+
+  //----------------------------------------------------------------------
+  tjs_int getTtl() {
+    return mTtl;
+  }
+
+  void setTtl(tjs_int ttl) {
+    mTtl = std::max(ttl, 0);
+  }
+
+  tjs_int getBudget() {
+    return mBudget;
+  }
+
+  void setBudget(tjs_int budget) {
+    mBudget = std::max(budget, 0);
+    trim();
+  }
+
+  tjs_int getHits() {
+    return mHits;
+  }
+
+  tjs_int getMisses() {
+    return mMisses;
+  }
+
+  tjs_int getBytes() {
+    return tjs_int(mBytes);
+  }
+
+  bool empty() {
+    return mEntries.empty();
+  }
+
+  //----------------------------------------------------------------------
+  void clear() {
+    mEntries.clear();
+    mBytes = 0;
+  }
+
+  //----------------------------------------------------------------------
+  // the snapshot stays valid until the cache is changed.
+  const Statement::Snapshot *lookup(const ttstr &sql, QueryResultType queryResultType, DecimalMode decimalMode) {
+    DWORD now = GetTickCount();
+    for (entries::iterator iEntry = mEntries.begin();
+         iEntry != mEntries.end();
+         iEntry++) {
+      if (iEntry->sql == sql
+          && iEntry->queryResultType == queryResultType
+          && iEntry->decimalMode == decimalMode) {
+        if (mTtl > 0 && now - iEntry->storedAt > DWORD(mTtl)) {
+          erase(iEntry);
+          break;
+        }
+        mEntries.splice(mEntries.begin(), mEntries, iEntry);
+        mHits++;
+        return &mEntries.front().snapshot;
+      }
+    }
+    mMisses++;
+    return NULL;
+  }
+
+  //----------------------------------------------------------------------
+  // results larger than the budget are not kept.
+  void store(const ttstr &sql, QueryResultType queryResultType, DecimalMode decimalMode,
+             const std::vector<ttstr> &tags, const Statement::Snapshot &snapshot) {
+    if (snapshot.size > size_t(mBudget))
+      return;
+    mEntries.push_front(Entry());
+    Entry &entry = mEntries.front();
+    entry.sql = sql;
+    entry.queryResultType = queryResultType;
+    entry.decimalMode = decimalMode;
+    entry.tags = tags;
+    entry.storedAt = GetTickCount();
+    entry.snapshot = snapshot;
+    mBytes += snapshot.size;
+    trim();
+  }
+
+  //----------------------------------------------------------------------
+  // drops the results tagged with one of the tables.
+  void invalidate(const std::vector<ttstr> &tables) {
+    entries::iterator iEntry = mEntries.begin();
+    while (iEntry != mEntries.end()) {
+      entries::iterator iNext = iEntry;
+      iNext++;
+      for (std::vector<ttstr>::const_iterator iTable = tables.begin();
+           iTable != tables.end();
+           iTable++)
+        if (std::find(iEntry->tags.begin(), iEntry->tags.end(), *iTable) != iEntry->tags.end()) {
+          erase(iEntry);
+          break;
+        }
+      iEntry = iNext;
+    }
+  }
+
+private:
+  //----------------------------------------------------------------------
+  void erase(entries::iterator iEntry) {
+    mBytes -= iEntry->snapshot.size;
+    mEntries.erase(iEntry);
+  }
+
+  //----------------------------------------------------------------------
+  void trim() {
+    while (! mEntries.empty() && mBytes > size_t(mBudget)) {
+      entries::iterator iLast = mEntries.end();
+      erase(--iLast);
+    }
+  }
+};
+
+//----------------------------------------------------------------------
+// QueryProfiler class
+//----------------------------------------------------------------------
+// costs of the executions of a connection, and its slowest statements.
+// used on the main thread only.
+class QueryProfiler
+{
+  //----------------------------------------------------------------------
+  struct SlowQuery {
+    ttstr               sql;
+    tjs_int64           time;     /* total of the profile */
+    QueryProfile        profile;
+  };
+  typedef std::vector<SlowQuery> slowQueries;
+
+  //----------------------------------------------------------------------
+  QueryProfile mTotal;
+  tjs_int64 mQueries;
+
+  // the slowest first, up to mSlowQueryCount.
+  slowQueries mSlowQueries;
+  tjs_int mSlowQueryCount;
+
+  // statements slower than this are logged. milliseconds, 0 for none.
+  tjs_int mSlowQueryThreshold;
+
+public:
+  //----------------------------------------------------------------------
+  QueryProfiler()
+    : mTotal()
+    , mQueries(0)
+    , mSlowQueryCount(10)
+    , mSlowQueryThreshold(0)
+  {}
+
+  //----------------------------------------------------------------------
+  tjs_int getSlowQueryCount() {
+    return mSlowQueryCount;
+  }
+
+  void setSlowQueryCount(tjs_int count) {
+    mSlowQueryCount = std::max(count, 0);
+    if (mSlowQueries.size() > size_t(mSlowQueryCount))
+      mSlowQueries.resize(mSlowQueryCount);
+  }
+
+  tjs_int getSlowQueryThreshold() {
+    return mSlowQueryThreshold;
+  }
+
+  void setSlowQueryThreshold(tjs_int threshold) {
+    mSlowQueryThreshold = std::max(threshold, 0);
+  }
+
+  //----------------------------------------------------------------------
+  void reset() {
+    mTotal = QueryProfile();
+    mQueries = 0;
+    mSlowQueries.clear();
+  }
+
+  //----------------------------------------------------------------------
+  void record(const ttstr &sql, const QueryProfile &profile) {
+    mQueries++;
+    mTotal.executeTime += profile.executeTime;
+    mTotal.fetchTime += profile.fetchTime;
+    mTotal.convertTime += profile.convertTime;
+    mTotal.rows += profile.rows;
+    mTotal.bytes += profile.bytes;
+    mTotal.allocations += profile.allocations;
+
+    tjs_int64 time = profile.executeTime + profile.fetchTime + profile.convertTime;
+    if (mSlowQueryThreshold > 0 && time >= tjs_int64(mSlowQueryThreshold) * 1000) {
+      WCHAR buf[64];
+      swprintf_s(buf, 64, L"slow query (%.3f ms): ", time / 1000.0);
+      TVPAddLog(ttstr(buf) + sql);
+    }
+
+    // insert in the order of the time, dropping the fastest one.
+    slowQueries::iterator iSlow = mSlowQueries.begin();
+    while (iSlow != mSlowQueries.end() && iSlow->time >= time)
+      iSlow++;
+    if (iSlow - mSlowQueries.begin() >= mSlowQueryCount)
+      return;
+    SlowQuery slow;
+    slow.sql = sql;
+    slow.time = time;
+    slow.profile = profile;
+    mSlowQueries.insert(iSlow, slow);
+    if (mSlowQueries.size() > size_t(mSlowQueryCount))
+      mSlowQueries.pop_back();
+  }
+
+  //----------------------------------------------------------------------
+  tTJSVariant getStatistics() {
+    tTJSVariant result = createDictionary();
+    ncbPropAccessor resultObj(result);
+    resultObj.SetValue(L"queries", mQueries);
+    setProfile(resultObj, mTotal);
+    return result;
+  }
+
+  //----------------------------------------------------------------------
+  tTJSVariant getSlowQueries() {
+    tTJSVariant result = createArray();
+    ncbPropAccessor resultObj(result);
+    for (slowQueries::iterator iSlow = mSlowQueries.begin();
+         iSlow != mSlowQueries.end();
+         iSlow++) {
+      tTJSVariant slow = createDictionary();
+      ncbPropAccessor slowObj(slow);
+      slowObj.SetValue(L"sql", iSlow->sql);
+      slowObj.SetValue(L"time", tjs_real(iSlow->time / 1000.0));
+      setProfile(slowObj, iSlow->profile);
+      resultObj.FuncCall(0, L"add", &addHint, NULL, slow);
+    }
+    return result;
+  }
+
+private:
+  //----------------------------------------------------------------------
+  // times in milliseconds.
+  static void setProfile(ncbPropAccessor &obj, const QueryProfile &profile) {
+    obj.SetValue(L"executeTime", tjs_real(profile.executeTime / 1000.0));
+    obj.SetValue(L"fetchTime", tjs_real(profile.fetchTime / 1000.0));
+    obj.SetValue(L"convertTime", tjs_real(profile.convertTime / 1000.0));
+    obj.SetValue(L"rows", profile.rows);
+    obj.SetValue(L"bytes", profile.bytes);
+    obj.SetValue(L"allocations", profile.allocations);
+  }
+};
+
+class ODBC;
+
+//----------------------------------------------------------------------
+// StatementHolder class
+//----------------------------------------------------------------------
+// base of the script objects that hold a statement of a connection.
+class StatementHolder
+{
+protected:
+  ODBC        *mOwner;
+  Statement   *mStatement;
+
+public:
+  //----------------------------------------------------------------------
+  StatementHolder(ODBC *owner, Statement *statement)
+    : mOwner(owner)
+    , mStatement(statement)
+  {
+  }
+
+  //----------------------------------------------------------------------
+  virtual ~StatementHolder() {
+  }
+
+  //----------------------------------------------------------------------
+  // called when the connection is closed. the owner frees the statement.
+  Statement *detach(void) {
+    Statement *statement = mStatement;
+    mOwner = NULL;
+    mStatement = NULL;
+    return statement;
+  }
+};
+
+//----------------------------------------------------------------------
+// AsyncQuery struct
+//----------------------------------------------------------------------
+// a query of ODBC::queryAsync
+struct AsyncQuery {
+  ODBC                *owner;
+  Statement           *statement;
+  std::vector<WCHAR>  sql;        /* copy of the sql read by the worker */
+  QueryResultType     queryResultType;
+  FetchOptions        options;
+  tTJSVariant         callback;
+  WorkerLog           log;
+  bool                failed;
+  HANDLE              done;       /* signaled when the worker finished */
+};
+
+//----------------------------------------------------------------------
+// AsyncDispatcher class
+//----------------------------------------------------------------------
+// runs asynchronous queries on worker threads, at most mLimit at once, and
+// passes the finished ones back to their connection on the main thread.
+class AsyncDispatcher : public tTVPContinuousEventCallbackIntf
+{
+  //----------------------------------------------------------------------
+  typedef std::list<AsyncQuery *> queries;
+
+  //----------------------------------------------------------------------
+  CRITICAL_SECTION mLock;
+  queries mWaiting;
+  queries mFinished;
+  tjs_int mRunning;
+  tjs_int mLimit;
+
+  // queries submitted and not yet passed back (main thread only)
+  tjs_int mPending;
+
+public:
+  //----------------------------------------------------------------------
+  AsyncDispatcher()
+    : mRunning(0)
+    , mLimit(4)
+    , mPending(0)
+  {
+    InitializeCriticalSection(&mLock);
+  }
+
+  //----------------------------------------------------------------------
+  virtual ~AsyncDispatcher() {
+    if (mPending > 0)
+      TVPRemoveContinuousEventHook(this);
+    DeleteCriticalSection(&mLock);
+  }
+
+  //----------------------------------------------------------------------
+  tjs_int getLimit() {
+    return mLimit;
+  }
+
+  void setLimit(tjs_int limit) {
+    EnterCriticalSection(&mLock);
+    mLimit = std::max(limit, 1);
+    startWorkers();
+    LeaveCriticalSection(&mLock);
+  }
+
+  //----------------------------------------------------------------------
+  void submit(AsyncQuery *query) {
+    if (mPending++ == 0)
+      TVPAddContinuousEventHook(this);
+    EnterCriticalSection(&mLock);
+    mWaiting.push_back(query);
+    startWorkers();
+    LeaveCriticalSection(&mLock);
+  }
+
+  //----------------------------------------------------------------------
+  // takes back a query of a closing connection. a running query is waited for.
+  void withdraw(AsyncQuery *query) {
+    EnterCriticalSection(&mLock);
+    bool waiting = std::find(mWaiting.begin(), mWaiting.end(), query) != mWaiting.end();
+    mWaiting.remove(query);
+    LeaveCriticalSection(&mLock);
+    if (! waiting) {
+      WaitForSingleObject(query->done, INFINITE);
+      EnterCriticalSection(&mLock);
+      mFinished.remove(query);
+      LeaveCriticalSection(&mLock);
+    }
+    release();
+  }
+
+  //----------------------------------------------------------------------
+  virtual void TJS_INTF_METHOD OnContinuousCallback(tjs_uint64 tick);
+
+private:
+  //----------------------------------------------------------------------
+  void release() {
+    if (--mPending == 0)
+      TVPRemoveContinuousEventHook(this);
+  }
+
+  //----------------------------------------------------------------------
+  // called in the lock
+  void startWorkers() {
+    while (mRunning < mLimit && ! mWaiting.empty()) {
+      AsyncQuery *query = mWaiting.front();
+      mWaiting.pop_front();
+      uintptr_t thread = _beginthreadex(NULL, 0, workerProc, query, 0, NULL);
+      if (! thread) {
+        static const WCHAR message[] = L"Unable to start a worker thread";
+        query->log.error.assign(message, message + sizeof(message) / sizeof(WCHAR));
+        query->failed = true;
+        mFinished.push_back(query);
+        SetEvent(query->done);
+        continue;
+      }
+      CloseHandle((HANDLE)thread);
+      mRunning++;
+    }
+  }
+
+  //----------------------------------------------------------------------
+  // runs queries until no query waits for a free worker.
+  static unsigned __stdcall workerProc(void *param);
+};
+
+static AsyncDispatcher *asyncDispatcher = NULL;
+
+static AsyncDispatcher *getAsyncDispatcher(void)
+{
+  if (! asyncDispatcher) {
+    allocWorkerLog();
+    asyncDispatcher = new AsyncDispatcher();
+  }
+  return asyncDispatcher;
+}
+
+//----------------------------------------------------------------------
+unsigned __stdcall AsyncDispatcher::workerProc(void *param)
+{
+  AsyncQuery *query = (AsyncQuery *)param;
+  AsyncDispatcher *self = asyncDispatcher;
+  
+  while (query) {
+    TlsSetValue(workerLogIndex, &query->log);
+    try {
+      query->statement->execDirectAsync(&query->sql[0], query->queryResultType, query->options);
+    } catch (WorkerError &) {
+      query->failed = true;
+    } catch (...) {
+      static const WCHAR message[] = L"Unexpected error in a worker thread";
+      query->log.error.assign(message, message + sizeof(message) / sizeof(WCHAR));
+      query->failed = true;
+    }
+    TlsSetValue(workerLogIndex, NULL);
+
+    EnterCriticalSection(&self->mLock);
+    self->mFinished.push_back(query);
+    SetEvent(query->done);
+    query = NULL;
+    if (self->mRunning <= self->mLimit && ! self->mWaiting.empty()) {
+      query = self->mWaiting.front();
+      self->mWaiting.pop_front();
+    } else
+      self->mRunning--;
+    LeaveCriticalSection(&self->mLock);
+  }
+  return 0;
+}
+
+//----------------------------------------------------------------------
+// QueryFanOut class
+//----------------------------------------------------------------------
+// runs the queries of ODBC::queryAll on worker threads, each with its own
+// connection. the workers take the queries in order until none is left.
+// the connections are opened and returned by the main thread, and the
+// results are built there after all workers finished.
+class QueryFanOut
+{
+public:
+  //----------------------------------------------------------------------
+  struct Query {
+    std::vector<WCHAR>  sql;
+    Statement           *statement; /* made by the worker that runs it */
+    WorkerLog           log;
+    bool                failed;
+  };
+
+  //----------------------------------------------------------------------
+  struct Worker {
+    QueryFanOut         *owner;
+    SQLHDBC             hDbc;
+    bool                connected;  /* false until the worker connects */
+    std::vector<WCHAR>  completed;  /* connection string returned by the driver */
+    WorkerLog           log;        /* logs and error of connecting */
+    HANDLE              thread;
+  };
+
+  //----------------------------------------------------------------------
+  std::vector<Query>    queries;
+  std::vector<Worker>   workers;
+  QueryResultType       queryResultType;
+  FetchOptions          options;
+
+private:
+  //----------------------------------------------------------------------
+  CRITICAL_SECTION      mLock;
+  size_t                mNext;      /* next query to run */
+  ColumnCache           *mColumnCache;
+  std::vector<WCHAR>    mConnectionStr;
+
+public:
+  //----------------------------------------------------------------------
+  QueryFanOut(ColumnCache *columnCache, const ttstr &connectionStr)
+    : mNext(0)
+    , mColumnCache(columnCache)
+    , mConnectionStr(connectionStr.c_str(), connectionStr.c_str() + connectionStr.length() + 1)
+  {
+    InitializeCriticalSection(&mLock);
+  }
+
+  //----------------------------------------------------------------------
+  ~QueryFanOut() {
+    freeStatements();
+    DeleteCriticalSection(&mLock);
+  }
+
+  //----------------------------------------------------------------------
+  // the statements are freed before their connections are returned.
+  void freeStatements() {
+    for (std::vector<Query>::iterator iQuery = queries.begin();
+         iQuery != queries.end();
+         iQuery++) {
+      delete iQuery->statement;
+      iQuery->statement = NULL;
+    }
+  }
+
+  //----------------------------------------------------------------------
+  // cancels the running queries. the queries not started yet fail.
+  void cancel() {
+    static const WCHAR message[] = L"Query cancelled.";
+    EnterCriticalSection(&mLock);
+    for (; mNext < queries.size(); mNext++) {
+      queries[mNext].log.error.assign(message, message + sizeof(message) / sizeof(WCHAR));
+      queries[mNext].failed = true;
+    }
+    for (std::vector<Query>::iterator iQuery = queries.begin();
+         iQuery != queries.end();
+         iQuery++)
+      if (iQuery->statement)
+        iQuery->statement->cancel();
+    LeaveCriticalSection(&mLock);
+  }
+
+  //----------------------------------------------------------------------
+  // starts the workers and waits for all of them. a worker that could not
+  // start leaves its queries to the others.
+  void run() {
+    for (std::vector<Worker>::iterator iWorker = workers.begin();
+         iWorker != workers.end();
+         iWorker++) {
+      iWorker->owner = this;
+      iWorker->thread = (HANDLE)_beginthreadex(NULL, 0, workerProc, &*iWorker, 0, NULL);
+    }
+    for (std::vector<Worker>::iterator iWorker = workers.begin();
+         iWorker != workers.end();
+         iWorker++) {
+      if (! iWorker->thread)
+        continue;
+      WaitForSingleObject(iWorker->thread, INFINITE);
+      CloseHandle(iWorker->thread);
+      iWorker->thread = NULL;
+    }
+  }
+
+private:
+  //----------------------------------------------------------------------
+  Query *nextQuery() {
+    Query *query = NULL;
+    EnterCriticalSection(&mLock);
+    if (mNext < queries.size())
+      query = &queries[mNext++];
+    LeaveCriticalSection(&mLock);
+    return query;
+  }
+
+  //----------------------------------------------------------------------
+  static unsigned __stdcall workerProc(void *param) {
+    Worker *worker = (Worker *)param;
+    QueryFanOut *self = worker->owner;
+
+    if (! worker->connected) {
+      TlsSetValue(workerLogIndex, &worker->log);
+      try {
+        self->connect(*worker);
+      } catch (WorkerError &) {
+      } catch (...) {
+        static const WCHAR message[] = L"Unexpected error in a worker thread";
+        worker->log.error.assign(message, message + sizeof(message) / sizeof(WCHAR));
+      }
+      TlsSetValue(workerLogIndex, NULL);
+      if (! worker->connected)
+        return 0;
+    }
+
+    Query *query;
+    while ((query = self->nextQuery()) != NULL) {
+      TlsSetValue(workerLogIndex, &query->log);
+      try {
+        Statement *statement = new Statement(worker->hDbc, self->mColumnCache);
+        EnterCriticalSection(&self->mLock);
+        query->statement = statement;
+        LeaveCriticalSection(&self->mLock);
+        statement->execDirectAsync(&query->sql[0], self->queryResultType, self->options);
+      } catch (WorkerError &) {
+        query->failed = true;
+      } catch (...) {
+        static const WCHAR message[] = L"Unexpected error in a worker thread";
+        query->log.error.assign(message, message + sizeof(message) / sizeof(WCHAR));
+        query->failed = true;
+      }
+      TlsSetValue(workerLogIndex, NULL);
+    }
+    return 0;
+  }
+
+  //----------------------------------------------------------------------
+  // a worker connection not taken from the pool. no dialog is shown
+  // from a worker thread.
+  void connect(Worker &worker) {
+    WCHAR outConnectionStr[1024 + 1];
+    SQLSMALLINT outConnectionStringLength = 0;
+    RETCODE retCode;
+    
+    TRYODBC(worker.hDbc,
+            SQL_HANDLE_DBC,
+            retCode = SQLDriverConnect(worker.hDbc,
+                                       NULL,
+                                       (SQLWCHAR*)&mConnectionStr[0],
+                                       SQL_NTS,
+                                       outConnectionStr,
+                                       1024 + 1,
+                                       &outConnectionStringLength,
+                                       SQL_DRIVER_NOPROMPT));
+    if (retCode == SQL_NO_DATA)
+      return;
+    if (outConnectionStringLength <= 1024)
+      worker.completed.assign(outConnectionStr, outConnectionStr + outConnectionStringLength + 1);
+    worker.connected = true;
+  }
+};
+
+//----------------------------------------------------------------------
+// ConnectionPool class
+//----------------------------------------------------------------------
+// the environment shared by all connections, and idle connections kept
+// for reuse by the connection string. used by the main thread only.
+class ConnectionPool
+{
+  //----------------------------------------------------------------------
+  struct Connection {
+    SQLHDBC     hDbc;
+    ttstr       key;        /* connection string given to connect */
+    ttstr       completed;  /* connection string returned by the driver */
+    DWORD       idleSince;  /* tick count when returned to the pool */
+  };
+  typedef std::list<Connection> connections;
+
+  //----------------------------------------------------------------------
+  SQLHENV     mHEnv;
+  tjs_int     mHandles;     /* connection handles allocated from mHEnv */
+
+  // idle connections, the most recently returned one first.
+  connections mIdle;
+
+  tjs_int     mMinSize;
+  tjs_int     mMaxSize;
+  tjs_int     mIdleTimeout;
+  ttstr       mValidationQuery;
+
+  tjs_int     mHits;
+  tjs_int     mMisses;
+  tjs_int     mEvictions;
+
+public:
+  //----------------------------------------------------------------------
+  ConnectionPool()
+    : mHEnv(NULL)
+    , mHandles(0)
+    , mMinSize(0)
+    , mMaxSize(0)
+    , mIdleTimeout(60000)
+    , mHits(0)
+    , mMisses(0)
+    , mEvictions(0)
+  {
+  }
+
+  //----------------------------------------------------------------------
+  ~ConnectionPool() {
+    while (! mIdle.empty()) {
+      closeConnection(mIdle.front().hDbc);
+      mIdle.pop_front();
+    }
+  }
+
+  //----------------------------------------------------------------------
+  tjs_int getMinSize() {
+    return mMinSize;
+  }
+
+  void setMinSize(tjs_int size) {
+    mMinSize = std::max(size, 0);
+  }
+
+  tjs_int getMaxSize() {
+    return mMaxSize;
+  }
+
+  void setMaxSize(tjs_int size) {
+    mMaxSize = std::max(size, 0);
+    trim();
+  }
+
+  tjs_int getIdleTimeout() {
+    return mIdleTimeout;
+  }
+
+  void setIdleTimeout(tjs_int timeout) {
+    mIdleTimeout = std::max(timeout, 0);
+    trim();
+  }
+
+  const ttstr &getValidationQuery() {
+    return mValidationQuery;
+  }
+
+  void setValidationQuery(ttstr query) {
+    mValidationQuery = query;
+  }
+
+  //----------------------------------------------------------------------
+  tjs_int getHits() {
+    return mHits;
+  }
+
+  tjs_int getMisses() {
+    return mMisses;
+  }
+
+  tjs_int getEvictions() {
+    return mEvictions;
+  }
+
+  tjs_int getIdleConnections() {
+    return tjs_int(mIdle.size());
+  }
+
+  //----------------------------------------------------------------------
+  // a new connection handle. the environment is allocated on first use.
+  SQLHDBC allocConnection() {
+    if (! mHEnv) {
+      if (SQLAllocHandle(SQL_HANDLE_ENV, SQL_NULL_HANDLE, &mHEnv) == SQL_ERROR) {
+        mHEnv = NULL;
+        TVPThrowExceptionMessage(L"Unable to allocate an environment handle");
+      }
+
+      RETCODE rc = SQLSetEnvAttr(mHEnv,
+                                 SQL_ATTR_ODBC_VERSION,
+                                 (SQLPOINTER)SQL_OV_ODBC3,
+                                 0);
+      if (rc != SQL_SUCCESS)
+        dumpDiagnosticRecord(mHEnv, SQL_HANDLE_ENV, rc);
+      if (rc == SQL_ERROR) {
+        freeEnvironment();
+        TVPThrowExceptionMessage(L"Error in SQLSetEnvAttr");
+      }
+    }
+
+    SQLHDBC hDbc = NULL;
+    RETCODE rc = SQLAllocHandle(SQL_HANDLE_DBC, mHEnv, &hDbc);
+    if (rc != SQL_SUCCESS)
+      dumpDiagnosticRecord(mHEnv, SQL_HANDLE_ENV, rc);
+    if (rc == SQL_ERROR) {
+      freeEnvironment();
+      TVPThrowExceptionMessage(L"Error in SQLAllocHandle");
+    }
+    mHandles++;
+    return hDbc;
+  }
+
+  //----------------------------------------------------------------------
+  // disconnects and frees a connection handle.
+  void closeConnection(SQLHDBC hDbc, bool connected = true) {
+    if (connected)
+      SQLDisconnect(hDbc);
+    SQLFreeHandle(SQL_HANDLE_DBC, hDbc);
+    mHandles--;
+    freeEnvironment();
+  }
+
+  //----------------------------------------------------------------------
+  // an idle connection of the connection string, or NULL.
+  SQLHDBC checkout(const ttstr &key, ttstr &completed) {
+    trim();
+    if (key.IsEmpty())
+      return NULL;
+    
+    for (connections::iterator iConnection = mIdle.begin();
+         iConnection != mIdle.end();) {
+      if (iConnection->key != key) {
+        iConnection++;
+        continue;
+      }
+      SQLHDBC hDbc = iConnection->hDbc;
+      completed = iConnection->completed;
+      iConnection = mIdle.erase(iConnection);
+      if (validate(hDbc)) {
+        mHits++;
+        return hDbc;
+      }
+      mEvictions++;
+      closeConnection(hDbc);
+    }
+    
+    mMisses++;
+    return NULL;
+  }
+
+  //----------------------------------------------------------------------
+  // returns a connection no longer used. it is closed when the pool is full.
+  void checkin(SQLHDBC hDbc, const ttstr &key, const ttstr &completed) {
+    if (mMaxSize == 0 || key.IsEmpty()) {
+      closeConnection(hDbc);
+      return;
+    }
+    Connection connection;
+    connection.hDbc = hDbc;
+    connection.key = key;
+    connection.completed = completed;
+    connection.idleSince = GetTickCount();
+    mIdle.push_front(connection);
+    trim();
+  }
+
+private:
+  //----------------------------------------------------------------------
+  void freeEnvironment() {
+    if (mHEnv && mHandles == 0) {
+      SQLFreeHandle(SQL_HANDLE_ENV, mHEnv);
+      mHEnv = NULL;
+    }
+  }
+
+  //----------------------------------------------------------------------
+  bool validate(SQLHDBC hDbc) {
+    SQLUINTEGER dead = SQL_CD_FALSE;
+    if (SQL_SUCCEEDED(SQLGetConnectAttr(hDbc, SQL_ATTR_CONNECTION_DEAD, &dead, 0, NULL))
+        && dead == SQL_CD_TRUE)
+      return false;
+    if (mValidationQuery.IsEmpty())
+      return true;
+
+    SQLHSTMT hStmt;
+    if (! SQL_SUCCEEDED(SQLAllocHandle(SQL_HANDLE_STMT, hDbc, &hStmt)))
+      return false;
+    RETCODE rc = SQLExecDirect(hStmt, (SQLWCHAR*)mValidationQuery.c_str(), SQL_NTS);
+    SQLFreeHandle(SQL_HANDLE_STMT, hStmt);
+    return SQL_SUCCEEDED(rc) || rc == SQL_NO_DATA;
+  }
+
+  //----------------------------------------------------------------------
+  // closes the connections idle longer than the timeout, and the oldest
+  // ones over the maximum size. mMinSize connections of each connection
+  // string are kept regardless of the timeout.
+  void trim() {
+    DWORD now = GetTickCount();
+    tjs_int kept = 0;
+    for (connections::iterator iConnection = mIdle.begin();
+         iConnection != mIdle.end();) {
+      bool expired = kept >= mMaxSize;
+      if (! expired && now - iConnection->idleSince > DWORD(mIdleTimeout)) {
+        tjs_int newer = 0;
+        for (connections::iterator iNewer = mIdle.begin();
+             iNewer != iConnection;
+             iNewer++)
+          if (iNewer->key == iConnection->key)
+            newer++;
+        expired = newer >= mMinSize;
+      }
+      if (expired) {
+        mEvictions++;
+        closeConnection(iConnection->hDbc);
+        iConnection = mIdle.erase(iConnection);
+      } else {
+        kept++;
+        iConnection++;
+      }
+    }
+  }
+};
+
+static ConnectionPool *connectionPool = NULL;
+
+static ConnectionPool *getConnectionPool(void)
+{
+  if (! connectionPool)
+    connectionPool = new ConnectionPool();
+  return connectionPool;
+}
+
+//----------------------------------------------------------------------
+// ODBC class
+//----------------------------------------------------------------------
+class ODBC : public tTVPContinuousEventCallbackIntf
+{
+  //----------------------------------------------------------------------
+  typedef std::list<Statement *> statements;
+  typedef std::list<StatementHolder *> statementHolders;
+  typedef std::list<AsyncQuery *> asyncQueries;
+
+  //----------------------------------------------------------------------
+  SQLHDBC     mHDbc;
+
+  // connection string given to connect, and the one completed by the driver
+  ttstr       mConnectionStr;
+  ttstr       mCompletedConnectionStr;
+  
+  bool mIsConnected;
+  FetchOptions mOptions;
+
+  // idle prepared statements, the most recently used one first.
+  statements mStatementCache;
+  tjs_int mStatementCacheSize;
+  tjs_int mStatementCacheHits;
+  tjs_int mStatementCacheMisses;
+
+  // column descriptions shared by the statements
+  ColumnCache mColumnCache;
+
+  // results of queryCached
+  ResultCache mResultCache;
+
+  QueryProfiler mProfiler;
+
+  // idle statements without prepared sql, used for direct execution
+  // and cursors.
+  statements mIdleStatements;
+  tjs_int mStatementPoolSize;
+
+  tjs_int mBatchSize;
+
+  // worker connections of queryAll
+  tjs_int mParallelism;
+
+  // statements held by script objects (prepared statements and cursors)
+  statementHolders mStatementHolders;
+
+  // asynchronous queries run one by one in this order, on mAsyncStatement.
+  asyncQueries mAsyncQueries;
+  Statement *mAsyncStatement;
+
+  // statements taken from the caches until they are given back, and the
+  // queries of a running queryAll. cancel() reaches them from any thread.
+  CRITICAL_SECTION mRunningLock;
+  statements mRunningStatements;
+  QueryFanOut *mRunningFanOut;
+
+  // held by the worker of an asynchronous query and the helpers of the
+  // cursors while they call the driver. the main thread waits for the
+  // running asynchronous query instead.
+  CRITICAL_SECTION mConnectionLock;
+
+  // transaction started by begin(). otherwise statements are committed
+  // every mCommitInterval statements or mCommitTime milliseconds, or
+  // at once when both are 0.
+  bool mTransaction;
+  bool mAutoCommit;
+  tjs_int mIsolationLevel;
+  // level the connection had before mIsolationLevel was applied, given
+  // back before it goes back to the pool. 0 when it was not read.
+  bool mIsolationChanged;
+  SQLUINTEGER mSessionIsolationLevel;
+  tjs_int mCommitInterval;
+  tjs_int mCommitTime;
+  tjs_int mUncommitted;
+  DWORD mUncommittedSince;
+  bool mCommitHooked;
+
+public:
+  //----------------------------------------------------------------------
+  ODBC()
+    : mHDbc(NULL)
+    , mIsConnected(false)
+    , mStatementCacheSize(32)
+    , mStatementCacheHits(0)
+    , mStatementCacheMisses(0)
+    , mStatementPoolSize(4)
+    , mBatchSize(1000)
+    , mParallelism(4)
+    , mAsyncStatement(NULL)
+    , mRunningFanOut(NULL)
+    , mTransaction(false)
+    , mAutoCommit(true)
+    , mIsolationLevel(0)
+    , mIsolationChanged(false)
+    , mSessionIsolationLevel(0)
+    , mCommitInterval(0)
+    , mCommitTime(0)
+    , mUncommitted(0)
+    , mUncommittedSince(0)
+    , mCommitHooked(false)
+  {
+    mOptions.fetchRowsetSize = 256;
+    mOptions.lobChunkSize = 64 * 1024;
+    mOptions.decimalMode = dmReal;
+    mOptions.dateMode = dtmDate;
+    mOptions.logAffectedRows = true;
+    mOptions.prefetchDepth = 0;
+    mOptions.prefetchLimit = 16 * 1024 * 1024;
+    mOptions.queryTimeout = 0;
+    mOptions.maxRows = 0;
+    mOptions.maxBytes = 0;
+    InitializeCriticalSection(&mRunningLock);
+    InitializeCriticalSection(&mConnectionLock);
+  }
+
+  //----------------------------------------------------------------------
+  virtual ~ODBC() {
+    disconnect();
+    DeleteCriticalSection(&mRunningLock);
+    DeleteCriticalSection(&mConnectionLock);
+  }
+
+  //----------------------------------------------------------------------
+  bool getConnected() {
+    return mIsConnected;
+  }
+
+  //----------------------------------------------------------------------
+  tjs_int getFetchRowsetSize() {
+    return tjs_int(mOptions.fetchRowsetSize);
+  }
+
+  void setFetchRowsetSize(tjs_int size) {
+    mOptions.fetchRowsetSize = SQLULEN(std::max(size, 1));
+  }
+
+  //----------------------------------------------------------------------
+  tjs_int getLobChunkSize() {
+    return tjs_int(mOptions.lobChunkSize);
+  }
+
+  void setLobChunkSize(tjs_int size) {
+    mOptions.lobChunkSize = SQLLEN(std::max(size, 64));
+  }
+
+  //----------------------------------------------------------------------
+  // rowsets fetched ahead by a helper thread while a cursor is read.
+  // 0 fetches on the main thread.
+  tjs_int getPrefetchDepth() {
+    return tjs_int(mOptions.prefetchDepth);
+  }
+
+  void setPrefetchDepth(tjs_int depth) {
+    mOptions.prefetchDepth = SQLULEN(std::max(depth, 0));
+  }
+
+  //----------------------------------------------------------------------
+  tjs_int getPrefetchLimit() {
+    return tjs_int(mOptions.prefetchLimit);
+  }
+
+  void setPrefetchLimit(tjs_int limit) {
+    mOptions.prefetchLimit = SQLULEN(std::max(limit, 0));
+  }
+
+  //----------------------------------------------------------------------
+  // seconds until an execution is cancelled by the driver. 0 waits.
+  tjs_int getQueryTimeout() {
+    return tjs_int(mOptions.queryTimeout);
+  }
+
+  void setQueryTimeout(tjs_int seconds) {
+    mOptions.queryTimeout = SQLULEN(std::max(seconds, 0));
+  }
+
+  //----------------------------------------------------------------------
+  // rows read from a result. 0 reads all.
+  tjs_int getMaxRows() {
+    return tjs_int(mOptions.maxRows);
+  }
+
+  void setMaxRows(tjs_int rows) {
+    mOptions.maxRows = SQLULEN(std::max(rows, 0));
+  }
+
+  //----------------------------------------------------------------------
+  // bytes fetched by an execution before the fetch stops. 0 for no limit.
+  tjs_int64 getMaxBytes() {
+    return mOptions.maxBytes;
+  }
+
+  void setMaxBytes(tjs_int64 bytes) {
+    mOptions.maxBytes = std::max(bytes, tjs_int64(0));
+  }
+
+  //----------------------------------------------------------------------
+  tjs_int getDecimalMode() {
+    return tjs_int(mOptions.decimalMode);
+  }
+
+  void setDecimalMode(tjs_int mode) {
+    mOptions.decimalMode = DecimalMode(mode);
+  }
+
+  //----------------------------------------------------------------------
+  tjs_int getDateMode() {
+    return tjs_int(mOptions.dateMode);
+  }
+
+  void setDateMode(tjs_int mode) {
+    mOptions.dateMode = DateMode(mode);
+  }
+
+  //----------------------------------------------------------------------
+  tjs_int getStatementCacheSize() {
+    return mStatementCacheSize;
+  }
+
+  void setStatementCacheSize(tjs_int size) {
+    mStatementCacheSize = std::max(size, 0);
+    trimStatementCache();
+  }
+
+  tjs_int getStatementCacheHits() {
+    return mStatementCacheHits;
+  }
+
+  tjs_int getStatementCacheMisses() {
+    return mStatementCacheMisses;
+  }
+
+  //----------------------------------------------------------------------
+  tjs_int getStatementPoolSize() {
+    return mStatementPoolSize;
+  }
+
+  void setStatementPoolSize(tjs_int size) {
+    mStatementPoolSize = std::max(size, 0);
+    trimIdleStatements();
+  }
+
+  tjs_int getIdleStatements() {
+    return tjs_int(mIdleStatements.size());
+  }
+
+  //----------------------------------------------------------------------
+  tjs_int getColumnCacheSize() {
+    return mColumnCache.getSize();
+  }
+
+  void setColumnCacheSize(tjs_int size) {
+    mColumnCache.setSize(size);
+  }
+
+  tjs_int getColumnCacheHits() {
+    return mColumnCache.getHits();
+  }
+
+  tjs_int getColumnCacheMisses() {
+    return mColumnCache.getMisses();
+  }
+
+  // needed after the columns of a table changed.
+  void clearColumnCache() {
+    mColumnCache.clear();
+  }
+
+  //----------------------------------------------------------------------
+  tjs_int getResultCacheTtl() {
+    return mResultCache.getTtl();
+  }
+
+  void setResultCacheTtl(tjs_int ttl) {
+    mResultCache.setTtl(ttl);
+  }
+
+  tjs_int getResultCacheBudget() {
+    return mResultCache.getBudget();
+  }
+
+  void setResultCacheBudget(tjs_int budget) {
+    mResultCache.setBudget(budget);
+  }
+
+  tjs_int getResultCacheHits() {
+    return mResultCache.getHits();
+  }
+
+  tjs_int getResultCacheMisses() {
+    return mResultCache.getMisses();
+  }
+
+  tjs_int getResultCacheBytes() {
+    return mResultCache.getBytes();
+  }
+
+  //----------------------------------------------------------------------
+  bool getLogAffectedRows() {
+    return mOptions.logAffectedRows;
+  }
+
+  void setLogAffectedRows(bool log) {
+    mOptions.logAffectedRows = log;
+  }
+
+  tTJSVariant getProfile() {
+    return mProfiler.getStatistics();
+  }
+
+  tTJSVariant getSlowQueries() {
+    return mProfiler.getSlowQueries();
+  }
+
+  tjs_int getSlowQueryCount() {
+    return mProfiler.getSlowQueryCount();
+  }
+
+  void setSlowQueryCount(tjs_int count) {
+    mProfiler.setSlowQueryCount(count);
+  }
+
+  tjs_int getSlowQueryThreshold() {
+    return mProfiler.getSlowQueryThreshold();
+  }
+
+  void setSlowQueryThreshold(tjs_int threshold) {
+    mProfiler.setSlowQueryThreshold(threshold);
+  }
+
+  void resetProfile() {
+    mProfiler.reset();
+  }
+
+  //----------------------------------------------------------------------
+  tjs_int getBatchSize() {
+    return mBatchSize;
+  }
+
+  void setBatchSize(tjs_int size) {
+    mBatchSize = std::max(size, 1);
+  }
+
+  //----------------------------------------------------------------------
+  tjs_int getIsolationLevel() {
+    return mIsolationLevel;
+  }
+
+  void setIsolationLevel(tjs_int level) {
+    mIsolationLevel = level;
+    if (mIsConnected)
+      applyIsolationLevel();
+  }
+
+  //----------------------------------------------------------------------
+  tjs_int getCommitInterval() {
+    return mCommitInterval;
+  }
+
+  void setCommitInterval(tjs_int interval) {
+    mCommitInterval = std::max(interval, 0);
+    updateAutoCommit();
+  }
+
+  tjs_int getCommitTime() {
+    return mCommitTime;
+  }
+
+  void setCommitTime(tjs_int time) {
+    mCommitTime = std::max(time, 0);
+    updateAutoCommit();
+  }
+
+  bool getInTransaction() {
+    return mTransaction;
+  }
+
+  tjs_int getUncommitted() {
+    return mUncommitted;
+  }
+  
+  //----------------------------------------------------------------------
+  tjs_int getAsyncLimit() {
+    return getAsyncDispatcher()->getLimit();
+  }
+
+  void setAsyncLimit(tjs_int limit) {
+    getAsyncDispatcher()->setLimit(limit);
+  }
+
+  tjs_int getAsyncQueries() {
+    return tjs_int(mAsyncQueries.size());
+  }
+
+  //----------------------------------------------------------------------
+  tjs_int getParallelism() {
+    return mParallelism;
+  }
+
+  void setParallelism(tjs_int parallelism) {
+    mParallelism = std::max(parallelism, 1);
+  }
+
+  //----------------------------------------------------------------------
+  tjs_int getPoolMinSize() {
+    return getConnectionPool()->getMinSize();
+  }
+
+  void setPoolMinSize(tjs_int size) {
+    getConnectionPool()->setMinSize(size);
+  }
+
+  tjs_int getPoolMaxSize() {
+    return getConnectionPool()->getMaxSize();
+  }
+
+  void setPoolMaxSize(tjs_int size) {
+    getConnectionPool()->setMaxSize(size);
+  }
+
+  tjs_int getPoolIdleTimeout() {
+    return getConnectionPool()->getIdleTimeout();
+  }
+
+  void setPoolIdleTimeout(tjs_int timeout) {
+    getConnectionPool()->setIdleTimeout(timeout);
+  }
+
+  ttstr getPoolValidationQuery() {
+    return getConnectionPool()->getValidationQuery();
+  }
+
+  void setPoolValidationQuery(ttstr query) {
+    getConnectionPool()->setValidationQuery(query);
+  }
+
+  tjs_int getPoolHits() {
+    return getConnectionPool()->getHits();
+  }
+
+  tjs_int getPoolMisses() {
+    return getConnectionPool()->getMisses();
+  }
+
+  tjs_int getPoolEvictions() {
+    return getConnectionPool()->getEvictions();
+  }
+
+  tjs_int getPoolIdleConnections() {
+    return getConnectionPool()->getIdleConnections();
+  }
+
+  //----------------------------------------------------------------------
+  static tjs_error TJS_INTF_METHOD connect(tTJSVariant *result,
+                                           tjs_int numparams,
+                                           tTJSVariant **param,
+                                           iTJSDispatch2 *objthis) {
+    ODBC *self = ncbInstanceAdaptor<ODBC>::GetNativeInstance(objthis);
+    if (! self) 
+      return TJS_E_NATIVECLASSCRASH;
+    ttstr connectStr;
+    if (numparams == 0) connectStr = L"";
+    else if (numparams == 1) connectStr = *param[0];
+    else return TJS_E_BADPARAMCOUNT;
+    ttstr resultConnectionStr = self->_connect(connectStr);
+    if (result)
+      *result = resultConnectionStr;
+    return TJS_S_OK;
+  }
+
+  //----------------------------------------------------------------------
+  ttstr _connect(ttstr connectStr) {
+    disconnect();
+
+    // Reuse an idle connection of the pool
+    ConnectionPool *pool = getConnectionPool();
+    ttstr result;
+    mHDbc = pool->checkout(connectStr, result);
+    if (mHDbc) {
+      mConnectionStr = connectStr;
+      mCompletedConnectionStr = result;
+      mIsConnected = true;
+      startSession();
+      return result;
+    }
+    
+    // Allocate a connection on the shared environment
+    mHDbc = pool->allocConnection();
+
+    // Connect to the driver.
+    WCHAR outConnectionStr[1024 + 1];
+    SQLSMALLINT outConnectionStringLength = 0;
+    RETCODE retCode;
+    
+    TRYODBC(mHDbc,
+            SQL_HANDLE_DBC,
+            retCode = SQLDriverConnect(mHDbc,
+                                       GetDesktopWindow(),
+                                       (SQLWCHAR*)connectStr.c_str(),
+                                       SQL_NTS,
+                                       outConnectionStr,
+                                       1024 + 1,
+                                       &outConnectionStringLength,
+                                       SQL_DRIVER_COMPLETE_REQUIRED));
+    
+    if (retCode == SQL_NO_DATA)
+      return L"";
+        
+    if (outConnectionStringLength <= 1024)
+      result = outConnectionStr;
+    
+    mConnectionStr = connectStr;
+    mCompletedConnectionStr = result;
+
+    mIsConnected = true;
+    startSession();
+
+    return result;
+  }
+
+  //----------------------------------------------------------------------
+  // the settings of the connection, made again for each connection.
+  void startSession() {
+    mAutoCommit = true;
+    mTransaction = false;
+    mUncommitted = 0;
+    mIsolationChanged = false;
+    mSessionIsolationLevel = 0;
+    if (mIsolationLevel)
+      applyIsolationLevel();
+    updateAutoCommit();
+  }
+
+  //----------------------------------------------------------------------
+  void disconnect(void) {
+    // the running asynchronous query is waited for. the queries are
+    // dropped without calling their callbacks.
+    if (! mAsyncQueries.empty()) {
+      mAsyncStatement->cancel();
+      asyncDispatcher->withdraw(mAsyncQueries.front());
+      for (asyncQueries::iterator iQuery = mAsyncQueries.begin();
+           iQuery != mAsyncQueries.end();
+           iQuery++)
+        deleteAsyncQuery(*iQuery);
+      mAsyncQueries.clear();
+    }
+
+    EnterCriticalSection(&mRunningLock);
+    mRunningStatements.clear();
+    if (mAsyncStatement)
+      {
+        delete mAsyncStatement;
+        mAsyncStatement = NULL;
+      }
+    LeaveCriticalSection(&mRunningLock);
+
+    for (statementHolders::iterator iHolder = mStatementHolders.begin();
+         iHolder != mStatementHolders.end();
+         iHolder++)
+      delete (*iHolder)->detach();
+    mStatementHolders.clear();
+
+    for (statements::iterator iStatement = mStatementCache.begin();
+         iStatement != mStatementCache.end();
+         iStatement++)
+      delete *iStatement;
+    mStatementCache.clear();
+    
+    for (statements::iterator iStatement = mIdleStatements.begin();
+         iStatement != mIdleStatements.end();
+         iStatement++)
+      delete *iStatement;
+    mIdleStatements.clear();
+    mColumnCache.clear();
+    mResultCache.clear();
+
+    // an open transaction is rolled back, batched statements are committed.
+    // pooled connections go back in autocommit mode.
+    if (mIsConnected && ! mAutoCommit) {
+      try {
+        endTransaction(mTransaction ? SQL_ROLLBACK : SQL_COMMIT);
+        mTransaction = false;
+        setAutoCommit(true);
+      } catch (...) {
+        // reported to the log. the connection is not reused.
+        getConnectionPool()->closeConnection(mHDbc, true);
+        mHDbc = NULL;
+        mIsConnected = false;
+      }
+    }
+
+    // the isolation level is given back as well. a connection whose level
+    // is not known is not reused.
+    if (mIsConnected && mIsolationChanged) {
+      if (! mSessionIsolationLevel
+          || ! SQL_SUCCEEDED(SQLSetConnectAttr(mHDbc,
+                                               SQL_ATTR_TXN_ISOLATION,
+                                               (SQLPOINTER)SQLULEN(mSessionIsolationLevel),
+                                               SQL_IS_UINTEGER))) {
+        getConnectionPool()->closeConnection(mHDbc, true);
+        mHDbc = NULL;
+        mIsConnected = false;
+      }
+      mIsolationChanged = false;
+    }
+
+    // a connection goes back to the pool, one failed to connect is freed.
+    if (mHDbc)
+      {
+        if (mIsConnected)
+          getConnectionPool()->checkin(mHDbc, mConnectionStr, mCompletedConnectionStr);
+        else
+          getConnectionPool()->closeConnection(mHDbc, false);
+        mHDbc = NULL;
+      }
+
+    mIsConnected = false;
+  }
+  
+  //----------------------------------------------------------------------
+  // starts a transaction, committing the batched statements first.
+  void begin() {
+    if (! mIsConnected) 
+      TVPThrowExceptionMessage(L"SQL connection is not established.");
+    if (mTransaction)
+      TVPThrowExceptionMessage(L"Transaction is already started.");
+    if (mUncommitted > 0)
+      endTransaction(SQL_COMMIT);
+    setAutoCommit(false);
+    mTransaction = true;
+  }
+
+  //----------------------------------------------------------------------
+  // commits the transaction, or the batched statements.
+  void commit() {
+    if (! mIsConnected) 
+      TVPThrowExceptionMessage(L"SQL connection is not established.");
+    if (! mAutoCommit)
+      endTransaction(SQL_COMMIT);
+    mTransaction = false;
+    updateAutoCommit();
+  }
+
+  //----------------------------------------------------------------------
+  // rolls back the transaction, or the batched statements. the cached
+  // results may hold rows of the rolled back changes.
+  void rollback() {
+    if (! mIsConnected) 
+      TVPThrowExceptionMessage(L"SQL connection is not established.");
+    if (! mAutoCommit) {
+      endTransaction(SQL_ROLLBACK);
+      mResultCache.clear();
+    }
+    mTransaction = false;
+    updateAutoCommit();
+  }
+
+  //----------------------------------------------------------------------
+  // commits the batched statements after mCommitTime.
+  virtual void TJS_INTF_METHOD OnContinuousCallback(tjs_uint64 tick) {
+    if (mUncommitted > 0
+        && mCommitTime > 0
+        && GetTickCount() - mUncommittedSince >= DWORD(mCommitTime)
+        && mAsyncQueries.empty()) {
+      try {
+        endTransaction(SQL_COMMIT);
+      } catch (...) {
+        // reported to the log, tried again by the next statement.
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------
+  static tjs_error TJS_INTF_METHOD query(tTJSVariant *result,
+                                         tjs_int numparams,
+                                         tTJSVariant **param,
+                                         iTJSDispatch2 *objthis) {
+    ODBC *self = ncbInstanceAdaptor<ODBC>::GetNativeInstance(objthis);
+    if (! self) 
+      return TJS_E_NATIVECLASSCRASH;
+    if (numparams == 0)
+      return TJS_E_BADPARAMCOUNT;
+    ttstr sqlStr;
+    sqlStr = *param[0];
+    QueryResultType queryResultType = qrtArray;
+    if (numparams >= 2)
+      queryResultType = QueryResultType(tjs_int(*param[1]));
+    tTJSVariant params;
+    if (numparams >= 3)
+      params = *param[2];
+    tTJSVariant options;
+    if (numparams >= 4)
+      options = *param[3];
+    tTJSVariant queryResult;
+    queryResult = self->_query(sqlStr, queryResultType, params, options);
+    if (result)
+      *result = queryResult;
+    return TJS_S_OK;
+  }
+
+  //----------------------------------------------------------------------
+  tTJSVariant _query(ttstr sqlString, QueryResultType queryResultType, tTJSVariant params,
+                     tTJSVariant options = tTJSVariant()) {
+    if (! mIsConnected) 
+      TVPThrowExceptionMessage(L"SQL connection is not established.");
+    FetchOptions fetchOptions = mOptions;
+    getLimitOptions(options, fetchOptions);
+    noteWrite(sqlString);
+
+    tTJSVariant result;
+    if (params.Type() == tvtVoid) {
+      Statement *statement = acquireStatement();
+      statement->resetProfile();
+      try {
+        result = statement->execDirect(sqlString, queryResultType, fetchOptions);
+      } catch (...) {
+        recycleStatement(statement);
+        throw;
+      }
+      mProfiler.record(sqlString, statement->getProfile());
+      recycleStatement(statement);
+      countStatement();
+      return result;
+    }
+
+    // queries with parameters reuse the prepared statement of the same sql.
+    Statement *statement = checkoutStatement(sqlString);
+    statement->resetProfile();
+    try {
+      result = statement->execute(params, queryResultType, fetchOptions);
+    } catch (...) {
+      statement->reset();
+      checkinStatement(statement);
+      throw;
+    }
+    mProfiler.record(sqlString, statement->getProfile());
+    checkinStatement(statement);
+    countStatement();
+    return result;
+  }
+
+  //----------------------------------------------------------------------
+  static tjs_error TJS_INTF_METHOD readLob(tTJSVariant *result,
+                                           tjs_int numparams,
+                                           tTJSVariant **param,
+                                           iTJSDispatch2 *objthis) {
+    ODBC *self = ncbInstanceAdaptor<ODBC>::GetNativeInstance(objthis);
+    if (! self) 
+      return TJS_E_NATIVECLASSCRASH;
+    if (numparams < 2)
+      return TJS_E_BADPARAMCOUNT;
+    ttstr sqlStr;
+    sqlStr = *param[0];
+    tTJSVariant target = *param[1];
+    tTJSVariant params;
+    if (numparams >= 3)
+      params = *param[2];
+    tTJSVariant length;
+    length = self->_readLob(sqlStr, target, params);
+    if (result)
+      *result = length;
+    return TJS_S_OK;
+  }
+
+  //----------------------------------------------------------------------
+  tTJSVariant _readLob(ttstr sqlString, tTJSVariant target, tTJSVariant params) {
+    if (! mIsConnected) 
+      TVPThrowExceptionMessage(L"SQL connection is not established.");
+
+    tTJSVariant result;
+    if (params.Type() == tvtVoid) {
+      Statement *statement = acquireStatement();
+      try {
+        result = statement->execDirectLob(sqlString, target, mOptions);
+      } catch (...) {
+        recycleStatement(statement);
+        throw;
+      }
+      recycleStatement(statement);
+      return result;
+    }
+
+    Statement *statement = checkoutStatement(sqlString);
+    try {
+      result = statement->executeLob(params, target, mOptions);
+    } catch (...) {
+      statement->reset();
+      checkinStatement(statement);
+      throw;
+    }
+    checkinStatement(statement);
+    return result;
+  }
+
+  //----------------------------------------------------------------------
+  static tjs_error TJS_INTF_METHOD exportQuery(tTJSVariant *result,
+                                               tjs_int numparams,
+                                               tTJSVariant **param,
+                                               iTJSDispatch2 *objthis) {
+    ODBC *self = ncbInstanceAdaptor<ODBC>::GetNativeInstance(objthis);
+    if (! self) 
+      return TJS_E_NATIVECLASSCRASH;
+    if (numparams < 2)
+      return TJS_E_BADPARAMCOUNT;
+    ttstr sqlStr;
+    sqlStr = *param[0];
+    ttstr path = *param[1];
+    ExportFormat format = efCSV;
+    if (numparams >= 3 && param[2]->Type() != tvtVoid)
+      format = ExportFormat(tjs_int(*param[2]));
+    tTJSVariant options;
+    if (numparams >= 4)
+      options = *param[3];
+    tjs_int64 rows = self->_exportQuery(sqlStr, path, format, options);
+    if (result)
+      *result = rows;
+    return TJS_S_OK;
+  }
+
+  //----------------------------------------------------------------------
+  // the rows go from the column buffers to the file without TJS objects.
+  // returns the number of the rows written.
+  tjs_int64 _exportQuery(ttstr sqlString, ttstr path, ExportFormat format, tTJSVariant options) {
+    if (! mIsConnected) 
+      TVPThrowExceptionMessage(L"SQL connection is not established.");
+    ExportOptions exportOptions;
+    tTJSVariant params;
+    getExportOptions(format, options, exportOptions, params);
+    FetchOptions fetchOptions = mOptions;
+    getLimitOptions(options, fetchOptions);
+    noteWrite(sqlString);
+
+    ExportWriter writer(path, exportOptions);
+    tjs_int64 rows;
+    if (params.Type() == tvtVoid) {
+      Statement *statement = acquireStatement();
+      statement->resetProfile();
+      try {
+        rows = statement->execDirectExport(sqlString, writer, fetchOptions);
+      } catch (...) {
+        recycleStatement(statement);
+        throw;
+      }
+      mProfiler.record(sqlString, statement->getProfile());
+      recycleStatement(statement);
+    } else {
+      Statement *statement = checkoutStatement(sqlString);
+      statement->resetProfile();
+      try {
+        rows = statement->executeExport(params, writer, fetchOptions);
+      } catch (...) {
+        statement->reset();
+        checkinStatement(statement);
+        throw;
+      }
+      mProfiler.record(sqlString, statement->getProfile());
+      checkinStatement(statement);
+    }
+    countStatement();
+    writer.close();
+    return rows;
+  }
+
+  //----------------------------------------------------------------------
+  static tjs_error TJS_INTF_METHOD saveSnapshot(tTJSVariant *result,
+                                                tjs_int numparams,
+                                                tTJSVariant **param,
+                                                iTJSDispatch2 *objthis) {
+    ODBC *self = ncbInstanceAdaptor<ODBC>::GetNativeInstance(objthis);
+    if (! self) 
+      return TJS_E_NATIVECLASSCRASH;
+    if (numparams < 2)
+      return TJS_E_BADPARAMCOUNT;
+    ttstr sqlStr;
+    sqlStr = *param[0];
+    ttstr path = *param[1];
+    tTJSVariant params;
+    if (numparams >= 3)
+      params = *param[2];
+    tTJSVariant rows = self->_saveSnapshot(sqlStr, path, params);
+    if (result)
+      *result = rows;
+    return TJS_S_OK;
+  }
+
+  //----------------------------------------------------------------------
+  // writes all the rows of the sql to a snapshot file, which loadSnapshot
+  // reads without the connection. returns the number of the rows, or void
+  // when the sql returns no result set and no file is written.
+  tTJSVariant _saveSnapshot(ttstr sqlString, ttstr path, tTJSVariant params) {
+    if (! mIsConnected) 
+      TVPThrowExceptionMessage(L"SQL connection is not established.");
+    noteWrite(sqlString);
+
+    Statement::Snapshot snapshot;
+    bool hasResult;
+    if (params.Type() == tvtVoid) {
+      Statement *statement = acquireStatement();
+      statement->resetProfile();
+      try {
+        hasResult = statement->execDirectToSnapshot(sqlString, mOptions, snapshot);
+      } catch (...) {
+        recycleStatement(statement);
+        throw;
+      }
+      mProfiler.record(sqlString, statement->getProfile());
+      recycleStatement(statement);
+    } else {
+      Statement *statement = checkoutStatement(sqlString);
+      statement->resetProfile();
+      try {
+        hasResult = statement->executeToSnapshot(params, mOptions, snapshot);
+      } catch (...) {
+        statement->reset();
+        checkinStatement(statement);
+        throw;
+      }
+      mProfiler.record(sqlString, statement->getProfile());
+      checkinStatement(statement);
+    }
+    countStatement();
+    if (! hasResult)
+      return tTJSVariant();
+
+    tTJSBinaryStream *stream = TVPCreateStream(path, TJS_BS_WRITE);
+    try {
+      Statement::writeSnapshot(stream, snapshot, sqlString);
+    } catch (...) {
+      stream->Destruct();
+      throw;
+    }
+    stream->Destruct();
+    return tjs_int64(snapshot.rows.rows);
+  }
+
+  //----------------------------------------------------------------------
+  static tjs_error TJS_INTF_METHOD loadSnapshot(tTJSVariant *result,
+                                                tjs_int numparams,
+                                                tTJSVariant **param,
+                                                iTJSDispatch2 *objthis) {
+    ODBC *self = ncbInstanceAdaptor<ODBC>::GetNativeInstance(objthis);
+    if (! self) 
+      return TJS_E_NATIVECLASSCRASH;
+    if (numparams == 0)
+      return TJS_E_BADPARAMCOUNT;
+    ttstr path = *param[0];
+    QueryResultType queryResultType = qrtArray;
+    if (numparams >= 2 && param[1]->Type() != tvtVoid)
+      queryResultType = QueryResultType(tjs_int(*param[1]));
+    tTJSVariant schemaHash;
+    if (numparams >= 3)
+      schemaHash = *param[2];
+    tTJSVariant queryResult = self->_loadSnapshot(path, queryResultType, schemaHash);
+    if (result)
+      *result = queryResult;
+    return TJS_S_OK;
+  }
+
+  //----------------------------------------------------------------------
+  // reads a snapshot file written by saveSnapshot. the connection is not
+  // used, so this works while disconnected. returns void when there is no
+  // such file, when the file is of another version, or when schemaHash is
+  // given and the columns of the file differ from it. the hash is only
+  // compared with the one in the file; the script keeps it from
+  // schemaHash() called while connected. qrtResultSet reads the values
+  // from the mapped file as the script asks for them.
+  tTJSVariant _loadSnapshot(ttstr path, QueryResultType queryResultType, tTJSVariant schemaHash) {
+    SnapshotFile *file = new SnapshotFile();
+    Statement::Snapshot *snapshot = new Statement::Snapshot();
+    try {
+      tjs_uint64 fileHash;
+      if (! file->open(path)
+          || ! Statement::readSnapshot(file->getData(), file->getSize(), *snapshot, fileHash)
+          || (schemaHash.Type() != tvtVoid && tjs_uint64(tjs_int64(schemaHash)) != fileHash)) {
+        delete snapshot;
+        delete file;
+        return tTJSVariant();
+      }
+      if (queryResultType != qrtResultSet) {
+        Statement restorer(NULL, NULL);
+        tTJSVariant result = restorer.restoreSnapshot(*snapshot, queryResultType, mOptions);
+        delete snapshot;
+        delete file;
+        return result;
+      }
+    } catch (...) {
+      delete snapshot;
+      delete file;
+      throw;
+    }
+    return Statement::createResultSet(snapshot, mOptions.dateMode, file);
+  }
+
+  //----------------------------------------------------------------------
+  // the schema hash of the columns the sql returns, to be given to
+  // loadSnapshot. the sql is prepared, not executed.
+  tjs_int64 schemaHash(ttstr sqlString) {
+    if (! mIsConnected) 
+      TVPThrowExceptionMessage(L"SQL connection is not established.");
+    Statement *statement = acquireStatement();
+    tjs_uint64 hash;
+    try {
+      hash = statement->describeSchema(sqlString);
+    } catch (...) {
+      recycleStatement(statement);
+      throw;
+    }
+    recycleStatement(statement);
+    return tjs_int64(hash);
+  }
+
+  //----------------------------------------------------------------------
+  static tjs_error TJS_INTF_METHOD queryAll(tTJSVariant *result,
+                                            tjs_int numparams,
+                                            tTJSVariant **param,
+                                            iTJSDispatch2 *objthis) {
+    ODBC *self = ncbInstanceAdaptor<ODBC>::GetNativeInstance(objthis);
+    if (! self) 
+      return TJS_E_NATIVECLASSCRASH;
+    if (numparams == 0)
+      return TJS_E_BADPARAMCOUNT;
+    tTJSVariant sqls = *param[0];
+    QueryResultType queryResultType = qrtArray;
+    if (numparams >= 2)
+      queryResultType = QueryResultType(tjs_int(*param[1]));
+    tTJSVariant errors;
+    if (numparams >= 3)
+      errors = *param[2];
+    tTJSVariant queryResult;
+    queryResult = self->_queryAll(sqls, queryResultType, errors);
+    if (result)
+      *result = queryResult;
+    return TJS_S_OK;
+  }
+
+  //----------------------------------------------------------------------
+  // runs the sql statements at once on up to mParallelism connections of
+  // the same connection string, and returns their results in the order.
+  // the error of each statement is set to errors when it is given, or
+  // the first one is thrown after all statements finished.
+  tTJSVariant _queryAll(tTJSVariant sqls, QueryResultType queryResultType, tTJSVariant errors) {
+    if (! mIsConnected) 
+      TVPThrowExceptionMessage(L"SQL connection is not established.");
+    allocWorkerLog();
+
+    QueryFanOut fanOut(&mColumnCache, mConnectionStr);
+    fanOut.queryResultType = queryResultType;
+    fanOut.options = mOptions;
+
+    ncbPropAccessor sqlsObj(sqls);
+    tjs_int count = countArray(sqls);
+    std::vector<ttstr> sqlStrings;
+    fanOut.queries.resize(count);
+    for (tjs_int i = 0; i < count; i++) {
+      ttstr sqlString = sqlsObj.GetValue(i, ncbTypedefs::Tag<ttstr>());
+      noteWrite(sqlString);
+      sqlStrings.push_back(sqlString);
+      QueryFanOut::Query &query = fanOut.queries[i];
+      query.sql.assign(sqlString.c_str(), sqlString.c_str() + sqlString.length() + 1);
+      query.statement = NULL;
+      query.failed = false;
+    }
+
+    tTJSVariant results = createArray();
+    if (count == 0)
+      return results;
+
+    // idle connections of the pool first, new ones for the rest. the new
+    // ones are connected by the workers.
+    ConnectionPool *pool = getConnectionPool();
+    fanOut.workers.reserve(std::min(size_t(mParallelism), size_t(count)));
+    try {
+      while (fanOut.workers.size() < fanOut.workers.capacity()) {
+        QueryFanOut::Worker worker;
+        worker.owner = NULL;
+        worker.thread = NULL;
+        ttstr completed;
+        worker.hDbc = pool->checkout(mConnectionStr, completed);
+        worker.connected = worker.hDbc != NULL;
+        if (! worker.hDbc)
+          worker.hDbc = pool->allocConnection();
+        worker.completed.assign(completed.c_str(), completed.c_str() + completed.length() + 1);
+        fanOut.workers.push_back(worker);
+      }
+      setRunningFanOut(&fanOut);
+      fanOut.run();
+      setRunningFanOut(NULL);
+    } catch (...) {
+      setRunningFanOut(NULL);
+      releaseFanOut(fanOut);
+      throw;
+    }
+
+    // the logs of the workers, then the results and the logs of each query.
+    const WCHAR *connectError = L"Unable to start a worker";
+    for (std::vector<QueryFanOut::Worker>::iterator iWorker = fanOut.workers.begin();
+         iWorker != fanOut.workers.end();
+         iWorker++) {
+      for (std::list<std::vector<WCHAR> >::iterator iMessage = iWorker->log.messages.begin();
+           iMessage != iWorker->log.messages.end();
+           iMessage++)
+        TVPAddLog(&(*iMessage)[0]);
+      if (! iWorker->log.error.empty())
+        connectError = &iWorker->log.error[0];
+    }
+    
+    ncbPropAccessor resultsObj(results);
+    ncbPropAccessor errorsObj(errors);
+    ttstr firstError;
+    bool failed = false;
+    try {
+      for (tjs_int i = 0; i < count; i++) {
+        QueryFanOut::Query &query = fanOut.queries[i];
+        for (std::list<std::vector<WCHAR> >::iterator iMessage = query.log.messages.begin();
+             iMessage != query.log.messages.end();
+             iMessage++)
+          TVPAddLog(&(*iMessage)[0]);
+
+        tTJSVariant result, error;
+        if (query.failed)
+          error = ttstr(&query.log.error[0]);
+        else if (! query.statement)
+          error = ttstr(connectError);
+        else {
+          result = query.statement->getAsyncResult(queryResultType);
+          mProfiler.record(sqlStrings[i], query.statement->getProfile());
+        }
+        resultsObj.SetValue(i, result);
+        if (error.Type() == tvtVoid)
+          continue;
+        if (errors.Type() == tvtObject)
+          errorsObj.SetValue(i, error);
+        else if (! failed) {
+          firstError = error;
+          failed = true;
+        }
+      }
+    } catch (...) {
+      releaseFanOut(fanOut);
+      throw;
+    }
+    releaseFanOut(fanOut);
+
+    if (failed)
+      TVPThrowExceptionMessage(firstError.c_str());
+    return results;
+  }
+
+  //----------------------------------------------------------------------
+  static tjs_error TJS_INTF_METHOD queryBatch(tTJSVariant *result,
+                                              tjs_int numparams,
+                                              tTJSVariant **param,
+                                              iTJSDispatch2 *objthis) {
+    ODBC *self = ncbInstanceAdaptor<ODBC>::GetNativeInstance(objthis);
+    if (! self) 
+      return TJS_E_NATIVECLASSCRASH;
+    if (numparams == 0)
+      return TJS_E_BADPARAMCOUNT;
+    ttstr sqlStr;
+    sqlStr = *param[0];
+    QueryResultType queryResultType = qrtArray;
+    if (numparams >= 2)
+      queryResultType = QueryResultType(tjs_int(*param[1]));
+    tTJSVariant queryResult;
+    queryResult = self->_queryBatch(sqlStr, queryResultType);
+    if (result)
+      *result = queryResult;
+    return TJS_S_OK;
+  }
+
+  //----------------------------------------------------------------------
+  tTJSVariant _queryBatch(ttstr sqlString, QueryResultType queryResultType) {
+    if (! mIsConnected) 
+      TVPThrowExceptionMessage(L"SQL connection is not established.");
+    noteWrite(sqlString);
+
+    Statement *statement = acquireStatement();
+    statement->resetProfile();
+    tTJSVariant result;
+    try {
+      result = statement->execDirectBatch(sqlString, queryResultType, mOptions);
+    } catch (...) {
+      recycleStatement(statement);
+      throw;
+    }
+    mProfiler.record(sqlString, statement->getProfile());
+    recycleStatement(statement);
+    countStatement();
+    return result;
+  }
+
+  //----------------------------------------------------------------------
+  static tjs_error TJS_INTF_METHOD queryCached(tTJSVariant *result,
+                                               tjs_int numparams,
+                                               tTJSVariant **param,
+                                               iTJSDispatch2 *objthis) {
+    ODBC *self = ncbInstanceAdaptor<ODBC>::GetNativeInstance(objthis);
+    if (! self) 
+      return TJS_E_NATIVECLASSCRASH;
+    if (numparams == 0)
+      return TJS_E_BADPARAMCOUNT;
+    ttstr sqlStr;
+    sqlStr = *param[0];
+    QueryResultType queryResultType = qrtArray;
+    if (numparams >= 2)
+      queryResultType = QueryResultType(tjs_int(*param[1]));
+    tTJSVariant tags;
+    if (numparams >= 3)
+      tags = *param[2];
+    tTJSVariant queryResult;
+    queryResult = self->_queryCached(sqlStr, queryResultType, tags);
+    if (result)
+      *result = queryResult;
+    return TJS_S_OK;
+  }
+
+  //----------------------------------------------------------------------
+  // the result is kept natively, and built again while it is cached.
+  // tags are the table names that invalidate it, the tables after FROM
+  // and JOIN by default.
+  tTJSVariant _queryCached(ttstr sqlString, QueryResultType queryResultType, tTJSVariant tags) {
+    if (! mIsConnected) 
+      TVPThrowExceptionMessage(L"SQL connection is not established.");
+
+    const Statement::Snapshot *snapshot = mResultCache.lookup(sqlString, queryResultType, mOptions.decimalMode);
+    if (! snapshot)
+      noteWrite(sqlString);
+
+    Statement *statement = acquireStatement();
+    statement->resetProfile();
+    tTJSVariant result;
+    try {
+      Statement::Snapshot stored;
+      if (snapshot)
+        result = statement->restoreSnapshot(*snapshot, queryResultType, mOptions);
+      else if (statement->execDirectSnapshot(sqlString, queryResultType, mOptions, result, stored)) {
+        std::vector<ttstr> tables;
+        if (tags.Type() == tvtVoid)
+          findReadTables(sqlString, tables);
+        else
+          getTableNames(tags, tables);
+        mResultCache.store(sqlString, queryResultType, mOptions.decimalMode, tables, stored);
+      }
+    } catch (...) {
+      recycleStatement(statement);
+      throw;
+    }
+    mProfiler.record(sqlString, statement->getProfile());
+    recycleStatement(statement);
+    return result;
+  }
+
+  //----------------------------------------------------------------------
+  static tjs_error TJS_INTF_METHOD invalidate(tTJSVariant *result,
+                                              tjs_int numparams,
+                                              tTJSVariant **param,
+                                              iTJSDispatch2 *objthis) {
+    ODBC *self = ncbInstanceAdaptor<ODBC>::GetNativeInstance(objthis);
+    if (! self) 
+      return TJS_E_NATIVECLASSCRASH;
+    if (numparams == 0 || param[0]->Type() == tvtVoid) {
+      self->mResultCache.clear();
+      return TJS_S_OK;
+    }
+    std::vector<ttstr> tables;
+    getTableNames(*param[0], tables);
+    self->mResultCache.invalidate(tables);
+    return TJS_S_OK;
+  }
+
+  //----------------------------------------------------------------------
+  // executes the sql on a worker thread, and calls the callback with the
+  // result on the main thread. queries of a connection run in order.
+  void queryAsync(ttstr sqlString, tjs_int queryResultType, tTJSVariant callback) {
+    if (! mIsConnected) 
+      TVPThrowExceptionMessage(L"SQL connection is not established.");
+
+    AsyncDispatcher *dispatcher = getAsyncDispatcher();
+    AsyncQuery *query = new AsyncQuery();
+    query->owner = this;
+    query->statement = NULL;
+    query->sql.assign(sqlString.c_str(), sqlString.c_str() + sqlString.length() + 1);
+    query->queryResultType = QueryResultType(queryResultType);
+    query->options = mOptions;
+    query->callback = callback;
+    query->failed = false;
+    query->done = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (! query->done) {
+      delete query;
+      TVPThrowExceptionMessage(L"Unable to create an event");
+    }
+    
+    noteWrite(sqlString);
+    mAsyncQueries.push_back(query);
+    if (mAsyncQueries.size() == 1)
+      startAsyncQuery(dispatcher);
+  }
+
+  //----------------------------------------------------------------------
+  // called on the main thread when the worker finished the first query.
+  void finishAsyncQuery(AsyncQuery *query) {
+    mAsyncQueries.pop_front();
+
+    // results cached while the query ran may miss its changes.
+    noteWrite(ttstr(&query->sql[0]));
+
+    for (std::list<std::vector<WCHAR> >::iterator iMessage = query->log.messages.begin();
+         iMessage != query->log.messages.end();
+         iMessage++)
+      TVPAddLog(&(*iMessage)[0]);
+
+    tTJSVariant result, error;
+    if (query->failed) {
+      // the statement may be left in any state.
+      error = ttstr(&query->log.error[0]);
+      EnterCriticalSection(&mRunningLock);
+      delete mAsyncStatement;
+      mAsyncStatement = NULL;
+      LeaveCriticalSection(&mRunningLock);
+    } else {
+      try {
+        result = mAsyncStatement->getAsyncResult(query->queryResultType);
+        mProfiler.record(ttstr(&query->sql[0]), mAsyncStatement->getProfile());
+      } catch (...) {
+        mAsyncStatement->closeCursor();
+        deleteAsyncQuery(query);
+        if (! mAsyncQueries.empty())
+          startAsyncQuery(asyncDispatcher);
+        throw;
+      }
+    }
+
+    tTJSVariant callback = query->callback;
+    deleteAsyncQuery(query);
+    if (! mAsyncQueries.empty())
+      startAsyncQuery(asyncDispatcher);
+
+    if (callback.Type() == tvtObject) {
+      tTJSVariant *args[] = { &result, &error };
+      callback.AsObjectClosureNoAddRef().FuncCall(0, NULL, NULL, NULL, 2, args, NULL);
+    }
+    countStatement();
+  }
+
+  //----------------------------------------------------------------------
+  tTJSVariant executeBatch(ttstr sqlString, tTJSVariant rows) {
+    if (! mIsConnected) 
+      TVPThrowExceptionMessage(L"SQL connection is not established.");
+    noteWrite(sqlString);
+
+    Statement *statement = checkoutStatement(sqlString);
+    statement->resetProfile();
+    tTJSVariant result;
+    try {
+      result = statement->executeBatch(rows, mBatchSize);
+    } catch (...) {
+      statement->reset();
+      checkinStatement(statement);
+      throw;
+    }
+    mProfiler.record(sqlString, statement->getProfile());
+    checkinStatement(statement);
+    countStatement();
+    return result;
+  }
+
+  //----------------------------------------------------------------------
+  static tjs_error TJS_INTF_METHOD prepare(tTJSVariant *result,
+                                           tjs_int numparams,
+                                           tTJSVariant **param,
+                                           iTJSDispatch2 *objthis);
+
+  //----------------------------------------------------------------------
+  tTJSVariant executeStatement(Statement *statement, tTJSVariant params, QueryResultType queryResultType) {
+    if (! mIsConnected) 
+      TVPThrowExceptionMessage(L"SQL connection is not established.");
+    noteWrite(statement->getSql());
+    waitAsyncQuery();
+    clearCancel(statement);
+    statement->resetProfile();
+    tTJSVariant result;
+    try {
+      result = statement->execute(params, queryResultType, mOptions);
+    } catch (...) {
+      // the script still holds the statement.
+      statement->reset();
+      throw;
+    }
+    mProfiler.record(statement->getSql(), statement->getProfile());
+    countStatement();
+    return result;
+  }
+
+  //----------------------------------------------------------------------
+  tTJSVariant executeStatementBatch(Statement *statement, tTJSVariant rows) {
+    if (! mIsConnected) 
+      TVPThrowExceptionMessage(L"SQL connection is not established.");
+    noteWrite(statement->getSql());
+    waitAsyncQuery();
+    clearCancel(statement);
+    statement->resetProfile();
+    tTJSVariant result;
+    try {
+      result = statement->executeBatch(rows, mBatchSize);
+    } catch (...) {
+      // the script still holds the statement.
+      statement->reset();
+      throw;
+    }
+    mProfiler.record(statement->getSql(), statement->getProfile());
+    countStatement();
+    return result;
+  }
+
+  //----------------------------------------------------------------------
+  // cancels the running queries: the statements of the open cursors, the
+  // asynchronous query and the queries of queryAll. safe to call from a
+  // timer or another thread while they fetch.
+  void cancel(void) {
+    EnterCriticalSection(&mRunningLock);
+    for (statements::iterator iStatement = mRunningStatements.begin();
+         iStatement != mRunningStatements.end();
+         iStatement++)
+      (*iStatement)->cancel();
+    if (mAsyncStatement)
+      mAsyncStatement->cancel();
+    if (mRunningFanOut)
+      mRunningFanOut->cancel();
+    LeaveCriticalSection(&mRunningLock);
+  }
+
+  //----------------------------------------------------------------------
+  static tjs_error TJS_INTF_METHOD openCursor(tTJSVariant *result,
+                                              tjs_int numparams,
+                                              tTJSVariant **param,
+                                              iTJSDispatch2 *objthis);
+
+  //----------------------------------------------------------------------
+  // waits until the worker of the running asynchronous query leaves the
+  // connection. the next one starts only when its result was passed back
+  // on the main thread.
+  void waitAsyncQuery() {
+    if (! mAsyncQueries.empty())
+      WaitForSingleObject(mAsyncQueries.front()->done, INFINITE);
+  }
+
+  //----------------------------------------------------------------------
+  // a statement held by a script object stays running while it is held.
+  // a cancel of an earlier call is forgotten when the next one starts, and
+  // one made after this is kept.
+  void clearCancel(Statement *statement) {
+    EnterCriticalSection(&mRunningLock);
+    statement->clearCancel();
+    LeaveCriticalSection(&mRunningLock);
+  }
+
+  //----------------------------------------------------------------------
+  // a statement held by a script object is no longer used.
+  // prepared statements go back to the cache, others to the idle statements.
+  void releaseStatement(StatementHolder *holder, Statement *statement) {
+    waitAsyncQuery();
+    mStatementHolders.remove(holder);
+    if (statement->getSql().IsEmpty())
+      recycleStatement(statement);
+    else
+      checkinStatement(statement);
+  }
+
+private:
+  //----------------------------------------------------------------------
+  void setAutoCommit(bool autoCommit) {
+    if (mAutoCommit == autoCommit)
+      return;
+    waitAsyncQuery();
+    TRYODBC(mHDbc,
+            SQL_HANDLE_DBC,
+            SQLSetConnectAttr(mHDbc,
+                              SQL_ATTR_AUTOCOMMIT,
+                              (SQLPOINTER)(autoCommit ? SQL_AUTOCOMMIT_ON : SQL_AUTOCOMMIT_OFF),
+                              SQL_IS_UINTEGER));
+    mAutoCommit = autoCommit;
+  }
+
+  //----------------------------------------------------------------------
+  // autocommit is off while a transaction or commit batching is on.
+  void updateAutoCommit() {
+    if (! mIsConnected || mTransaction)
+      return;
+    bool autoCommit = mCommitInterval == 0 && mCommitTime == 0;
+    if (autoCommit && mUncommitted > 0)
+      endTransaction(SQL_COMMIT);
+    setAutoCommit(autoCommit);
+  }
+
+  //----------------------------------------------------------------------
+  void applyIsolationLevel() {
+    if (! mIsolationLevel)
+      return;
+    waitAsyncQuery();
+    if (! mIsolationChanged) {
+      SQLUINTEGER level = 0;
+      if (! SQL_SUCCEEDED(SQLGetConnectAttr(mHDbc, SQL_ATTR_TXN_ISOLATION, &level, SQL_IS_UINTEGER, NULL)))
+        level = 0;
+      mSessionIsolationLevel = level;
+      mIsolationChanged = true;
+    }
+    TRYODBC(mHDbc,
+            SQL_HANDLE_DBC,
+            SQLSetConnectAttr(mHDbc,
+                              SQL_ATTR_TXN_ISOLATION,
+                              (SQLPOINTER)SQLULEN(mIsolationLevel),
+                              SQL_IS_UINTEGER));
+  }
+
+  //----------------------------------------------------------------------
+  void endTransaction(SQLSMALLINT completionType) {
+    if (mCommitHooked) {
+      TVPRemoveContinuousEventHook(this);
+      mCommitHooked = false;
+    }
+    mUncommitted = 0;
+    waitAsyncQuery();
+    TRYODBC(mHDbc,
+            SQL_HANDLE_DBC,
+            SQLEndTran(SQL_HANDLE_DBC, mHDbc, completionType));
+  }
+
+  //----------------------------------------------------------------------
+  // counts an executed statement while batching commits. the statements
+  // are committed every mCommitInterval, while no asynchronous query runs.
+  void countStatement() {
+    if (mTransaction || mAutoCommit)
+      return;
+    if (mUncommitted++ == 0)
+      mUncommittedSince = GetTickCount();
+    if (mCommitTime > 0 && ! mCommitHooked) {
+      TVPAddContinuousEventHook(this);
+      mCommitHooked = true;
+    }
+    if (mCommitInterval > 0
+        && mUncommitted >= mCommitInterval
+        && mAsyncQueries.empty())
+      endTransaction(SQL_COMMIT);
+  }
+
+  //----------------------------------------------------------------------
+  // drops the cached results of the tables the sql changes.
+  void noteWrite(const ttstr &sqlString) {
+    if (mResultCache.empty())
+      return;
+    std::vector<ttstr> tables;
+    findWrittenTables(sqlString, tables);
+    if (! tables.empty())
+      mResultCache.invalidate(tables);
+  }
+
+  //----------------------------------------------------------------------
+  // options of exportQuery from a dictionary. params are the parameters
+  // of the sql.
+  static void getExportOptions(ExportFormat format, tTJSVariant options,
+                               ExportOptions &exportOptions, tTJSVariant &params) {
+    if (format != efCSV && format != efTSV && format != efJSONLines)
+      TVPThrowExceptionMessage(L"Unknown export format.");
+    exportOptions.format = format;
+    exportOptions.quoting = eqMinimal;
+    exportOptions.encoding = eeUTF8;
+    exportOptions.header = true;
+    exportOptions.delimiter = format == efTSV ? L"\t" : L",";
+    exportOptions.newline = format == efJSONLines ? L"\n" : L"\r\n";
+    exportOptions.nullText = L"";
+    if (options.Type() != tvtObject)
+      return;
+
+    ncbPropAccessor optionsObj(options);
+    tTJSVariant value;
+    if ((value = optionsObj.GetValue(L"header", ncbTypedefs::Tag<tTJSVariant>())).Type() != tvtVoid)
+      exportOptions.header = value.operator bool();
+    if ((value = optionsObj.GetValue(L"quote", ncbTypedefs::Tag<tTJSVariant>())).Type() != tvtVoid)
+      exportOptions.quoting = ExportQuoting(tjs_int(value));
+    if ((value = optionsObj.GetValue(L"encoding", ncbTypedefs::Tag<tTJSVariant>())).Type() != tvtVoid)
+      exportOptions.encoding = ExportEncoding(tjs_int(value));
+    if ((value = optionsObj.GetValue(L"delimiter", ncbTypedefs::Tag<tTJSVariant>())).Type() != tvtVoid)
+      exportOptions.delimiter = value;
+    if ((value = optionsObj.GetValue(L"newline", ncbTypedefs::Tag<tTJSVariant>())).Type() != tvtVoid)
+      exportOptions.newline = value;
+    if ((value = optionsObj.GetValue(L"null", ncbTypedefs::Tag<tTJSVariant>())).Type() != tvtVoid)
+      exportOptions.nullText = value;
+    params = optionsObj.GetValue(L"params", ncbTypedefs::Tag<tTJSVariant>());
+  }
+
+  //----------------------------------------------------------------------
+  // queryTimeout, maxRows and maxBytes of a call, over the ones of the
+  // connection.
+  static void getLimitOptions(tTJSVariant options, FetchOptions &fetchOptions) {
+    if (options.Type() != tvtObject)
+      return;
+
+    ncbPropAccessor optionsObj(options);
+    tTJSVariant value;
+    if ((value = optionsObj.GetValue(L"queryTimeout", ncbTypedefs::Tag<tTJSVariant>())).Type() != tvtVoid)
+      fetchOptions.queryTimeout = SQLULEN(std::max(tjs_int(value), 0));
+    if ((value = optionsObj.GetValue(L"maxRows", ncbTypedefs::Tag<tTJSVariant>())).Type() != tvtVoid)
+      fetchOptions.maxRows = SQLULEN(std::max(tjs_int(value), 0));
+    if ((value = optionsObj.GetValue(L"maxBytes", ncbTypedefs::Tag<tTJSVariant>())).Type() != tvtVoid)
+      fetchOptions.maxBytes = std::max(tjs_int64(value), tjs_int64(0));
+  }
+
+  //----------------------------------------------------------------------
+  // returns the worker connections of queryAll to the pool.
+  void releaseFanOut(QueryFanOut &fanOut) {
+    fanOut.freeStatements();
+    ConnectionPool *pool = getConnectionPool();
+    for (std::vector<QueryFanOut::Worker>::iterator iWorker = fanOut.workers.begin();
+         iWorker != fanOut.workers.end();
+         iWorker++) {
+      if (iWorker->connected)
+        pool->checkin(iWorker->hDbc, mConnectionStr, ttstr(&iWorker->completed[0]));
+      else
+        pool->closeConnection(iWorker->hDbc, false);
+    }
+    fanOut.workers.clear();
+  }
+
+  //----------------------------------------------------------------------
+  // a table name, or an array of them.
+  static void getTableNames(tTJSVariant names, std::vector<ttstr> &tables) {
+    if (names.Type() != tvtObject) {
+      ttstr name = names;
+      tables.push_back(foldTableName(name.c_str(), name.length()));
+      return;
+    }
+    ncbPropAccessor namesObj(names);
+    tjs_uint count = countArray(names);
+    for (tjs_uint i = 0; i < count; i++) {
+      ttstr name = namesObj.GetValue(tjs_int(i), ncbTypedefs::Tag<tTJSVariant>());
+      tables.push_back(foldTableName(name.c_str(), name.length()));
+    }
+  }
+
+  //----------------------------------------------------------------------
+  Statement *acquireStatement() {
+    waitAsyncQuery();
+    Statement *statement;
+    if (mIdleStatements.empty())
+      statement = new Statement(mHDbc, &mColumnCache, &mConnectionLock);
+    else {
+      statement = mIdleStatements.front();
+      mIdleStatements.pop_front();
+    }
+    addRunningStatement(statement);
+    return statement;
+  }
+
+  //----------------------------------------------------------------------
+  void recycleStatement(Statement *statement) {
+    removeRunningStatement(statement);
+    statement->reset();
+    mIdleStatements.push_front(statement);
+    trimIdleStatements();
+  }
+
+  //----------------------------------------------------------------------
+  void trimIdleStatements() {
+    while (mIdleStatements.size() > size_t(mStatementPoolSize)) {
+      delete mIdleStatements.back();
+      mIdleStatements.pop_back();
+    }
+  }
+
+  //----------------------------------------------------------------------
+  void startAsyncQuery(AsyncDispatcher *dispatcher) {
+    if (! mAsyncStatement) {
+      Statement *statement = new Statement(mHDbc, &mColumnCache, &mConnectionLock);
+      EnterCriticalSection(&mRunningLock);
+      mAsyncStatement = statement;
+      LeaveCriticalSection(&mRunningLock);
+    }
+    AsyncQuery *query = mAsyncQueries.front();
+    query->statement = mAsyncStatement;
+    mAsyncStatement->clearCancel();
+    mAsyncStatement->resetProfile();
+    dispatcher->submit(query);
+  }
+
+  //----------------------------------------------------------------------
+  static void deleteAsyncQuery(AsyncQuery *query) {
+    CloseHandle(query->done);
+    delete query;
+  }
+
+  //----------------------------------------------------------------------
+  Statement *checkoutStatement(ttstr sqlString) {
+    waitAsyncQuery();
+    for (statements::iterator iStatement = mStatementCache.begin();
+         iStatement != mStatementCache.end();
+         iStatement++) {
+      if ((*iStatement)->getSql() == sqlString) {
+        Statement *statement = *iStatement;
+        mStatementCache.erase(iStatement);
+        mStatementCacheHits++;
+        addRunningStatement(statement);
+        return statement;
+      }
+    }
+
+    mStatementCacheMisses++;
+    Statement *statement = new Statement(mHDbc, &mColumnCache, &mConnectionLock);
+    try {
+      statement->prepare(sqlString);
+    } catch (...) {
+      delete statement;
+      throw;
+    }
+    addRunningStatement(statement);
+    return statement;
+  }
+
+  //----------------------------------------------------------------------
+  void checkinStatement(Statement *statement) {
+    removeRunningStatement(statement);
+    mStatementCache.push_front(statement);
+    trimStatementCache();
+  }
+
+  //----------------------------------------------------------------------
+  void trimStatementCache() {
+    while (mStatementCache.size() > size_t(mStatementCacheSize)) {
+      delete mStatementCache.back();
+      mStatementCache.pop_back();
+    }
+  }
+
+  //----------------------------------------------------------------------
+  void addRunningStatement(Statement *statement) {
+    statement->clearCancel();
+    EnterCriticalSection(&mRunningLock);
+    mRunningStatements.push_back(statement);
+    LeaveCriticalSection(&mRunningLock);
+  }
+
+  void removeRunningStatement(Statement *statement) {
+    EnterCriticalSection(&mRunningLock);
+    mRunningStatements.remove(statement);
+    LeaveCriticalSection(&mRunningLock);
+  }
+
+  void setRunningFanOut(QueryFanOut *fanOut) {
+    EnterCriticalSection(&mRunningLock);
+    mRunningFanOut = fanOut;
+    LeaveCriticalSection(&mRunningLock);
+  }
+
+public:
+  //----------------------------------------------------------------------
+  static tjs_error TJS_INTF_METHOD escapeString(tTJSVariant *result,
+                                                tjs_int numparams,
+                                                tTJSVariant **param,
+                                                iTJSDispatch2 *objthis) {
+    if (numparams == 0) return TJS_E_BADPARAMCOUNT;
+    ttstr str = *param[0];
+    ttstr func, delimiter = L" + ";
+    if (numparams >= 2)
+      func = *param[1];
+    if (numparams >= 3)
+      delimiter = *param[2];
+    ttstr resultString = _escapeString(str, func, delimiter);
+    if (result)
+      *result = resultString;
+    return TJS_S_OK;
+  }
     
-    switch(retCode)
-      {
-      case SQL_SUCCESS_WITH_INFO:
-        {
-          dumpDiagnosticRecord(mHStmt, SQL_HANDLE_STMT, retCode);
-          // fall through
-        }
-      case SQL_SUCCESS:
+  //----------------------------------------------------------------------
+  // quoted runs joined with CHAR() of the quotes and control characters,
+  // and of the backslashes when they are escapes in the quotes.
+  static ttstr _escapeString(ttstr str, ttstr func, ttstr delimiter, bool backslash = false) {
+    std::vector<tjs_char> buf;
+    buf.reserve(func.length() + str.length() + 16);
+    appendText(buf, func.c_str());
+    buf.push_back(L'(');
+
+    const tjs_char *s = str.c_str();
+    bool quoted = false, first = true;
+    for (; *s; s++) {
+      bool special = (*s) < 0x20 || (*s) == L'\'' || (backslash && (*s) == L'\\');
+      if (quoted && ! special) {
+        buf.push_back(*s);
+        continue;
+      }
+      if (quoted) {
+        buf.push_back(L'\'');
+        quoted = false;
+      }
+      if (! first)
+        appendText(buf, delimiter.c_str());
+      first = false;
+      if (special) {
+        WCHAR code[16];
+        swprintf_s(code, 16, L"CHAR(%d)", tjs_int(*s));
+        appendText(buf, code);
+      } else {
+        buf.push_back(L'\'');
+        buf.push_back(*s);
+        quoted = true;
+      }
+    }
+    if (quoted)
+      buf.push_back(L'\'');
+    if (first)
+      appendText(buf, L"''");
+    buf.push_back(L')');
+    return ttstr(&buf[0], tjs_int(buf.size()));
+  }
+
+  //----------------------------------------------------------------------
+  // appends the literal of the string in the dialect.
+  static void appendLiteral(std::vector<tjs_char> &buf, const tjs_char *s, tjs_int length, EscapeDialect dialect) {
+    if (dialect == edGeneric) {
+      ttstr literal = _escapeString(ttstr(s, length), L"", L" + ");
+      buf.insert(buf.end(), literal.c_str(), literal.c_str() + literal.length());
+      return;
+    }
+
+    // the string is written as is, unless it needs escapes or N''.
+    const tjs_char *end = s + length;
+    bool control = false, wide = false, slash = false;
+    for (const tjs_char *c = s; c < end; c++) {
+      control = control || *c < 0x20;
+      wide = wide || *c >= 0x80;
+      slash = slash || *c == L'\\';
+    }
+
+    // mysql reads backslashes by its sql mode. CHAR() means the same in
+    // any mode.
+    if (dialect == edMySQL && (control || slash)) {
+      ttstr literal = _escapeString(ttstr(s, length), L"CONCAT", L", ", true);
+      buf.insert(buf.end(), literal.c_str(), literal.c_str() + literal.length());
+      return;
+    }
+    bool backslash = dialect == edPostgreSQL && control;
+
+    if (dialect == edSQLServer && wide)
+      buf.push_back(L'N');
+    if (dialect == edPostgreSQL && control)
+      buf.push_back(L'E');
+    buf.push_back(L'\'');
+    for (const tjs_char *c = s; c < end; c++) {
+      if (*c == L'\'') {
+        buf.push_back(L'\'');
+        buf.push_back(L'\'');
+        continue;
+      }
+      tjs_char escape = backslash ? backslashEscape(*c) : 0;
+      if (! escape) {
+        buf.push_back(*c);
+        continue;
+      }
+      buf.push_back(L'\\');
+      if (escape == L'x') {
+        WCHAR code[8];
+        swprintf_s(code, 8, L"x%02x", tjs_int(*c));
+        appendText(buf, code);
+      } else
+        buf.push_back(escape);
+    }
+    buf.push_back(L'\'');
+  }
+
+  //----------------------------------------------------------------------
+  // the letter after a backslash for the character, or 0 to write it as is.
+  static tjs_char backslashEscape(tjs_char c) {
+    switch (c) {
+    case L'\\': return L'\\';
+    case L'\n': return L'n';
+    case L'\r': return L'r';
+    case L'\t': return L't';
+    case L'\b': return L'b';
+    }
+    return c < 0x20 ? L'x' : 0;
+  }
+
+  //----------------------------------------------------------------------
+  static void appendText(std::vector<tjs_char> &buf, const tjs_char *text) {
+    for (; *text; text++)
+      buf.push_back(*text);
+  }
+
+  //----------------------------------------------------------------------
+  static ttstr escapeDialect(ttstr str, EscapeDialect dialect) {
+    std::vector<tjs_char> buf;
+    buf.reserve(str.length() + 16);
+    appendLiteral(buf, str.c_str(), str.length(), dialect);
+    return ttstr(&buf[0], tjs_int(buf.size()));
+  }
+
+  //----------------------------------------------------------------------
+  static ttstr escapeStringAccess(ttstr str) {
+    return escapeDialect(str, edAccess);
+  }
+
+  //----------------------------------------------------------------------
+  static ttstr escapeStringSQLServer(ttstr str) {
+    return escapeDialect(str, edSQLServer);
+  }
+
+  //----------------------------------------------------------------------
+  static ttstr escapeStringOracle(ttstr str) {
+    return escapeDialect(str, edOracle);
+  }
+
+  //----------------------------------------------------------------------
+  static ttstr escapeStringMySQL(ttstr str) {
+    return escapeDialect(str, edMySQL);
+  }
+
+  //----------------------------------------------------------------------
+  static ttstr escapeStringPostgreSQL(ttstr str) {
+    return escapeDialect(str, edPostgreSQL);
+  }
+
+  //----------------------------------------------------------------------
+  static tjs_error TJS_INTF_METHOD escapeStrings(tTJSVariant *result,
+                                                 tjs_int numparams,
+                                                 tTJSVariant **param,
+                                                 iTJSDispatch2 *objthis) {
+    if (numparams == 0) return TJS_E_BADPARAMCOUNT;
+    EscapeDialect dialect = edGeneric;
+    if (numparams >= 2)
+      dialect = EscapeDialect(tjs_int(*param[1]));
+    tTJSVariant resultArray = _escapeStrings(*param[0], dialect);
+    if (result)
+      *result = resultArray;
+    return TJS_S_OK;
+  }
+
+  //----------------------------------------------------------------------
+  // one buffer is reused for every string of the array.
+  static tTJSVariant _escapeStrings(tTJSVariant strs, EscapeDialect dialect) {
+    tTJSVariant result = createArray();
+    ncbPropAccessor resultObj(result);
+    ncbPropAccessor strsObj(strs);
+    tjs_uint count = countArray(strs);
+    std::vector<tjs_char> buf;
+    for (tjs_uint i = 0; i < count; i++) {
+      ttstr str = strsObj.GetValue(tjs_int(i), ncbTypedefs::Tag<tTJSVariant>());
+      buf.clear();
+      appendLiteral(buf, str.c_str(), str.length(), dialect);
+      resultObj.FuncCall(0, L"add", &addHint, NULL, ttstr(&buf[0], tjs_int(buf.size())));
+    }
+    return result;
+  }
+
+  //----------------------------------------------------------------------
+  static tjs_error TJS_INTF_METHOD buildInList(tTJSVariant *result,
+                                               tjs_int numparams,
+                                               tTJSVariant **param,
+                                               iTJSDispatch2 *objthis) {
+    if (numparams == 0) return TJS_E_BADPARAMCOUNT;
+    EscapeDialect dialect = edGeneric;
+    if (numparams >= 2)
+      dialect = EscapeDialect(tjs_int(*param[1]));
+    ttstr resultString = _buildInList(*param[0], dialect);
+    if (result)
+      *result = resultString;
+    return TJS_S_OK;
+  }
+
+  //----------------------------------------------------------------------
+  // "(v1, v2, ...)" for IN. an empty array makes "(NULL)", which matches
+  // no rows.
+  static ttstr _buildInList(tTJSVariant values, EscapeDialect dialect) {
+    ncbPropAccessor valuesObj(values);
+    tjs_uint count = countArray(values);
+    std::vector<tjs_char> buf;
+    buf.reserve(count * 8 + 8);
+    buf.push_back(L'(');
+    for (tjs_uint i = 0; i < count; i++) {
+      if (i > 0)
+        appendText(buf, L", ");
+      tTJSVariant value = valuesObj.GetValue(tjs_int(i), ncbTypedefs::Tag<tTJSVariant>());
+      switch (value.Type()) {
+      case tvtVoid:
+        appendText(buf, L"NULL");
+        break;
+      case tvtInteger:
+      case tvtReal:
+        appendText(buf, ttstr(value).c_str());
+        break;
+      case tvtOctet:
         {
-          // If this is a row-returning query, display
-          // results
-          TRYODBC(mHStmt,
-                  SQL_HANDLE_STMT,
-                  SQLNumResultCols(mHStmt,&numResults));
-          
-          if (numResults > 0) {
-            result = fetchResults(numResults);
-            switch (queryResultType) {
-            case qrtArray: break;
-            case qrtDictionary: result = convertQueryResultToDictionary(result); break;
-            case qrtSingleColumnArray: result = convertQueryResultToSingleColumnArray(result); break;
-            }
+          tTJSVariantOctet *octet = value.AsOctetNoAddRef();
+          const tjs_uint8 *data = octet ? octet->GetData() : NULL;
+          tjs_uint length = octet ? octet->GetLength() : 0;
+          appendText(buf, dialect == edSQLServer || dialect == edAccess ? L"0x" : L"X'");
+          for (tjs_uint j = 0; j < length; j++) {
+            WCHAR hex[4];
+            swprintf_s(hex, 4, L"%02X", data[j]);
+            appendText(buf, hex);
           }
-          else
-            dumpAffectedRows(mHStmt);
+          if (dialect != edSQLServer && dialect != edAccess)
+            buf.push_back(L'\'');
           break;
         }
-        
-      case SQL_ERROR:
-        {
-          dumpDiagnosticRecord(mHStmt, SQL_HANDLE_STMT, retCode);
-          break;
+      default:
+        if (isDateObject(value))
+          appendText(buf, encodeDate(value).c_str());
+        else {
+          ttstr str = value;
+          appendLiteral(buf, str.c_str(), str.length(), dialect);
         }
-        
-      default: {
-        WCHAR buf[1024];                                                
-        swprintf_s(buf, 1023, L"Unexpected return code %hd!", retCode);
-        TVPThrowExceptionMessage(buf);
-      }
+        break;
       }
+    }
+    if (count == 0)
+      appendText(buf, L"NULL");
+    buf.push_back(L')');
+    return ttstr(&buf[0], tjs_int(buf.size()));
+  }
+
+  //----------------------------------------------------------------------
+  static ttstr encodeDate(tTJSVariant _date) {
+    // Date object, or milliseconds since the epoch as returned in dtmTime mode
+    tjs_int64 time;
+    if (_date.Type() == tvtObject)
+      time = getDateTime(_date);
+    else
+      time = tjs_int64(_date);
+    SQL_TIMESTAMP_STRUCT ts = timeToTimestamp(time);
+    WCHAR buf[1024];
+    swprintf_s(buf,
+               1024,
+               L"'%04d-%02d-%02d %02d:%02d:%02d'",
+               tjs_int(ts.year),
+               tjs_int(ts.month),
+               tjs_int(ts.day),
+               tjs_int(ts.hour),
+               tjs_int(ts.minute),
+               tjs_int(ts.second));
+    return ttstr(buf);
+  }
+};
 
-    return result;
+//----------------------------------------------------------------------
+// ODBCStatement class
+//----------------------------------------------------------------------
+class ODBCStatement : public StatementHolder
+{
+  ttstr       mSql;
+
+public:
+  //----------------------------------------------------------------------
+  ODBCStatement(ODBC *owner, Statement *statement)
+    : StatementHolder(owner, statement)
+    , mSql(statement->getSql())
+  {
   }
 
   //----------------------------------------------------------------------
-  tTJSVariant fetchResults(SQLSMALLINT cCols) {
-    tTJSVariant result;
-    result = createArray();
-    ncbPropAccessor resultObj(result);
-    
-    allocateBindings(cCols);
-    tTJSVariant titles = fetchTitles();
-    resultObj.FuncCall(0, L"add", &addHint, NULL, titles);
+  ~ODBCStatement() {
+    close();
+  }
 
-    RETCODE         RetCode = SQL_SUCCESS;
-    bool fNoData = false;
-    
-    do {
-      tTJSVariant columns = fetchColumns();
-      if (columns.Type() == tvtVoid)
-        fNoData = true;
-      else 
-        resultObj.FuncCall(0, L"add", &addHint, NULL, columns);
-    } while (! fNoData);
-        
-    freeBindings();
-    
-    return result;
+  //----------------------------------------------------------------------
+  ttstr getSql() {
+    return mSql;
   }
 
   //----------------------------------------------------------------------
-  void allocateBindings(SQLSMALLINT   cCols) {
-    freeBindings();
-    
-    SQLSMALLINT     col;
-    SQLLEN          columnLength;
-    
-    for (col = 1; col <= cCols; col++) {
-      Binding binding = {};
+  static tjs_error TJS_INTF_METHOD execute(tTJSVariant *result,
+                                           tjs_int numparams,
+                                           tTJSVariant **param,
+                                           iTJSDispatch2 *objthis) {
+    ODBCStatement *self = ncbInstanceAdaptor<ODBCStatement>::GetNativeInstance(objthis);
+    if (! self) 
+      return TJS_E_NATIVECLASSCRASH;
+    tTJSVariant params;
+    if (numparams >= 1)
+      params = *param[0];
+    QueryResultType queryResultType = qrtArray;
+    if (numparams >= 2)
+      queryResultType = QueryResultType(tjs_int(*param[1]));
+    tTJSVariant queryResult;
+    queryResult = self->_execute(params, queryResultType);
+    if (result)
+      *result = queryResult;
+    return TJS_S_OK;
+  }
 
-      // get column type
-      TRYODBC(mHStmt,
-              SQL_HANDLE_STMT,
-              SQLColAttribute(mHStmt,
-                              col,
-                              SQL_DESC_CONCISE_TYPE,
-                              NULL,
-                              0,
-                              NULL,
-                              &binding.type));
-      
-      // get column length 
-      TRYODBC(mHStmt,
-              SQL_HANDLE_STMT,
-              SQLColAttribute(mHStmt,
-                              col,
-                              SQL_DESC_LENGTH,
-                              NULL,
-                              0,
-                              NULL,
-                              &columnLength));
+  //----------------------------------------------------------------------
+  tTJSVariant _execute(tTJSVariant params, QueryResultType queryResultType) {
+    if (! mStatement)
+      TVPThrowExceptionMessage(L"Statement is already closed.");
+    return mOwner->executeStatement(mStatement, params, queryResultType);
+  }
 
-      // allocate column buffer.
-      binding.buffer = (WCHAR *)malloc((columnLength+1) * sizeof(WCHAR));
+  //----------------------------------------------------------------------
+  tTJSVariant executeBatch(tTJSVariant rows) {
+    if (! mStatement)
+      TVPThrowExceptionMessage(L"Statement is already closed.");
+    return mOwner->executeStatementBatch(mStatement, rows);
+  }
 
-      // bind buffer to column
-      TRYODBC(mHStmt,
-              SQL_HANDLE_STMT,
-              SQLBindCol(mHStmt,
-                         col,
-                         SQL_C_TCHAR,
-                         (SQLPOINTER) binding.buffer,
-                         (columnLength + 1) * sizeof(WCHAR),
-                         &binding.ind));
+  //----------------------------------------------------------------------
+  void close(void) {
+    if (mStatement)
+      {
+        mOwner->releaseStatement(this, mStatement);
+        mStatement = NULL;
+      }
+  }
+};
 
-      mBindings.push_back(binding);
-    }
+//----------------------------------------------------------------------
+// ODBCCursor class
+//----------------------------------------------------------------------
+class ODBCCursor : public StatementHolder
+{
+  QueryResultType mQueryResultType;
+  tTJSVariant     mColumns;
+
+public:
+  //----------------------------------------------------------------------
+  ODBCCursor(ODBC *owner, Statement *statement, QueryResultType queryResultType)
+    : StatementHolder(owner, statement)
+    , mQueryResultType(queryResultType)
+    , mColumns(statement->getTitles())
+  {
   }
 
   //----------------------------------------------------------------------
-  void freeBindings() {
-    for (bindings::iterator iBinding = mBindings.begin();
-         iBinding != mBindings.end();
-         iBinding++) 
-      free(iBinding->buffer);
+  ~ODBCCursor() {
+    close();
+  }
 
-    mBindings.clear();
+  //----------------------------------------------------------------------
+  tTJSVariant getColumns() {
+    return mColumns;
   }
 
   //----------------------------------------------------------------------
-  tTJSVariant  fetchTitles() {
+  tTJSVariant fetch(tjs_int count) {
     tTJSVariant result = createArray();
     ncbPropAccessor resultObj(result);
-
-    SQLSMALLINT col, colBegin, colEnd;
-    SQLSMALLINT titleLength;
-      
-    titleLength = 0;
-    colBegin = 1;
-    colEnd = SQLSMALLINT(mBindings.size() + 1);
-
-    for (col = colBegin; col < colEnd; col++) {
-      SQLSMALLINT columnNameLength;
-      TRYODBC(mHStmt,
-              SQL_HANDLE_STMT,
-              SQLColAttribute(mHStmt,
-                              col,
-                              SQL_DESC_NAME,
-                              NULL,
-                              0,
-                              &columnNameLength,
-                              NULL));
-      titleLength = std::max(titleLength, SQLSMALLINT(columnNameLength / 2));
-    }
-
-    WCHAR *wszTitle = new WCHAR[titleLength + 1];
-    
-    for (col = colBegin; col < colEnd; col++) {
-      TRYODBC(mHStmt,
-              SQL_HANDLE_STMT,
-              SQLColAttribute(mHStmt,
-                              col,
-                              SQL_DESC_NAME,
-                              wszTitle,
-                              (titleLength + 1) * sizeof(WCHAR),
-                              NULL,
-                              NULL));
-      
-      resultObj.FuncCall(0, L"add", &addHint, NULL, ttstr(wszTitle));
+    for (tjs_int i = 0; i < count; i++) {
+      tTJSVariant row = fetchOne();
+      if (row.Type() == tvtVoid)
+        break;
+      resultObj.FuncCall(0, L"add", &addHint, NULL, row);
     }
-    delete[] wszTitle;
-    
     return result;
   }
 
   //----------------------------------------------------------------------
-  tTJSVariant fetchColumns() {
-    RETCODE         RetCode = SQL_SUCCESS;
-    tTJSVariant result;
-
-    TRYODBC(mHStmt, SQL_HANDLE_STMT, RetCode = SQLFetch(mHStmt));
-    
-    if (RetCode == SQL_NO_DATA_FOUND)
-      return result;
-
-    result = createArray();
-    ncbPropAccessor resultObj(result);
+  tTJSVariant fetchOne() {
+    if (! mStatement)
+      return tTJSVariant();
+    mOwner->waitAsyncQuery();
+    mOwner->clearCancel(mStatement);
+    return mStatement->fetchRow(mQueryResultType);
+  }
 
-    for (bindings::iterator iBinding = mBindings.begin();
-         iBinding != mBindings.end();
-         iBinding++) {
-      if (iBinding->ind == SQL_NULL_DATA) {
-        resultObj.FuncCall(0, L"add", &addHint, NULL, tTJSVariant());
-      } else {          
-        tTJSVariant columnValue = ttstr(iBinding->buffer);
-        switch (iBinding->type) {
-        case SQL_SMALLINT:
-        case SQL_INTEGER:
-        case SQL_TINYINT:
-        case SQL_BIGINT:
-          columnValue.ToInteger();
-          break;
-        case SQL_DECIMAL:
-        case SQL_NUMERIC:
-        case SQL_REAL:
-        case SQL_FLOAT:
-        case SQL_DOUBLE:
-          columnValue.ToReal();
-          break;
-        case SQL_TYPE_DATE:
-        case SQL_TYPE_TIME:
-        case SQL_TYPE_TIMESTAMP: {
-          ttstr exp = L"new Date('" + ttstr(columnValue) + "')";
-          TVPExecuteExpression(exp, &columnValue);
-          break;
-        }
-        }
-        resultObj.FuncCall(0, L"add", &addHint, NULL, columnValue);
-      }
+  //----------------------------------------------------------------------
+  // calls the callback with each remaining row.
+  // stops early when the callback returns false.
+  tjs_int each(tTJSVariant callback) {
+    tTJSVariantClosure &closure = callback.AsObjectClosureNoAddRef();
+    tjs_int count = 0;
+    for (;;) {
+      tTJSVariant row = fetchOne();
+      if (row.Type() == tvtVoid)
+        break;
+      count++;
+      tTJSVariant ret;
+      tTJSVariant *args[] = { &row };
+      closure.FuncCall(0, NULL, NULL, &ret, 1, args, NULL);
+      if (ret.Type() != tvtVoid && ! bool(ret))
+        break;
     }
-    
-    return result;
+    return count;
   }
 
   //----------------------------------------------------------------------
-  tTJSVariant convertQueryResultToDictionary(tTJSVariant table) {
-    ncbPropAccessor tableObj(table);
+  void close(void) {
+    if (mStatement)
+      {
+        mStatement->closeCursor();
+        mOwner->releaseStatement(this, mStatement);
+        mStatement = NULL;
+      }
+  }
+};
 
-    tTJSVariant titleRow;
-    tableObj.FuncCall(0, L"shift", &shiftHint, &titleRow);
-    ncbPropAccessor titleRowObj(titleRow);
+//----------------------------------------------------------------------
+// ODBCResultSet class
+//----------------------------------------------------------------------
+// rows of a query with qrtResultSet, kept natively. the values are made
+// only when the script reads them.
+class ODBCResultSet
+{
+  Statement::Snapshot     *mSnapshot;
+  SnapshotFile            *mFile;     /* keeps the rows of a loaded snapshot */
+  DateMode                mDateMode;
+  std::vector<ttstr>      mTitles;
+  std::vector<tjs_uint32> mTitleHints;
+  std::vector<SQLULEN>    mRows;      /* rows without errors, when some have */
+  tjs_int                 mCount;
 
-    tjs_int colCount = countArray(titleRow);
-    tjs_int rowCount = countArray(table);
+public:
+  //----------------------------------------------------------------------
+  ODBCResultSet(Statement::Snapshot *snapshot, DateMode dateMode, SnapshotFile *file)
+    : mSnapshot(snapshot)
+    , mFile(file)
+    , mDateMode(dateMode)
+    , mCount(0)
+  {
+    for (size_t col = 0; col < mSnapshot->columns.size(); col++)
+      mTitles.push_back(ttstr(&mSnapshot->columns[col].name[0]));
+    mTitleHints.assign(mTitles.size(), 0);
 
-    std::vector<ttstr> titles;
-    for (tjs_int i = 0; i < colCount; i++)
-      titles.push_back(titleRowObj.GetValue(i, ncbTypedefs::Tag<ttstr>()));
+    const std::vector<SQLUSMALLINT> &status = mSnapshot->rows.status;
+    if (std::find(status.begin(), status.end(), SQLUSMALLINT(SQL_ROW_ERROR)) != status.end()) {
+      for (SQLULEN row = 0; row < mSnapshot->rows.rows; row++)
+        if (status[row] != SQL_ROW_ERROR)
+          mRows.push_back(row);
+      mCount = tjs_int(mRows.size());
+    } else
+      mCount = tjs_int(mSnapshot->rows.rows);
+  }
 
-    tTJSVariant result = createArray();
-    ncbPropAccessor resultObj(result);
-    
-    for (tjs_int rowIndex = 0; rowIndex < rowCount; rowIndex++) {
-      tTJSVariant row;
-      row = tableObj.GetValue(rowIndex, ncbTypedefs::Tag<tTJSVariant>());
-      ncbPropAccessor rowObj(row);
-      tTJSVariant rowDict = createDictionary();
-      ncbPropAccessor rowDictObj(rowDict);
-      for (tjs_int colIndex = 0; colIndex < colCount; colIndex++) {
-        tTJSVariant col = rowObj.GetValue(colIndex, ncbTypedefs::Tag<tTJSVariant>());
-        rowDictObj.SetValue(titles[colIndex].c_str(), col);
-      }
-      resultObj.FuncCall(0, L"add", &addHint, NULL, rowDict);
-    }
-    return result;
+  //----------------------------------------------------------------------
+  ~ODBCResultSet() {
+    delete mSnapshot;
+    delete mFile;
   }
 
   //----------------------------------------------------------------------
-  tTJSVariant convertQueryResultToSingleColumnArray(tTJSVariant table) {
-    ncbPropAccessor tableObj(table);
-    tableObj.FuncCall(0, L"shift", &shiftHint, NULL);
+  tjs_int getCount() {
+    return mCount;
+  }
 
-    tjs_int rowCount = countArray(table);
-    
+  //----------------------------------------------------------------------
+  tTJSVariant getColumns() {
     tTJSVariant result = createArray();
     ncbPropAccessor resultObj(result);
-
-    for (tjs_int rowIndex = 0; rowIndex < rowCount; rowIndex++) {
-      tTJSVariant row;
-      row = tableObj.GetValue(rowIndex, ncbTypedefs::Tag<tTJSVariant>(), 0);
-      ncbPropAccessor rowObj(row);
-      tTJSVariant colValue = rowObj.GetValue(tjs_int(0), ncbTypedefs::Tag<tTJSVariant>());
-      resultObj.FuncCall(0, L"add", &addHint, NULL, colValue);
-    }
+    for (std::vector<ttstr>::iterator iTitle = mTitles.begin();
+         iTitle != mTitles.end();
+         iTitle++)
+      resultObj.FuncCall(0, L"add", &addHint, NULL, *iTitle);
     return result;
   }
-  
+
   //----------------------------------------------------------------------
-  static tjs_error TJS_INTF_METHOD escapeString(tTJSVariant *result,
-                                                tjs_int numparams,
-                                                tTJSVariant **param,
-                                                iTJSDispatch2 *objthis) {
-    if (numparams == 0) return TJS_E_BADPARAMCOUNT;
-    ttstr str = *param[0];
-    ttstr func, delimiter = L" + ";
+  // a value by the row and the column index or name. void when either is
+  // out of the result.
+  tTJSVariant get(tjs_int row, tTJSVariant column) {
+    tjs_int col = findColumn(column);
+    if (row < 0 || row >= mCount || col < 0)
+      return tTJSVariant();
+    return getValue(row, col);
+  }
+
+  //----------------------------------------------------------------------
+  static tjs_error TJS_INTF_METHOD row(tTJSVariant *result,
+                                       tjs_int numparams,
+                                       tTJSVariant **param,
+                                       iTJSDispatch2 *objthis) {
+    ODBCResultSet *self = ncbInstanceAdaptor<ODBCResultSet>::GetNativeInstance(objthis);
+    if (! self) 
+      return TJS_E_NATIVECLASSCRASH;
+    if (numparams == 0)
+      return TJS_E_BADPARAMCOUNT;
+    tjs_int row = *param[0];
+    QueryResultType queryResultType = qrtArray;
     if (numparams >= 2)
-      func = *param[1];
-    if (numparams >= 3)
-      func = *param[2];
-    ttstr resultString = _escapeString(str, func, delimiter);
+      queryResultType = QueryResultType(tjs_int(*param[1]));
+    tTJSVariant rowResult;
+    rowResult = self->_row(row, queryResultType);
     if (result)
-      *result = resultString;
+      *result = rowResult;
     return TJS_S_OK;
   }
-    
+
   //----------------------------------------------------------------------
-  static ttstr _escapeString(ttstr str, ttstr func, ttstr delimiter) {
-    tTJSVariant resultArray = createArray();
-    ncbPropAccessor resultArrayObj(resultArray);
-    ttstr buf;
+  // a row as an array of the values, or a dictionary with qrtDictionary.
+  tTJSVariant _row(tjs_int row, QueryResultType queryResultType) {
+    if (row < 0 || row >= mCount)
+      return tTJSVariant();
 
-    for (const tjs_char *s = str.c_str();
-         *s;
-         s++) {
-      if ((*s) < 0x20
-          || (*s) == L'\'') {
-        if (! buf.IsEmpty()) {
-          resultArrayObj.FuncCall(0, L"add", &addHint, NULL, L"'" + buf + L"'");
-          buf = L"";
-        }
-        resultArrayObj.FuncCall(0, L"add", &addHint, NULL, L"CHAR(" + ttstr(tjs_int(*s)) + L")");
-      } else {
-        buf += *s;
-      }
+    if (queryResultType == qrtDictionary) {
+      tTJSVariant result = createDictionary();
+      ncbPropAccessor resultObj(result);
+      for (size_t col = 0; col < mTitles.size(); col++)
+        resultObj.SetValue(mTitles[col].c_str(), getValue(row, col), 0, &mTitleHints[col]);
+      return result;
     }
-    if (! buf.IsEmpty()) 
-      resultArrayObj.FuncCall(0, L"add", &addHint, NULL, L"'" + buf + L"'");
-
-    tTJSVariant result;
-    resultArrayObj.FuncCall(0, L"join", &joinHint, &result, delimiter);
 
-    return func + L"(" + result + L")";
+    tTJSVariant result = createArray();
+    ncbPropAccessor resultObj(result);
+    for (size_t col = 0; col < mTitles.size(); col++)
+      resultObj.FuncCall(0, L"add", &addHint, NULL, getValue(row, col));
+    return result;
   }
 
   //----------------------------------------------------------------------
-  static ttstr escapeStringAccess(ttstr str) {
-    return _escapeString(str, L"", L" + ");
+  // the values of a column by its index or name.
+  tTJSVariant column(tTJSVariant column) {
+    tjs_int col = findColumn(column);
+    if (col < 0)
+      return tTJSVariant();
+
+    tTJSVariant result = createArray();
+    iTJSDispatch2 *array = result.AsObjectNoAddRef();
+    for (tjs_int row = 0; row < mCount; row++) {
+      tTJSVariant value = getValue(row, col);
+      tTJSVariant *args[] = { &value };
+      array->FuncCall(0, L"add", &addHint, NULL, 1, args, array);
+    }
+    return result;
   }
 
+private:
   //----------------------------------------------------------------------
-  static ttstr escapeStringSQLServer(ttstr str) {
-    return _escapeString(str, L"", L" + ");
+  tjs_int findColumn(const tTJSVariant &column) {
+    if (column.Type() != tvtString) {
+      tjs_int col = column;
+      return col >= 0 && col < tjs_int(mTitles.size()) ? col : -1;
+    }
+    ttstr name(column);
+    for (size_t col = 0; col < mTitles.size(); col++)
+      if (mTitles[col] == name)
+        return tjs_int(col);
+    return -1;
   }
 
   //----------------------------------------------------------------------
-  static ttstr escapeStringOracle(ttstr str) {
-    return _escapeString(str, L"CONCAT", L", ");
+  tTJSVariant getValue(tjs_int row, size_t col) {
+    SQLULEN index = mRows.empty() ? SQLULEN(row) : mRows[row];
+    return Statement::getSnapshotValue(*mSnapshot, index, col, mDateMode);
   }
+};
 
-  //----------------------------------------------------------------------
-  static ttstr escapeStringMySQL(ttstr str) {
-    return _escapeString(str, L"CONCAT", L", ");
+//----------------------------------------------------------------------
+tTJSVariant Statement::createResultSet(Snapshot *snapshot, DateMode dateMode, SnapshotFile *file)
+{
+  ODBCResultSet *resultSet;
+  try {
+    resultSet = new ODBCResultSet(snapshot, dateMode, file);
+  } catch (...) {
+    delete snapshot;
+    delete file;
+    throw;
+  }
+  iTJSDispatch2 *obj;
+  try {
+    obj = ncbInstanceAdaptor<ODBCResultSet>::CreateAdaptor(resultSet);
+  } catch (...) {
+    delete resultSet;
+    throw;
+  }
+  tTJSVariant result(obj, obj);
+  obj->Release();
+  return result;
+}
+
+//----------------------------------------------------------------------
+tjs_error TJS_INTF_METHOD ODBC::prepare(tTJSVariant *result,
+                                        tjs_int numparams,
+                                        tTJSVariant **param,
+                                        iTJSDispatch2 *objthis) {
+  ODBC *self = ncbInstanceAdaptor<ODBC>::GetNativeInstance(objthis);
+  if (! self) 
+    return TJS_E_NATIVECLASSCRASH;
+  if (numparams == 0)
+    return TJS_E_BADPARAMCOUNT;
+  if (! self->mIsConnected) 
+    TVPThrowExceptionMessage(L"SQL connection is not established.");
+  ttstr sqlStr;
+  sqlStr = *param[0];
+  ODBCStatement *prepared = new ODBCStatement(self, self->checkoutStatement(sqlStr));
+  self->mStatementHolders.push_back(prepared);
+  iTJSDispatch2 *obj = ncbInstanceAdaptor<ODBCStatement>::CreateAdaptor(prepared);
+  if (result)
+    *result = tTJSVariant(obj, obj);
+  obj->Release();
+  return TJS_S_OK;
+}
+
+//----------------------------------------------------------------------
+tjs_error TJS_INTF_METHOD ODBC::openCursor(tTJSVariant *result,
+                                           tjs_int numparams,
+                                           tTJSVariant **param,
+                                           iTJSDispatch2 *objthis) {
+  ODBC *self = ncbInstanceAdaptor<ODBC>::GetNativeInstance(objthis);
+  if (! self) 
+    return TJS_E_NATIVECLASSCRASH;
+  if (numparams == 0)
+    return TJS_E_BADPARAMCOUNT;
+  if (! self->mIsConnected) 
+    TVPThrowExceptionMessage(L"SQL connection is not established.");
+  ttstr sqlStr;
+  sqlStr = *param[0];
+  QueryResultType queryResultType = qrtArray;
+  if (numparams >= 2)
+    queryResultType = QueryResultType(tjs_int(*param[1]));
+  tTJSVariant params;
+  if (numparams >= 3)
+    params = *param[2];
+  FetchOptions options = self->mOptions;
+  if (numparams >= 4)
+    getLimitOptions(*param[3], options);
+  self->noteWrite(sqlStr);
+
+  // each cursor has its own statement so that other queries can run
+  // while it is open.
+  Statement *statement;
+  bool opened;
+  if (params.Type() == tvtVoid) {
+    statement = self->acquireStatement();
+    try {
+      opened = statement->execDirectCursor(sqlStr, queryResultType, options);
+    } catch (...) {
+      self->recycleStatement(statement);
+      throw;
+    }
+    if (! opened)
+      self->recycleStatement(statement);
+  } else {
+    statement = self->checkoutStatement(sqlStr);
+    try {
+      opened = statement->executeCursor(params, queryResultType, options);
+    } catch (...) {
+      statement->reset();
+      self->checkinStatement(statement);
+      throw;
+    }
+    if (! opened) {
+      statement->reset();
+      self->checkinStatement(statement);
+    }
   }
 
-  //----------------------------------------------------------------------
-  static ttstr escapeStringPostgreSQL(ttstr str) {
-    return _escapeString(str, L"", L" || ");
+  // statements without a result set return void, as query() does.
+  if (! opened) {
+    if (result)
+      result->Clear();
+    return TJS_S_OK;
   }
 
-  //----------------------------------------------------------------------
-  static ttstr encodeDate(tTJSVariant _date) {
-    ncbPropAccessor dateObj(_date);
-    tTJSVariant year, month, date, hours, minutes, seconds;
-    dateObj.FuncCall(0, L"getYear", &getYearHint, &year);
-    dateObj.FuncCall(0, L"getMonth", &getMonthHint, &month);
-    dateObj.FuncCall(0, L"getDate", &getDateHint, &date);
-    dateObj.FuncCall(0, L"getHours", &getHoursHint, &hours);
-    dateObj.FuncCall(0, L"getMinutes", &getMinutesHint, &minutes);
-    dateObj.FuncCall(0, L"getSeconds", &getSecondsHint, &seconds);
-    WCHAR buf[1024];
-    swprintf_s(buf,
-               1024,
-               L"'%04d-%02d-%02d %02d:%02d:%02d'",
-               tjs_int(year),
-               tjs_int(month) + 1,
-               tjs_int(date),
-               tjs_int(hours),
-               tjs_int(minutes),
-               tjs_int(seconds));
-    return ttstr(buf);
+  ODBCCursor *cursor = new ODBCCursor(self, statement, queryResultType);
+  self->mStatementHolders.push_back(cursor);
+  iTJSDispatch2 *obj = ncbInstanceAdaptor<ODBCCursor>::CreateAdaptor(cursor);
+  if (result)
+    *result = tTJSVariant(obj, obj);
+  obj->Release();
+  return TJS_S_OK;
+}
+
+//----------------------------------------------------------------------
+void TJS_INTF_METHOD AsyncDispatcher::OnContinuousCallback(tjs_uint64 tick)
+{
+  // one at a time, as a callback may throw.
+  for (;;) {
+    EnterCriticalSection(&mLock);
+    if (mFinished.empty()) {
+      LeaveCriticalSection(&mLock);
+      break;
+    }
+    AsyncQuery *query = mFinished.front();
+    mFinished.pop_front();
+    LeaveCriticalSection(&mLock);
+    release();
+    query->owner->finishAsyncQuery(query);
   }
-};
+}
+
+//----------------------------------------------------------------------
+void releaseConnectionPool(void)
+{
+  if (connectionPool) {
+    delete connectionPool;
+    connectionPool = NULL;
+  }
+}
+
+//----------------------------------------------------------------------
+void releaseAsyncDispatcher(void)
+{
+  if (asyncDispatcher) {
+    delete asyncDispatcher;
+    asyncDispatcher = NULL;
+  }
+  if (workerLogIndex != TLS_OUT_OF_INDEXES) {
+    TlsFree(workerLogIndex);
+    workerLogIndex = TLS_OUT_OF_INDEXES;
+  }
+}
 
 NCB_REGISTER_CLASS(ODBC)
 {
   Constructor();
 
-  Variant("qrtArray", int(ODBC::qrtArray));
-  Variant("qrtDictionary", int(ODBC::qrtDictionary));
-  Variant("qrtSingleColumnArray", int(ODBC::qrtSingleColumnArray));
+  Variant("qrtArray", int(qrtArray));
+  Variant("qrtDictionary", int(qrtDictionary));
+  Variant("qrtSingleColumnArray", int(qrtSingleColumnArray));
+  Variant("qrtColumns", int(qrtColumns));
+  Variant("qrtPackedColumns", int(qrtPackedColumns));
+  Variant("qrtResultSet", int(qrtResultSet));
+
+  Variant("dmReal", int(dmReal));
+  Variant("dmExact", int(dmExact));
+
+  Variant("dtmDate", int(dtmDate));
+  Variant("dtmTime", int(dtmTime));
+
+  Variant("edGeneric", int(edGeneric));
+  Variant("edAccess", int(edAccess));
+  Variant("edSQLServer", int(edSQLServer));
+  Variant("edOracle", int(edOracle));
+  Variant("edMySQL", int(edMySQL));
+  Variant("edPostgreSQL", int(edPostgreSQL));
+
+  Variant("efCSV", int(efCSV));
+  Variant("efTSV", int(efTSV));
+  Variant("efJSONLines", int(efJSONLines));
+
+  Variant("eqMinimal", int(eqMinimal));
+  Variant("eqAll", int(eqAll));
+  Variant("eqNonNumeric", int(eqNonNumeric));
+  Variant("eqNone", int(eqNone));
+
+  Variant("eeUTF8", int(eeUTF8));
+  Variant("eeUTF8BOM", int(eeUTF8BOM));
+  Variant("eeUTF16LE", int(eeUTF16LE));
+
+  Variant("psSuccess", int(SQL_PARAM_SUCCESS));
+  Variant("psSuccessWithInfo", int(SQL_PARAM_SUCCESS_WITH_INFO));
+  Variant("psError", int(SQL_PARAM_ERROR));
+  Variant("psUnused", int(SQL_PARAM_UNUSED));
+  Variant("psDiagUnavailable", int(SQL_PARAM_DIAG_UNAVAILABLE));
+
+  Variant("tilReadUncommitted", int(SQL_TXN_READ_UNCOMMITTED));
+  Variant("tilReadCommitted", int(SQL_TXN_READ_COMMITTED));
+  Variant("tilRepeatableRead", int(SQL_TXN_REPEATABLE_READ));
+  Variant("tilSerializable", int(SQL_TXN_SERIALIZABLE));
   
   NCB_PROPERTY_RO(connected, getConnected);
+  NCB_PROPERTY(fetchRowsetSize, getFetchRowsetSize, setFetchRowsetSize);
+  NCB_PROPERTY(prefetchDepth, getPrefetchDepth, setPrefetchDepth);
+  NCB_PROPERTY(prefetchLimit, getPrefetchLimit, setPrefetchLimit);
+  NCB_PROPERTY(lobChunkSize, getLobChunkSize, setLobChunkSize);
+  NCB_PROPERTY(decimalMode, getDecimalMode, setDecimalMode);
+  NCB_PROPERTY(dateMode, getDateMode, setDateMode);
+  NCB_PROPERTY(queryTimeout, getQueryTimeout, setQueryTimeout);
+  NCB_PROPERTY(maxRows, getMaxRows, setMaxRows);
+  NCB_PROPERTY(maxBytes, getMaxBytes, setMaxBytes);
   NCB_METHOD_RAW_CALLBACK(connect, ODBC::connect, 0);
   NCB_METHOD(disconnect);
   NCB_METHOD_RAW_CALLBACK(query, ODBC::query, 0);
+  NCB_METHOD_RAW_CALLBACK(queryBatch, ODBC::queryBatch, 0);
+  NCB_METHOD_RAW_CALLBACK(queryAll, ODBC::queryAll, 0);
+  NCB_PROPERTY(parallelism, getParallelism, setParallelism);
+  NCB_METHOD_RAW_CALLBACK(readLob, ODBC::readLob, 0);
+  NCB_METHOD_RAW_CALLBACK(exportQuery, ODBC::exportQuery, 0);
+  NCB_METHOD_RAW_CALLBACK(saveSnapshot, ODBC::saveSnapshot, 0);
+  NCB_METHOD_RAW_CALLBACK(loadSnapshot, ODBC::loadSnapshot, 0);
+  NCB_METHOD(schemaHash);
+  NCB_METHOD_RAW_CALLBACK(prepare, ODBC::prepare, 0);
+  NCB_METHOD_RAW_CALLBACK(openCursor, ODBC::openCursor, 0);
+  NCB_METHOD(executeBatch);
+  NCB_METHOD(queryAsync);
+  NCB_METHOD(cancel);
+  NCB_PROPERTY(asyncLimit, getAsyncLimit, setAsyncLimit);
+  NCB_PROPERTY_RO(asyncQueries, getAsyncQueries);
+  NCB_PROPERTY(poolMinSize, getPoolMinSize, setPoolMinSize);
+  NCB_PROPERTY(poolMaxSize, getPoolMaxSize, setPoolMaxSize);
+  NCB_PROPERTY(poolIdleTimeout, getPoolIdleTimeout, setPoolIdleTimeout);
+  NCB_PROPERTY(poolValidationQuery, getPoolValidationQuery, setPoolValidationQuery);
+  NCB_PROPERTY_RO(poolHits, getPoolHits);
+  NCB_PROPERTY_RO(poolMisses, getPoolMisses);
+  NCB_PROPERTY_RO(poolEvictions, getPoolEvictions);
+  NCB_PROPERTY_RO(poolIdleConnections, getPoolIdleConnections);
+  NCB_PROPERTY(batchSize, getBatchSize, setBatchSize);
+  NCB_METHOD(begin);
+  NCB_METHOD(commit);
+  NCB_METHOD(rollback);
+  NCB_PROPERTY_RO(inTransaction, getInTransaction);
+  NCB_PROPERTY(isolationLevel, getIsolationLevel, setIsolationLevel);
+  NCB_PROPERTY(commitInterval, getCommitInterval, setCommitInterval);
+  NCB_PROPERTY(commitTime, getCommitTime, setCommitTime);
+  NCB_PROPERTY_RO(uncommitted, getUncommitted);
+
+  NCB_PROPERTY(statementCacheSize, getStatementCacheSize, setStatementCacheSize);
+  NCB_PROPERTY_RO(statementCacheHits, getStatementCacheHits);
+  NCB_PROPERTY_RO(statementCacheMisses, getStatementCacheMisses);
+  NCB_PROPERTY(statementPoolSize, getStatementPoolSize, setStatementPoolSize);
+  NCB_PROPERTY_RO(idleStatements, getIdleStatements);
+  NCB_PROPERTY(columnCacheSize, getColumnCacheSize, setColumnCacheSize);
+  NCB_PROPERTY_RO(columnCacheHits, getColumnCacheHits);
+  NCB_PROPERTY_RO(columnCacheMisses, getColumnCacheMisses);
+  NCB_METHOD(clearColumnCache);
+  NCB_METHOD_RAW_CALLBACK(queryCached, ODBC::queryCached, 0);
+  NCB_METHOD_RAW_CALLBACK(invalidate, ODBC::invalidate, 0);
+  NCB_PROPERTY(resultCacheTtl, getResultCacheTtl, setResultCacheTtl);
+  NCB_PROPERTY(resultCacheBudget, getResultCacheBudget, setResultCacheBudget);
+  NCB_PROPERTY_RO(resultCacheHits, getResultCacheHits);
+  NCB_PROPERTY_RO(resultCacheMisses, getResultCacheMisses);
+  NCB_PROPERTY_RO(resultCacheBytes, getResultCacheBytes);
+  NCB_PROPERTY(logAffectedRows, getLogAffectedRows, setLogAffectedRows);
+  NCB_PROPERTY_RO(profile, getProfile);
+  NCB_PROPERTY_RO(slowQueries, getSlowQueries);
+  NCB_PROPERTY(slowQueryCount, getSlowQueryCount, setSlowQueryCount);
+  NCB_PROPERTY(slowQueryThreshold, getSlowQueryThreshold, setSlowQueryThreshold);
+  NCB_METHOD(resetProfile);
   
   NCB_METHOD_RAW_CALLBACK(escapeString, ODBC::escapeString, 0);
   NCB_METHOD(escapeStringAccess);
@@ -682,7 +7280,38 @@ NCB_REGISTER_CLASS(ODBC)
   NCB_METHOD(escapeStringOracle);
   NCB_METHOD(escapeStringMySQL);
   NCB_METHOD(escapeStringPostgreSQL);
+  NCB_METHOD_RAW_CALLBACK(escapeStrings, ODBC::escapeStrings, 0);
+  NCB_METHOD_RAW_CALLBACK(buildInList, ODBC::buildInList, 0);
 
   NCB_METHOD(encodeDate);
 };
 
+NCB_REGISTER_CLASS(ODBCStatement)
+{
+  NCB_PROPERTY_RO(sql, getSql);
+  NCB_METHOD_RAW_CALLBACK(execute, ODBCStatement::execute, 0);
+  NCB_METHOD(executeBatch);
+  NCB_METHOD(close);
+};
+
+NCB_REGISTER_CLASS(ODBCCursor)
+{
+  NCB_PROPERTY_RO(columns, getColumns);
+  NCB_METHOD(fetch);
+  NCB_METHOD(fetchOne);
+  NCB_METHOD(each);
+  NCB_METHOD(close);
+};
+
+NCB_REGISTER_CLASS(ODBCResultSet)
+{
+  NCB_PROPERTY_RO(count, getCount);
+  NCB_PROPERTY_RO(columns, getColumns);
+  NCB_METHOD(get);
+  NCB_METHOD_RAW_CALLBACK(row, ODBCResultSet::row, 0);
+  NCB_METHOD(column);
+};
+
+NCB_PRE_UNREGIST_CALLBACK(releaseStaticObjects);
+NCB_PRE_UNREGIST_CALLBACK(releaseAsyncDispatcher);
+NCB_PRE_UNREGIST_CALLBACK(releaseConnectionPool);